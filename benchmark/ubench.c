@@ -22,9 +22,16 @@
 #include <umf/pools/pool_scalable.h>
 #endif
 
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <unistd.h>
 
+#include "base_alloc.h"
+#include "base_alloc_linear.h"
+#include "critnib.h"
+#include "page_map.h"
 #include "ubench.h"
 
 // BENCHMARK CONFIG
@@ -41,6 +48,31 @@
 #define DISJOINT_POOL_MIN_BUCKET_SIZE (ALLOC_SIZE)
 #define DISJOINT_POOL_TRACE (0)
 
+// DISJOINT POOL SMALL CHUNKS CONFIG
+#define SMALL_CHUNKS_N_ALLOCS (16 * 1024)
+#define SMALL_CHUNKS_MIN_SIZE (8)
+#define SMALL_CHUNKS_MAX_SIZE (64)
+#define SMALL_CHUNKS_SLAB_MIN_SIZE (64 * 1024)
+
+// CRITNIB CONFIG
+#define CRITNIB_N_THREADS (8)
+#define CRITNIB_N_KEYS (4 * 1024)
+
+// base allocator config
+#define BA_N_THREADS (8)
+#define BA_N_ALLOCS (4 * 1024)
+#define BA_ALLOC_SIZE (64)
+
+// tracker maps config
+#define TRACKER_N_RANGES (16 * 1024)
+#define TRACKER_RANGE_SIZE (64 * 1024)
+#define TRACKER_FIRST_RANGE ((uintptr_t)0x7f0000000000)
+
+// tracker config of many small allocations
+#define TRACKER_LARGE_N_RANGES (1024 * 1024)
+#define TRACKER_LARGE_RANGE_SIZE (4 * 1024)
+#define TRACKER_LARGE_N_LOOKUPS (64 * 1024)
+
 typedef struct alloc_s {
     void *ptr;
     size_t size;
@@ -177,6 +209,16 @@ static void w_umfPoolFree(void *provider, void *ptr, size_t size) {
         exit(-1);
     }
 }
+
+// free the memory looking up its pool by the pointer
+static void w_umfFree(void *provider, void *ptr, size_t size) {
+    (void)provider;
+    enum umf_result_t umf_result;
+    umf_result = umfFree(ptr);
+    if (umf_result != UMF_RESULT_SUCCESS) {
+        exit(-1);
+    }
+}
 #endif /* (defined UMF_BUILD_OS_MEMORY_PROVIDER) && ((defined UMF_BUILD_LIBUMF_POOL_DISJOINT) || (defined UMF_BUILD_LIBUMF_POOL_JEMALLOC) || (defined UMF_BUILD_LIBUMF_POOL_SCALABLE)) */
 
 #if (defined UMF_BUILD_LIBUMF_POOL_DISJOINT) &&                                \
@@ -222,6 +264,118 @@ UBENCH_EX(simple, disjoint_pool_with_os_memory_provider) {
     umfMemoryProviderDestroy(os_memory_provider);
     free(array);
 }
+
+// Free and reallocate chunks in a pseudo-random order, so that almost every
+// allocation has to find the only free chunk in an almost full slab.
+static void do_small_chunks_benchmark(alloc_t *array, size_t n_allocs,
+                                      umf_memory_pool_handle_t pool) {
+    unsigned seed = 1;
+    for (size_t i = 0; i < n_allocs; i++) {
+        seed = seed * 1103515245 + 12345;
+        size_t idx = (seed >> 8) % n_allocs;
+        w_umfPoolFree(pool, array[idx].ptr, array[idx].size);
+        array[idx].ptr = w_umfPoolMalloc(pool, array[idx].size, 0);
+        if (array[idx].ptr == NULL) {
+            exit(-1);
+        }
+    }
+}
+
+UBENCH_EX(simple, disjoint_pool_small_chunks_with_os_memory_provider) {
+    alloc_t *array = alloc_array(SMALL_CHUNKS_N_ALLOCS);
+
+    enum umf_result_t umf_result;
+    umf_memory_provider_handle_t os_memory_provider = NULL;
+    umf_result = umfMemoryProviderCreate(umfOsMemoryProviderOps(),
+                                         &UMF_OS_MEMORY_PROVIDER_PARAMS,
+                                         &os_memory_provider);
+    if (umf_result != UMF_RESULT_SUCCESS) {
+        exit(-1);
+    }
+
+    umf_disjoint_pool_params_t disjoint_memory_pool_params = {};
+    disjoint_memory_pool_params.SlabMinSize = SMALL_CHUNKS_SLAB_MIN_SIZE;
+    disjoint_memory_pool_params.MaxPoolableSize = SMALL_CHUNKS_SLAB_MIN_SIZE;
+    disjoint_memory_pool_params.Capacity = DISJOINT_POOL_CAPACITY;
+    disjoint_memory_pool_params.MinBucketSize = SMALL_CHUNKS_MIN_SIZE;
+    disjoint_memory_pool_params.PoolTrace = DISJOINT_POOL_TRACE;
+
+    umf_memory_pool_handle_t disjoint_pool;
+    umf_result = umfPoolCreate(umfDisjointPoolOps(), os_memory_provider,
+                               &disjoint_memory_pool_params, 0, &disjoint_pool);
+    if (umf_result != UMF_RESULT_SUCCESS) {
+        exit(-1);
+    }
+
+    // fill up the slabs with chunks of 8, 16, 32 and 64 bytes
+    size_t size = SMALL_CHUNKS_MIN_SIZE;
+    for (size_t i = 0; i < SMALL_CHUNKS_N_ALLOCS; i++) {
+        array[i].size = size;
+        array[i].ptr = w_umfPoolMalloc(disjoint_pool, size, 0);
+        if (array[i].ptr == NULL) {
+            exit(-1);
+        }
+        size = (size == SMALL_CHUNKS_MAX_SIZE) ? SMALL_CHUNKS_MIN_SIZE
+                                               : 2 * size;
+    }
+
+    do_small_chunks_benchmark(array, SMALL_CHUNKS_N_ALLOCS,
+                              disjoint_pool); // WARMUP
+
+    UBENCH_DO_BENCHMARK() {
+        do_small_chunks_benchmark(array, SMALL_CHUNKS_N_ALLOCS, disjoint_pool);
+    }
+
+    for (size_t i = 0; i < SMALL_CHUNKS_N_ALLOCS; i++) {
+        w_umfPoolFree(disjoint_pool, array[i].ptr, array[i].size);
+    }
+
+    umfPoolDestroy(disjoint_pool);
+    umfMemoryProviderDestroy(os_memory_provider);
+    free(array);
+}
+
+// Allocate small chunks and free them with umfFree(), which has to find
+// the pool of each chunk in the memory tracker.
+UBENCH_EX(simple, disjoint_pool_umfFree_with_os_memory_provider) {
+    alloc_t *array = alloc_array(SMALL_CHUNKS_N_ALLOCS);
+
+    enum umf_result_t umf_result;
+    umf_memory_provider_handle_t os_memory_provider = NULL;
+    umf_result = umfMemoryProviderCreate(umfOsMemoryProviderOps(),
+                                         &UMF_OS_MEMORY_PROVIDER_PARAMS,
+                                         &os_memory_provider);
+    if (umf_result != UMF_RESULT_SUCCESS) {
+        exit(-1);
+    }
+
+    umf_disjoint_pool_params_t disjoint_memory_pool_params = {};
+    disjoint_memory_pool_params.SlabMinSize = SMALL_CHUNKS_SLAB_MIN_SIZE;
+    disjoint_memory_pool_params.MaxPoolableSize = SMALL_CHUNKS_SLAB_MIN_SIZE;
+    disjoint_memory_pool_params.Capacity = DISJOINT_POOL_CAPACITY;
+    disjoint_memory_pool_params.MinBucketSize = SMALL_CHUNKS_MIN_SIZE;
+    disjoint_memory_pool_params.PoolTrace = DISJOINT_POOL_TRACE;
+
+    umf_memory_pool_handle_t disjoint_pool;
+    umf_result = umfPoolCreate(umfDisjointPoolOps(), os_memory_provider,
+                               &disjoint_memory_pool_params, 0, &disjoint_pool);
+    if (umf_result != UMF_RESULT_SUCCESS) {
+        exit(-1);
+    }
+
+    Alloc_size = SMALL_CHUNKS_MAX_SIZE;
+    do_benchmark(array, SMALL_CHUNKS_N_ALLOCS, w_umfPoolMalloc, w_umfFree,
+                 disjoint_pool); // WARMUP
+
+    UBENCH_DO_BENCHMARK() {
+        do_benchmark(array, SMALL_CHUNKS_N_ALLOCS, w_umfPoolMalloc, w_umfFree,
+                     disjoint_pool);
+    }
+
+    umfPoolDestroy(disjoint_pool);
+    umfMemoryProviderDestroy(os_memory_provider);
+    free(array);
+}
 #endif /* (defined UMF_BUILD_LIBUMF_POOL_DISJOINT) && (defined UMF_BUILD_OS_MEMORY_PROVIDER) */
 
 #if (defined UMF_BUILD_LIBUMF_POOL_JEMALLOC) &&                                \
@@ -298,4 +452,388 @@ UBENCH_EX(simple, scalable_pool_with_os_memory_provider) {
 }
 #endif /* (defined UMF_BUILD_LIBUMF_POOL_SCALABLE) && (defined UMF_BUILD_OS_MEMORY_PROVIDER) */
 
+////////////////// CRITNIB CONCURRENT INSERT/REMOVE
+
+typedef struct critnib_args_s {
+    critnib *c;
+    uintptr_t first_key;
+} critnib_args_t;
+
+// Each thread inserts and then removes its own range of page-aligned keys,
+// like the tracking provider does on provider allocations and frees.
+static void *critnib_insert_remove(void *arg) {
+    critnib_args_t *args = arg;
+    for (uintptr_t i = 0; i < CRITNIB_N_KEYS; i++) {
+        uintptr_t key = (args->first_key + i) * 4096;
+        if (critnib_insert(args->c, key, (void *)key, 0)) {
+            exit(-1);
+        }
+    }
+
+    for (uintptr_t i = 0; i < CRITNIB_N_KEYS; i++) {
+        uintptr_t key = (args->first_key + i) * 4096;
+        if (critnib_remove(args->c, key) != (void *)key) {
+            exit(-1);
+        }
+    }
+
+    return NULL;
+}
+
+static void do_critnib_benchmark(critnib *c) {
+    pthread_t threads[CRITNIB_N_THREADS];
+    critnib_args_t args[CRITNIB_N_THREADS];
+
+    for (int i = 0; i < CRITNIB_N_THREADS; i++) {
+        args[i].c = c;
+        args[i].first_key = (uintptr_t)(i + 1) * CRITNIB_N_KEYS;
+        if (pthread_create(&threads[i], NULL, critnib_insert_remove,
+                           &args[i])) {
+            exit(-1);
+        }
+    }
+
+    for (int i = 0; i < CRITNIB_N_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+UBENCH_EX(simple, critnib_concurrent_insert_remove) {
+    critnib *c = critnib_new();
+    if (c == NULL) {
+        exit(-1);
+    }
+
+    do_critnib_benchmark(c); // WARMUP
+
+    UBENCH_DO_BENCHMARK() { do_critnib_benchmark(c); }
+
+    critnib_delete(c);
+}
+
+////////////////// BASE ALLOCATOR CONCURRENT ALLOC/FREE
+
+// Each thread allocates chunks and frees them in the reverse order, like
+// critnib nodes and tracker entries are allocated and freed by the threads
+// allocating memory from pools.
+static void *ba_alloc_free(void *arg) {
+    umf_ba_pool_t *pool = arg;
+    void *ptrs[BA_N_ALLOCS];
+    for (int i = 0; i < BA_N_ALLOCS; i++) {
+        ptrs[i] = umf_ba_alloc(pool);
+        if (ptrs[i] == NULL) {
+            exit(-1);
+        }
+    }
+
+    for (int i = BA_N_ALLOCS - 1; i >= 0; i--) {
+        umf_ba_free(pool, ptrs[i]);
+    }
+
+    return NULL;
+}
+
+static void do_ba_benchmark(umf_ba_pool_t *pool) {
+    pthread_t threads[BA_N_THREADS];
+
+    for (int i = 0; i < BA_N_THREADS; i++) {
+        if (pthread_create(&threads[i], NULL, ba_alloc_free, pool)) {
+            exit(-1);
+        }
+    }
+
+    for (int i = 0; i < BA_N_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+UBENCH_EX(simple, base_alloc_concurrent_alloc_free) {
+    umf_ba_pool_t *pool = umf_ba_create(BA_ALLOC_SIZE);
+    if (pool == NULL) {
+        exit(-1);
+    }
+
+    do_ba_benchmark(pool); // WARMUP
+
+    UBENCH_DO_BENCHMARK() { do_ba_benchmark(pool); }
+
+    umf_ba_destroy(pool);
+}
+
+////////////////// LINEAR BASE ALLOCATOR CONCURRENT ALLOC
+
+// All threads allocate from one linear pool at once, like the buffers of
+// requests handled in parallel are allocated from a scratch arena, which
+// is reset after all of them are done.
+static void *ba_linear_alloc(void *arg) {
+    umf_ba_linear_pool_t *pool = arg;
+    for (int i = 0; i < BA_N_ALLOCS; i++) {
+        if (umf_ba_linear_alloc(pool, BA_ALLOC_SIZE) == NULL) {
+            exit(-1);
+        }
+    }
+
+    return NULL;
+}
+
+static void do_ba_linear_benchmark(umf_ba_linear_pool_t *pool) {
+    pthread_t threads[BA_N_THREADS];
+
+    for (int i = 0; i < BA_N_THREADS; i++) {
+        if (pthread_create(&threads[i], NULL, ba_linear_alloc, pool)) {
+            exit(-1);
+        }
+    }
+
+    for (int i = 0; i < BA_N_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    umf_ba_linear_reset(pool);
+}
+
+UBENCH_EX(simple, base_alloc_linear_concurrent_alloc) {
+    umf_ba_linear_pool_t *pool = umf_ba_linear_create(0);
+    if (pool == NULL) {
+        exit(-1);
+    }
+
+    do_ba_linear_benchmark(pool); // WARMUP
+
+    UBENCH_DO_BENCHMARK() { do_ba_linear_benchmark(pool); }
+
+    umf_ba_linear_destroy(pool);
+}
+
+////////////////// TRACKER MAPS: CRITNIB VS PAGE MAP
+
+// Ranges of TRACKER_RANGE_SIZE bytes, like slabs of a pool, are inserted into
+// the map and then looked up by addresses inside them in a pseudo-random
+// order, like the memory tracker does in umfPoolByPtr().
+
+static uintptr_t tracker_range(size_t i) {
+    return TRACKER_FIRST_RANGE + i * TRACKER_RANGE_SIZE;
+}
+
+static uintptr_t tracker_lookup_addr(unsigned *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    size_t i = (*seed >> 8) % TRACKER_N_RANGES;
+    return tracker_range(i) + (*seed & (TRACKER_RANGE_SIZE - 1));
+}
+
+// resident memory of the process
+static size_t get_rss(void) {
+    long size = 0, rss = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f) {
+        if (fscanf(f, "%ld %ld", &size, &rss) != 2) {
+            rss = 0;
+        }
+        fclose(f);
+    }
+    return (size_t)rss * getpagesize();
+}
+
+static void tracker_print_memory(const char *name, size_t rss_before) {
+    printf("%s: %zu KiB of memory for %d ranges\n", name,
+           (get_rss() - rss_before) / 1024, TRACKER_N_RANGES);
+}
+
+static void critnib_insert_ranges(critnib *c) {
+    for (size_t i = 0; i < TRACKER_N_RANGES; i++) {
+        if (critnib_insert(c, tracker_range(i), (void *)tracker_range(i), 0)) {
+            exit(-1);
+        }
+    }
+}
+
+static void critnib_remove_ranges(critnib *c) {
+    for (size_t i = 0; i < TRACKER_N_RANGES; i++) {
+        if (critnib_remove(c, tracker_range(i)) != (void *)tracker_range(i)) {
+            exit(-1);
+        }
+    }
+}
+
+static void page_map_insert_ranges(page_map *pm) {
+    for (size_t i = 0; i < TRACKER_N_RANGES; i++) {
+        if (page_map_set(pm, tracker_range(i), TRACKER_RANGE_SIZE,
+                         (void *)tracker_range(i))) {
+            exit(-1);
+        }
+    }
+}
+
+static void page_map_remove_ranges(page_map *pm) {
+    for (size_t i = 0; i < TRACKER_N_RANGES; i++) {
+        page_map_clear(pm, tracker_range(i), TRACKER_RANGE_SIZE);
+    }
+}
+
+static void do_critnib_lookup_benchmark(critnib *c) {
+    unsigned seed = 1;
+    for (size_t i = 0; i < TRACKER_N_RANGES; i++) {
+        uintptr_t addr = tracker_lookup_addr(&seed);
+        uintptr_t rkey;
+        void *rvalue;
+        if (!critnib_find(c, addr, FIND_LE, &rkey, &rvalue) ||
+            addr - rkey >= TRACKER_RANGE_SIZE) {
+            exit(-1);
+        }
+    }
+}
+
+static void do_page_map_lookup_benchmark(page_map *pm) {
+    unsigned seed = 1;
+    for (size_t i = 0; i < TRACKER_N_RANGES; i++) {
+        uintptr_t addr = tracker_lookup_addr(&seed);
+        if (page_map_get(pm, addr) == NULL) {
+            exit(-1);
+        }
+    }
+}
+
+UBENCH_EX(simple, tracker_critnib_insert_remove) {
+    size_t rss_before = get_rss();
+    critnib *c = critnib_new();
+    if (c == NULL) {
+        exit(-1);
+    }
+
+    critnib_insert_ranges(c); // WARMUP
+    tracker_print_memory("critnib", rss_before);
+    critnib_remove_ranges(c);
+
+    UBENCH_DO_BENCHMARK() {
+        critnib_insert_ranges(c);
+        critnib_remove_ranges(c);
+    }
+
+    critnib_delete(c);
+}
+
+UBENCH_EX(simple, tracker_page_map_insert_remove) {
+    size_t rss_before = get_rss();
+    page_map *pm = page_map_new();
+    if (pm == NULL) {
+        exit(-1);
+    }
+
+    page_map_insert_ranges(pm); // WARMUP
+    tracker_print_memory("page map", rss_before);
+    page_map_remove_ranges(pm);
+
+    UBENCH_DO_BENCHMARK() {
+        page_map_insert_ranges(pm);
+        page_map_remove_ranges(pm);
+    }
+
+    page_map_delete(pm);
+}
+
+UBENCH_EX(simple, tracker_critnib_lookup) {
+    critnib *c = critnib_new();
+    if (c == NULL) {
+        exit(-1);
+    }
+
+    critnib_insert_ranges(c);
+
+    UBENCH_DO_BENCHMARK() { do_critnib_lookup_benchmark(c); }
+
+    critnib_remove_ranges(c);
+    critnib_delete(c);
+}
+
+UBENCH_EX(simple, tracker_page_map_lookup) {
+    page_map *pm = page_map_new();
+    if (pm == NULL) {
+        exit(-1);
+    }
+
+    page_map_insert_ranges(pm);
+
+    UBENCH_DO_BENCHMARK() { do_page_map_lookup_benchmark(pm); }
+
+    page_map_remove_ranges(pm);
+    page_map_delete(pm);
+}
+
+////////////////// TRACKER LOOKUP OF MANY ALLOCATIONS
+
+// Many small allocations are tracked, so the nodes and leaves of the critnib
+// are spread over many pages and the lookups in a pseudo-random order miss
+// the TLB unless the base allocator backs them with huge pages
+// (UMF_ENABLE_BA_HUGE_PAGES).
+
+typedef struct tracker_large_value_t {
+    void *pool;
+    size_t size;
+} tracker_large_value_t;
+
+static uintptr_t tracker_large_range(size_t i) {
+    return TRACKER_FIRST_RANGE + i * TRACKER_LARGE_RANGE_SIZE;
+}
+
+// memory of the process backed by transparent huge pages
+static size_t get_anon_huge_pages(void) {
+    size_t kib = 0;
+    char line[256];
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    if (f) {
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "AnonHugePages: %zu kB", &kib) == 1) {
+                break;
+            }
+        }
+        fclose(f);
+    }
+    return kib;
+}
+
+static void do_critnib_large_lookup_benchmark(critnib *c) {
+    unsigned seed = 1;
+    for (size_t i = 0; i < TRACKER_LARGE_N_LOOKUPS; i++) {
+        seed = seed * 1103515245 + 12345;
+        uintptr_t addr = tracker_large_range((seed >> 4) %
+                                             TRACKER_LARGE_N_RANGES) +
+                         (seed & (TRACKER_LARGE_RANGE_SIZE - 1));
+        uintptr_t rkey;
+        tracker_large_value_t value;
+        if (!critnib_find_inline(c, addr, FIND_LE, &rkey, &value) ||
+            addr - rkey >= value.size) {
+            exit(-1);
+        }
+    }
+}
+
+UBENCH_EX(simple, tracker_critnib_lookup_large) {
+    size_t rss_before = get_rss();
+    critnib *c = critnib_new_inline(sizeof(tracker_large_value_t));
+    if (c == NULL) {
+        exit(-1);
+    }
+
+    for (size_t i = 0; i < TRACKER_LARGE_N_RANGES; i++) {
+        tracker_large_value_t value = {NULL, TRACKER_LARGE_RANGE_SIZE};
+        if (critnib_insert_inline(c, tracker_large_range(i), &value, 0)) {
+            exit(-1);
+        }
+    }
+
+    printf("critnib: %zu KiB of memory (%zu KiB in huge pages) for %d "
+           "ranges\n",
+           (get_rss() - rss_before) / 1024, get_anon_huge_pages(),
+           TRACKER_LARGE_N_RANGES);
+
+    do_critnib_large_lookup_benchmark(c); // WARMUP
+
+    UBENCH_DO_BENCHMARK() { do_critnib_large_lookup_benchmark(c); }
+
+    for (size_t i = 0; i < TRACKER_LARGE_N_RANGES; i++) {
+        critnib_remove_inline(c, tracker_large_range(i), NULL);
+    }
+    critnib_delete(c);
+}
+
 UBENCH_MAIN();
@@ -14,5 +14,6 @@
 #include <umf/memory_provider.h>
 #include <umf/memspace.h>
 #include <umf/memspace_policy.h>
+#include <umf/scratch_arena.h>
 
 #endif /* UMF_UNIFIED_MEMORY_FRAMEWORK_H */
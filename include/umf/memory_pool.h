@@ -124,6 +124,48 @@ UMF_EXPORT size_t umfPoolMallocUsableSize(umf_memory_pool_handle_t hPool,
 ///
 UMF_EXPORT umf_result_t umfPoolFree(umf_memory_pool_handle_t hPool, void *ptr);
 
+///
+/// @brief Frees the memory space of the specified \p hPool pointed by \p ptr,
+///        like umfPoolFree(). Knowing the size of the allocation, pools which
+///        support it find the memory faster.
+/// @param hPool specified memory hPool
+/// @param ptr pointer to the memory allocated with umfPoolMalloc(),
+///        umfPoolCalloc() or umfPoolRealloc()
+/// @param size size of the allocation, as requested from umfPoolMalloc(),
+///        umfPoolCalloc() (the product of its arguments) or umfPoolRealloc()
+/// @return UMF_RESULT_SUCCESS on success or appropriate error code on failure.
+///
+UMF_EXPORT umf_result_t umfPoolFreeSized(umf_memory_pool_handle_t hPool,
+                                         void *ptr, size_t size);
+
+///
+/// @brief Allocates \p num blocks of \p size bytes of uninitialized storage
+///        from \p hPool. Pools which support it serve the whole batch at the
+///        cost of a single allocation, e.g. taking their locks once.
+/// @param hPool specified memory hPool
+/// @param size number of bytes to allocate for each block
+/// @param num number of blocks
+/// @param ptrs [out] array of at least \p num elements for the pointers to
+///        the allocated memory
+/// @return Number of blocks allocated, their pointers are stored at the
+///         beginning of \p ptrs. If it is less than \p num,
+///         umfPoolGetLastAllocationError() returns the reason.
+///
+UMF_EXPORT size_t umfPoolMallocBatch(umf_memory_pool_handle_t hPool,
+                                     size_t size, size_t num, void **ptrs);
+
+///
+/// @brief Frees \p num blocks of memory of \p hPool pointed by \p ptrs
+/// @param hPool specified memory hPool
+/// @param ptrs array of pointers to the allocated memory to free, NULL
+///        pointers are ignored
+/// @param num number of elements of \p ptrs
+/// @return UMF_RESULT_SUCCESS on success or the error of the first free which
+///         failed. All blocks are freed regardless of failures.
+///
+UMF_EXPORT umf_result_t umfPoolFreeBatch(umf_memory_pool_handle_t hPool,
+                                         void **ptrs, size_t num);
+
 ///
 /// @brief Frees the memory space pointed by ptr if it belongs to UMF pool, does nothing otherwise.
 /// @param ptr pointer to the allocated memory
@@ -172,6 +214,26 @@ UMF_EXPORT umf_memory_pool_handle_t umfPoolByPtr(const void *ptr);
 UMF_EXPORT umf_result_t umfPoolGetMemoryProvider(
     umf_memory_pool_handle_t hPool, umf_memory_provider_handle_t *hProvider);
 
+///
+/// @brief Wrap a memory provider, used by a pool in addition to the one passed
+///        to its initialize(), so that memory allocated from it is attributed
+///        to the pool by umfPoolByPtr() and umfFree().
+/// @param hPoolProvider the memory provider passed to the pool's initialize()
+/// @param hUpstream memory provider to be wrapped, its lifetime is managed by
+///        the caller
+/// @param hTrackedProvider [out] memory provider to be used by the pool instead
+///        of \p hUpstream, it must be destroyed with umfMemoryProviderDestroy()
+/// @return UMF_RESULT_SUCCESS on success or appropriate error code on failure.
+///         UMF_RESULT_ERROR_INVALID_ARGUMENT if \p hPoolProvider is not the
+///         provider of a pool.
+///         UMF_RESULT_ERROR_NOT_SUPPORTED if UMF is built without pool
+///         tracking, \p hUpstream can then be used directly.
+///
+UMF_EXPORT umf_result_t umfPoolTrackMemoryProvider(
+    umf_memory_provider_handle_t hPoolProvider,
+    umf_memory_provider_handle_t hUpstream,
+    umf_memory_provider_handle_t *hTrackedProvider);
+
 #ifdef __cplusplus
 }
 #endif
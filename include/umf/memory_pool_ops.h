@@ -20,7 +20,7 @@ extern "C" {
 ///
 /// @brief This structure comprises function pointers used by corresponding umfPool*
 /// calls. Each memory pool implementation should initialize all function
-/// pointers.
+/// pointers, except for the optional ones, which may be NULL.
 ///
 typedef struct umf_memory_pool_ops_t {
     /// Version of the ops structure.
@@ -120,6 +120,45 @@ typedef struct umf_memory_pool_ops_t {
     ///         The value is undefined if the previous allocation was successful.
     ///
     umf_result_t (*get_last_allocation_error)(void *pool);
+
+    ///
+    /// @brief Allocates \p num blocks of \p size bytes of uninitialized storage
+    ///        from \p pool. Optional, if NULL umfPoolMallocBatch() calls malloc
+    ///        for each block.
+    /// @param pool pointer to the memory pool
+    /// @param size number of bytes to allocate for each block
+    /// @param num number of blocks
+    /// @param ptrs [out] array of at least \p num elements for the pointers to
+    ///        the allocated memory
+    /// @return Number of blocks allocated, their pointers are stored at the
+    ///         beginning of \p ptrs. If it is less than \p num, the error is
+    ///         stored as for a failed malloc.
+    ///
+    size_t (*malloc_batch)(void *pool, size_t size, size_t num, void **ptrs);
+
+    ///
+    /// @brief Frees \p num blocks of memory of \p pool pointed by \p ptrs.
+    ///        Optional, if NULL umfPoolFreeBatch() calls free for each block.
+    /// @param pool pointer to the memory pool
+    /// @param ptrs array of pointers to the allocated memory to free, NULL
+    ///        pointers are ignored
+    /// @param num number of elements of \p ptrs
+    /// @return UMF_RESULT_SUCCESS on success or the error of the first free
+    ///         which failed. All blocks are freed regardless of failures.
+    ///
+    umf_result_t (*free_batch)(void *pool, void **ptrs, size_t num);
+
+    ///
+    /// @brief Frees the memory space of the specified \p pool pointed by \p ptr,
+    ///        which was allocated with the given \p size. Optional, if NULL
+    ///        umfPoolFreeSized() calls free.
+    /// @param pool pointer to the memory pool
+    /// @param ptr pointer to the allocated memory to free
+    /// @param size size of the allocation, as requested from malloc, calloc
+    ///        (the product of its arguments) or realloc
+    /// @return UMF_RESULT_SUCCESS on success or appropriate error code on failure.
+    ///
+    umf_result_t (*free_sized)(void *pool, void *ptr, size_t size);
 } umf_memory_pool_ops_t;
 
 #ifdef __cplusplus
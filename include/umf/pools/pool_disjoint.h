@@ -24,6 +24,31 @@ typedef struct umf_disjoint_pool_shared_limits_t
 umf_disjoint_pool_shared_limits_t *
 umfDisjointPoolSharedLimitsCreate(size_t MaxSize);
 
+/// @brief Create a pool limits struct which is a part of a hierarchy of
+///        limits, e.g. process -> tenant -> pool. Besides the memory cached by
+///        the pools (see umfDisjointPoolSharedLimitsCreate), it limits the
+///        memory obtained from memory providers, either in use or cached, by
+///        the pools using these limits or any limits below them.
+/// @param MaxSize specifies hard limit for memory cached by the pools
+/// @param SoftLimit when exceeded, the memory cached by the pools below these
+///        limits is released, and no memory is cached until the usage drops
+///        below it. 0 disables the soft limit.
+/// @param HardLimit allocations which would exceed it fail with
+///        UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY. 0 disables the hard limit.
+/// @param Parent limits which include these ones, NULL for the top level.
+///        Child limits must be destroyed before their parent.
+/// @return pointer to created pool limits struct or NULL on failure
+umf_disjoint_pool_shared_limits_t *umfDisjointPoolSharedLimitsCreateEx(
+    size_t MaxSize, size_t SoftLimit, size_t HardLimit,
+    umf_disjoint_pool_shared_limits_t *Parent);
+
+/// @brief Get the size of memory obtained from memory providers by the pools
+///        using the limits or any limits below them
+/// @param PoolLimits pointer to a pool limits struct
+/// @return size of memory in use or cached by the pools
+size_t umfDisjointPoolSharedLimitsGetUsedSize(
+    umf_disjoint_pool_shared_limits_t *PoolLimits);
+
 /// @brief Destroy previously created pool limits struct
 /// @param PoolLimits pointer to a pool limits struct
 void umfDisjointPoolSharedLimitsDestroy(
@@ -58,6 +83,87 @@ typedef struct umf_disjoint_pool_params_t {
 
     /// Name used in traces
     const char *Name;
+
+    /// Maximum number of free chunks each thread caches per bucket. Cached
+    /// chunks are served to, and accepted from, the owning thread without
+    /// taking the bucket lock. Caches are flushed back to the pool on thread
+    /// exit and on pool destruction. 0 disables per-thread caching.
+    size_t ThreadCacheSize;
+
+    /// Only buckets of size up to ThreadCacheMaxSize are cached. Caching is
+    /// limited to chunked buckets (sizes up to SlabMinSize / 2), 0 means that
+    /// all chunked buckets are cached.
+    size_t ThreadCacheMaxSize;
+
+    /// Set to a non-zero value if the memory provider is known to return
+    /// zero-filled memory. calloc() then skips clearing memory which has not
+    /// been used since it was obtained from the provider.
+    int ProviderMemoryZeroed;
+
+    /// Time in milliseconds after which the memory of an empty slab kept in
+    /// the pool is purged with umfMemoryProviderPurgeLazy(). The slab stays
+    /// in the pool. 0 disables purging.
+    size_t PurgeDelayMs;
+
+    /// Time in milliseconds after which an empty slab kept in the pool is
+    /// returned to the memory provider. 0 disables releasing.
+    size_t ReleaseDelayMs;
+
+    /// If non-zero, idle slabs are purged and released by a background
+    /// thread of the pool. Otherwise it is done lazily: a thread checks
+    /// whether decay is due on its first allocation or free and then on
+    /// every 256th one, counted over all pools. Slabs of a pool which is not
+    /// used, or only by threads doing few operations, may thus be kept much
+    /// longer than the delays; such pools should set DecayThread.
+    int DecayThread;
+
+    /// Sorted array of distinct allocation sizes of the pool's buckets,
+    /// copied on pool creation. MinBucketSize is ignored and allocations
+    /// larger than the largest size class are served directly by the memory
+    /// provider. If NULL, there are four size classes per power of 2
+    /// (at least 8 bytes apart), starting from MinBucketSize.
+    const size_t *SizeClasses;
+
+    /// Number of elements of SizeClasses
+    size_t NumSizeClasses;
+
+    /// Maximum allocation size that will be requested from the system for
+    /// slabs split into chunks. Each bucket doubles the size of its next slab
+    /// as it allocates new slabs, and halves it as it returns slabs to the
+    /// system, within SlabMinSize and SlabMaxSize. Values not greater than
+    /// SlabMinSize disable the resizing.
+    size_t SlabMaxSize;
+
+    /// Maximum number of bytes of freed allocations larger than
+    /// MaxPoolableSize kept by the pool for reuse by allocations of similar
+    /// sizes. Cached memory counts against SharedLimits and is returned to
+    /// the memory provider after ReleaseDelayMs, if set. 0 disables caching.
+    size_t LargeCacheSize;
+
+    /// Memory providers bound to NUMA nodes, indexed by node ID. If set,
+    /// buckets keep separate lists of slabs per node: chunks are allocated
+    /// from slabs of the node of the calling CPU, requested from
+    /// NodeProviders[node % NumNodeProviders], and freed chunks return to
+    /// the slabs of their node. Allocations larger than MaxPoolableSize are
+    /// served by the pool's memory provider. The providers must outlive the
+    /// pool.
+    umf_memory_provider_handle_t *NodeProviders;
+
+    /// Number of elements of NodeProviders
+    size_t NumNodeProviders;
+
+    /// Maximum number of chunk frees each bucket defers, rounded up to a
+    /// power of 2, when its lock is held by another thread. Such frees are
+    /// queued without waiting for the lock, so threads freeing memory
+    /// allocated by other threads do not contend with them on the lock. The
+    /// queue is drained by the freeing thread if the lock is released by the
+    /// time the chunk is queued, otherwise by the next allocation or free
+    /// which takes the lock, by decay (see DecayThread) and by the trimming
+    /// of the pool before a hard limit of SharedLimits fails an allocation,
+    /// unless the bucket is locked at that time.
+    /// Until then the chunks are not reused, nor their slabs released.
+    /// 0 disables deferring.
+    size_t RemoteFreeQueueSize;
 } umf_disjoint_pool_params_t;
 
 umf_memory_pool_ops_t *umfDisjointPoolOps(void);
@@ -72,7 +178,20 @@ static inline umf_disjoint_pool_params_t umfDisjointPoolParamsDefault(void) {
         0,                                         /* CurPoolSize */
         0,                                         /* PoolTrace */
         NULL,                                      /* SharedLimits */
-        "disjoint_pool"                            /* Name */
+        "disjoint_pool",                           /* Name */
+        0,                                         /* ThreadCacheSize */
+        0,                                         /* ThreadCacheMaxSize */
+        0,                                         /* ProviderMemoryZeroed */
+        0,                                         /* PurgeDelayMs */
+        0,                                         /* ReleaseDelayMs */
+        0,                                         /* DecayThread */
+        NULL,                                      /* SizeClasses */
+        0,                                         /* NumSizeClasses */
+        0,                                         /* SlabMaxSize */
+        0,                                         /* LargeCacheSize */
+        NULL,                                      /* NodeProviders */
+        0,                                         /* NumNodeProviders */
+        0                                          /* RemoteFreeQueueSize */
     };
 
     return params;
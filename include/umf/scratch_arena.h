@@ -0,0 +1,64 @@
+/*
+ *
+ * Copyright (C) 2024 Intel Corporation
+ *
+ * Under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ *
+ */
+
+#ifndef UMF_SCRATCH_ARENA_H
+#define UMF_SCRATCH_ARENA_H 1
+
+#include <umf/base.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief A scratch arena is a linear allocator of temporary buffers,
+///        for example the buffers used while handling a single request.
+///        The buffers cannot be freed one by one, all of them are freed
+///        at once by umfScratchArenaReset() or umfScratchArenaDestroy().
+typedef struct umf_scratch_arena_t *umf_scratch_arena_handle_t;
+
+///
+/// @brief Creates a new scratch arena.
+/// @param size expected total size of the buffers allocated between resets,
+///        the arena grows if they need more memory
+/// @param hArena [out] handle to the newly created scratch arena
+/// @return UMF_RESULT_SUCCESS on success or appropriate error code on failure.
+///
+UMF_EXPORT umf_result_t umfScratchArenaCreate(
+    size_t size, umf_scratch_arena_handle_t *hArena);
+
+///
+/// @brief Destroys the scratch arena and frees all buffers allocated from it.
+/// @param hArena handle to the scratch arena
+///
+UMF_EXPORT void umfScratchArenaDestroy(umf_scratch_arena_handle_t hArena);
+
+///
+/// @brief Allocates \p size bytes of uninitialized storage from \p hArena.
+///        It is safe to call from many threads at once.
+/// @param hArena handle to the scratch arena
+/// @param size number of bytes to allocate
+/// @return Pointer to the allocated memory aligned to sizeof(void *)
+///         or NULL on failure.
+///
+UMF_EXPORT void *umfScratchArenaAlloc(umf_scratch_arena_handle_t hArena,
+                                      size_t size);
+
+///
+/// @brief Frees all buffers allocated from \p hArena, so that its memory can
+///        be allocated again. It must not be called concurrently with
+///        umfScratchArenaAlloc() on the same arena.
+/// @param hArena handle to the scratch arena
+///
+UMF_EXPORT void umfScratchArenaReset(umf_scratch_arena_handle_t hArena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UMF_SCRATCH_ARENA_H */
@@ -6,6 +6,7 @@
 */
 
 #include <assert.h>
+#include <stdlib.h>
 
 #include "base_alloc.h"
 #include "base_alloc_internal.h"
@@ -21,6 +22,16 @@
 // alignment of the base allocator
 #define MEMORY_ALIGNMENT (sizeof(uintptr_t))
 
+// number of free lists of each pool, every thread uses one of them
+#define BA_SHARDS 16
+
+// free regions are looked for once this many times the number of chunks of
+// a region, or a half of the chunks of all regions if more, were freed to a
+// free list since the last check; one free region is always kept and the
+// other ones are released only if they are still free at the next check and
+// the pool did not need their chunks in the meantime
+#define RELEASE_THRESHOLD_REGIONS 2
+
 typedef struct umf_ba_chunk_t umf_ba_chunk_t;
 typedef struct umf_ba_next_pool_t umf_ba_next_pool_t;
 
@@ -30,12 +41,41 @@ struct umf_ba_chunk_t {
     char user_data[];
 };
 
-// metadata is set and used only in the main (the first) pool
-struct umf_ba_main_pool_meta_t {
-    size_t pool_size; // size of each pool (argument of each ba_os_alloc() call)
-    size_t chunk_size;         // size of all memory chunks in this pool
+// free list used by a subset of threads, so that threads allocating and
+// freeing chunks at the same time don't contend on a single lock
+struct umf_ba_shard_t {
     os_mutex_t free_lock;      // lock of free_list
     umf_ba_chunk_t *free_list; // list of free chunks
+    size_t n_free;             // length of free_list
+    size_t n_free_min;         // the lowest n_free since the last check
+    size_t n_freed;            // chunks freed since the last check
+    size_t release_threshold;  // n_freed triggering ba_release_free_regions()
+    char padding[64 - (sizeof(os_mutex_t) + sizeof(umf_ba_chunk_t *) +
+                       4 * sizeof(size_t)) %
+                          64]; // avoid false sharing
+};
+
+// region ("next" pool) of the base allocator seen by ba_release_free_regions()
+typedef struct ba_region_t {
+    char *start;
+    size_t n_free; // number of its chunks in the free lists
+    int release;
+} ba_region_t;
+
+// metadata is set and used only in the main (the first) pool
+struct umf_ba_main_pool_meta_t {
+    size_t pool_size;   // size of the main pool
+    size_t chunk_size;  // size of all memory chunks in this pool
+    size_t region_size; // size of the next "next" pool
+    size_t release_distance; // release_threshold set at the last check
+    size_t n_regions;    // number of the "next" pools
+    size_t n_region_maps; // number of the "next" pools ever allocated
+    // array of ba_release_free_regions(), grown with the list of pools, so
+    // that nothing is mapped while the locks of the free lists are held
+    ba_region_t *regions;
+    size_t regions_size; // size of the regions array
+    os_mutex_t pool_lock; // lock of the list of pools
+    struct umf_ba_shard_t shards[BA_SHARDS];
 #ifndef NDEBUG
     size_t n_pools;
     size_t n_allocs;
@@ -60,11 +100,35 @@ struct umf_ba_next_pool_t {
     // address of the beginning of the next pool (a list of allocated pools to be freed in umf_ba_destroy())
     umf_ba_next_pool_t *next_pool;
 
+    // size of this pool (argument of its ba_os_alloc() call)
+    size_t pool_size;
+
+    // number of chunks of this pool
+    size_t n_chunks;
+
+    // the pool was free at the last ba_release_free_regions()
+    int was_free;
+
     // data area of all pools except of the main (the first one) starts here
     char data[];
 };
 
+/* index+1 of the shard of the thread, 0 if not assigned yet */
+static __TLS unsigned Ba_shard;
+static uint64_t Ba_next_shard;
+
+// ba_shard - return the shard of the free list of the calling thread
+static struct umf_ba_shard_t *ba_shard(umf_ba_pool_t *pool) {
+    if (!Ba_shard) {
+        Ba_shard =
+            (unsigned)(util_atomic_increment(&Ba_next_shard) % BA_SHARDS) + 1;
+    }
+
+    return &pool->metadata.shards[Ba_shard - 1];
+}
+
 #ifndef NDEBUG
+// must not be called concurrently with allocations and frees
 static void ba_debug_checks(umf_ba_pool_t *pool) {
     // count pools
     size_t n_pools = 1;
@@ -77,20 +141,23 @@ static void ba_debug_checks(umf_ba_pool_t *pool) {
 
     // count chunks
     size_t n_free_chunks = 0;
-    umf_ba_chunk_t *next_chunk = pool->metadata.free_list;
-    while (next_chunk) {
-        n_free_chunks++;
-        next_chunk = next_chunk->next;
+    for (int i = 0; i < BA_SHARDS; i++) {
+        umf_ba_chunk_t *next_chunk = pool->metadata.shards[i].free_list;
+        while (next_chunk) {
+            n_free_chunks++;
+            next_chunk = next_chunk->next;
+        }
     }
     assert(n_free_chunks == pool->metadata.n_chunks - pool->metadata.n_allocs);
 }
 #endif /* NDEBUG */
 
-// ba_divide_memory_into_chunks - divide given memory into chunks of chunk_size and add them to the free_list
-static void ba_divide_memory_into_chunks(umf_ba_pool_t *pool, void *ptr,
-                                         size_t size) {
-    assert(pool->metadata.free_list == NULL);
+// ba_divide_memory_into_chunks - divide given memory into chunks of chunk_size and return the list of them
+static umf_ba_chunk_t *ba_divide_memory_into_chunks(umf_ba_pool_t *pool,
+                                                    void *ptr, size_t size,
+                                                    size_t *n_chunks) {
     assert(size > pool->metadata.chunk_size);
+    *n_chunks = 0;
 
     char *data_ptr = ptr;
     size_t size_left = size;
@@ -105,22 +172,22 @@ static void ba_divide_memory_into_chunks(umf_ba_pool_t *pool, void *ptr,
         data_ptr += pool->metadata.chunk_size;
         size_left -= pool->metadata.chunk_size;
         prev_chunk = current_chunk;
+        (*n_chunks)++;
 #ifndef NDEBUG
         pool->metadata.n_chunks++;
 #endif /* NDEBUG */
     }
 
     current_chunk->next = NULL;
-    pool->metadata.free_list = ptr; // address of the first chunk
+    return ptr; // address of the first chunk
 }
 
 umf_ba_pool_t *umf_ba_create(size_t size) {
     size_t chunk_size = align_size(size, MEMORY_ALIGNMENT);
-    size_t mutex_size = align_size(util_mutex_get_size(), MEMORY_ALIGNMENT);
 
     size_t metadata_size = sizeof(struct umf_ba_main_pool_meta_t);
-    size_t pool_size = sizeof(void *) + metadata_size + mutex_size +
-                       (MINIMUM_CHUNK_COUNT * chunk_size);
+    size_t pool_size =
+        sizeof(void *) + metadata_size + (MINIMUM_CHUNK_COUNT * chunk_size);
     if (pool_size < MINIMUM_POOL_SIZE) {
         pool_size = MINIMUM_POOL_SIZE;
     }
@@ -134,6 +201,13 @@ umf_ba_pool_t *umf_ba_create(size_t size) {
 
     pool->metadata.pool_size = pool_size;
     pool->metadata.chunk_size = chunk_size;
+    pool->metadata.region_size = ba_next_region_size(pool_size, pool_size);
+    pool->metadata.release_distance =
+        RELEASE_THRESHOLD_REGIONS * (pool_size / chunk_size);
+    pool->metadata.n_regions = 0;
+    pool->metadata.n_region_maps = 0;
+    pool->metadata.regions = NULL;
+    pool->metadata.regions_size = 0;
     pool->next_pool = NULL; // this is the only pool now
 #ifndef NDEBUG
     pool->metadata.n_pools = 1;
@@ -146,52 +220,348 @@ umf_ba_pool_t *umf_ba_create(size_t size) {
 
     align_ptr_size((void **)&data_ptr, &size_left, MEMORY_ALIGNMENT);
 
-    // init free_lock
-    os_mutex_t *mutex = util_mutex_init(&pool->metadata.free_lock);
-    if (!mutex) {
-        ba_os_free(pool, pool_size);
-        return NULL;
+    int n_locks;
+    for (n_locks = 0; n_locks < BA_SHARDS; n_locks++) {
+        struct umf_ba_shard_t *shard = &pool->metadata.shards[n_locks];
+        if (!util_mutex_init(&shard->free_lock)) {
+            goto err_destroy_locks;
+        }
+        shard->free_list = NULL;
+        shard->n_free = 0;
+        shard->n_free_min = 0;
+        shard->n_freed = 0;
+        shard->release_threshold = pool->metadata.release_distance;
     }
 
-    pool->metadata.free_list = NULL;
-    ba_divide_memory_into_chunks(pool, data_ptr, size_left);
+    if (!util_mutex_init(&pool->metadata.pool_lock)) {
+        goto err_destroy_locks;
+    }
+
+    struct umf_ba_shard_t *shard = ba_shard(pool);
+    shard->free_list =
+        ba_divide_memory_into_chunks(pool, data_ptr, size_left, &shard->n_free);
+    shard->n_free_min = shard->n_free;
 
     return pool;
+
+err_destroy_locks:
+    while (n_locks--) {
+        util_mutex_destroy_not_free(&pool->metadata.shards[n_locks].free_lock);
+    }
+    ba_os_free(pool, pool_size);
+    return NULL;
 }
 
-void *umf_ba_alloc(umf_ba_pool_t *pool) {
-    util_mutex_lock(&pool->metadata.free_lock);
-    if (pool->metadata.free_list == NULL) {
-        umf_ba_next_pool_t *new_pool =
-            (umf_ba_next_pool_t *)ba_os_alloc(pool->metadata.pool_size);
-        if (!new_pool) {
-            util_mutex_unlock(&pool->metadata.free_lock);
+// ba_add_pool - allocate a new pool and return the list of its chunks
+static umf_ba_chunk_t *ba_add_pool(umf_ba_pool_t *pool, size_t *n_chunks) {
+    util_mutex_lock(&pool->metadata.pool_lock);
+    size_t pool_size = pool->metadata.region_size;
+    umf_ba_next_pool_t *new_pool = (umf_ba_next_pool_t *)ba_os_alloc(pool_size);
+    if (!new_pool) {
+        util_mutex_unlock(&pool->metadata.pool_lock);
+        return NULL;
+    }
+
+    pool->metadata.region_size =
+        ba_next_region_size(pool_size, pool->metadata.pool_size);
+
+    // add the new pool to the list of pools
+    new_pool->next_pool = pool->next_pool;
+    new_pool->pool_size = pool_size;
+    new_pool->was_free = 0;
+    pool->next_pool = new_pool;
+    pool->metadata.n_regions++;
+    pool->metadata.n_region_maps++;
+
+    // the array of ba_release_free_regions() is doubled when it is full;
+    // if that fails, the regions are not released until it succeeds
+    size_t n_regions = pool->metadata.n_regions;
+    if (pool->metadata.regions_size < n_regions * sizeof(ba_region_t)) {
+        size_t regions_size = align_size(2 * n_regions * sizeof(ba_region_t),
+                                         ba_os_get_page_size());
+        ba_region_t *regions = ba_os_alloc(regions_size);
+        if (regions) {
+            if (pool->metadata.regions) {
+                ba_os_free(pool->metadata.regions,
+                           pool->metadata.regions_size);
+            }
+            pool->metadata.regions = regions;
+            pool->metadata.regions_size = regions_size;
+        }
+    }
+#ifndef NDEBUG
+    pool->metadata.n_pools++;
+#endif /* NDEBUG */
+
+    char *data_ptr = (char *)&new_pool->data;
+    size_t size_left = pool_size - offsetof(umf_ba_next_pool_t, data);
+
+    align_ptr_size((void **)&data_ptr, &size_left, MEMORY_ALIGNMENT);
+    umf_ba_chunk_t *chunks =
+        ba_divide_memory_into_chunks(pool, data_ptr, size_left, n_chunks);
+    new_pool->n_chunks = *n_chunks;
+    util_mutex_unlock(&pool->metadata.pool_lock);
+
+    return chunks;
+}
+
+// ba_refill - take all free chunks of another shard or of a new pool,
+// return one of them and add the rest to the free list of the shard
+static umf_ba_chunk_t *ba_refill(umf_ba_pool_t *pool,
+                                 struct umf_ba_shard_t *shard) {
+    umf_ba_chunk_t *chunks = NULL;
+    size_t n_chunks = 0;
+
+    // the lock of the shard is not held here, so that two threads taking
+    // the chunks of each other's shards can't deadlock
+    size_t first = shard - pool->metadata.shards;
+    for (size_t i = 1; i < BA_SHARDS && !chunks; i++) {
+        struct umf_ba_shard_t *other =
+            &pool->metadata.shards[(first + i) % BA_SHARDS];
+        util_mutex_lock(&other->free_lock);
+        chunks = other->free_list;
+        n_chunks = other->n_free;
+        other->free_list = NULL;
+        other->n_free = 0;
+        other->n_free_min = 0;
+        util_mutex_unlock(&other->free_lock);
+    }
+
+    if (!chunks) {
+        chunks = ba_add_pool(pool, &n_chunks);
+        if (!chunks) {
             return NULL;
         }
+    }
+
+    umf_ba_chunk_t *chunk = chunks;
+    chunks = chunks->next;
+    if (!chunks) {
+        return chunk;
+    }
+
+    util_mutex_lock(&shard->free_lock);
+    shard->n_free += n_chunks - 1;
+    if (shard->free_list) {
+        // chunks were freed to the shard in the meantime
+        umf_ba_chunk_t *last = chunks;
+        while (last->next) {
+            last = last->next;
+        }
+        last->next = shard->free_list;
+    }
+    shard->free_list = chunks;
+    util_mutex_unlock(&shard->free_lock);
+
+    return chunk;
+}
+
+static int ba_region_cmp(const void *a, const void *b) {
+    const ba_region_t *ra = a;
+    const ba_region_t *rb = b;
+    return (ra->start > rb->start) - (ra->start < rb->start);
+}
+
+// ba_find_region - return the region of the chunk from the array of regions
+// sorted by address, NULL if the chunk belongs to the main pool
+static ba_region_t *ba_find_region(ba_region_t *regions, size_t n_regions,
+                                   void *chunk) {
+    size_t lo = 0, hi = n_regions;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (regions[mid].start <= (char *)chunk) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == 0) {
+        return NULL;
+    }
+
+    ba_region_t *region = &regions[lo - 1];
+    if ((size_t)((char *)chunk - region->start) >=
+        ((umf_ba_next_pool_t *)region->start)->pool_size) {
+        return NULL;
+    }
 
-        // add the new pool to the list of pools
-        new_pool->next_pool = pool->next_pool;
-        pool->next_pool = new_pool;
+    return region;
+}
+
+// ba_mark_free_regions - mark the regions all chunks of which are in the free
+// lists and were free already at the last check for release, except of one
+// of them, as long as they have at most 'spare' chunks in total, and return
+// their number; the number of the regions found free for the first time is
+// stored in 'n_new_free'
+static size_t ba_mark_free_regions(umf_ba_pool_t *pool, ba_region_t *regions,
+                                   size_t n_regions, size_t spare,
+                                   size_t *n_new_free) {
+    size_t i = 0;
+    for (umf_ba_next_pool_t *r = pool->next_pool; r; r = r->next_pool) {
+        regions[i].start = (char *)r;
+        regions[i].n_free = 0;
+        regions[i].release = 0;
+        i++;
+    }
+
+    qsort(regions, n_regions, sizeof(ba_region_t), ba_region_cmp);
+
+    for (int s = 0; s < BA_SHARDS; s++) {
+        umf_ba_chunk_t *chunk = pool->metadata.shards[s].free_list;
+        for (; chunk; chunk = chunk->next) {
+            ba_region_t *region = ba_find_region(regions, n_regions, chunk);
+            if (region) {
+                region->n_free++;
+            }
+        }
+    }
 
+    // the first free region is kept for the next allocations
+    size_t n_marked = 0;
+    int kept = 0;
+    *n_new_free = 0;
+    for (i = 0; i < n_regions; i++) {
+        umf_ba_next_pool_t *region = (umf_ba_next_pool_t *)regions[i].start;
+        if (regions[i].n_free < region->n_chunks) {
+            region->was_free = 0;
+        } else if (!kept) {
+            kept = 1;
+        } else if (!region->was_free) {
+            region->was_free = 1;
+            (*n_new_free)++;
+        } else if (region->n_chunks <= spare) {
+            spare -= region->n_chunks;
+            regions[i].release = 1;
+            n_marked++;
+        }
+    }
+
+    return n_marked;
+}
+
+// ba_release_marked_regions - remove the chunks of the marked regions from
+// the free lists and free the regions
+static void ba_release_marked_regions(umf_ba_pool_t *pool,
+                                      ba_region_t *regions, size_t n_regions) {
+    for (int s = 0; s < BA_SHARDS; s++) {
+        struct umf_ba_shard_t *shard = &pool->metadata.shards[s];
+        umf_ba_chunk_t **prev = &shard->free_list;
+        while (*prev) {
+            ba_region_t *region = ba_find_region(regions, n_regions, *prev);
+            if (region && region->release) {
+                *prev = (*prev)->next;
+                shard->n_free--;
+            } else {
+                prev = &(*prev)->next;
+            }
+        }
+    }
+
+    umf_ba_next_pool_t **prev = &pool->next_pool;
+    while (*prev) {
+        umf_ba_next_pool_t *current = *prev;
+        ba_region_t *region = ba_find_region(regions, n_regions, current);
+        if (region && region->release) {
+            *prev = current->next_pool;
+            pool->metadata.n_regions--;
 #ifndef NDEBUG
-        pool->metadata.n_pools++;
+            pool->metadata.n_pools--;
+            pool->metadata.n_chunks -= current->n_chunks;
 #endif /* NDEBUG */
+            ba_os_free(current, current->pool_size);
+        } else {
+            prev = &current->next_pool;
+        }
+    }
+}
+
+// ba_release_free_regions - return the regions all chunks of which are free
+// to the OS, except of one of them
+static void ba_release_free_regions(umf_ba_pool_t *pool) {
+    // nothing can be allocated or freed while the free lists are checked
+    util_mutex_lock(&pool->metadata.pool_lock);
+    for (int s = 0; s < BA_SHARDS; s++) {
+        util_mutex_lock(&pool->metadata.shards[s].free_lock);
+    }
 
-        char *data_ptr = (char *)&new_pool->data;
-        size_t size_left =
-            pool->metadata.pool_size - offsetof(umf_ba_next_pool_t, data);
+    // the regions found free at the last check are released only if the
+    // pool did not need their chunks since then, i.e. as many chunks stayed
+    // in the free lists all the time, so that the regions of a pool reused
+    // in cycles are not mapped again and again
+    size_t spare = 0;
+    for (int s = 0; s < BA_SHARDS; s++) {
+        spare += pool->metadata.shards[s].n_free_min;
+    }
+
+    // one free region is kept anyway
+    size_t n_regions = pool->metadata.n_regions;
+    size_t n_marked = 0;
+    size_t n_new_free = 0;
+    if (n_regions > 1 &&
+        pool->metadata.regions_size >= n_regions * sizeof(ba_region_t)) {
+        ba_region_t *regions = pool->metadata.regions;
+        n_marked = ba_mark_free_regions(pool, regions, n_regions, spare,
+                                        &n_new_free);
+        if (n_marked) {
+            ba_release_marked_regions(pool, regions, n_regions);
+        }
+    }
+
+    size_t n_region_chunks = 0;
+    for (umf_ba_next_pool_t *r = pool->next_pool; r; r = r->next_pool) {
+        n_region_chunks += r->n_chunks;
+    }
+
+    // wait until a half of the remaining regions could be freed, so that
+    // freeing all chunks does not scan the free lists once per few regions,
+    // and back off while there is nothing to release, e.g. when the pool
+    // is reused in cycles; the regions found free for the first time are
+    // checked again without backing off
+    size_t distance = RELEASE_THRESHOLD_REGIONS *
+                      (pool->metadata.pool_size / pool->metadata.chunk_size);
+    if (distance < n_region_chunks / 2) {
+        distance = n_region_chunks / 2;
+    }
+    if (!n_marked && !n_new_free &&
+        distance < 2 * pool->metadata.release_distance) {
+        distance = 2 * pool->metadata.release_distance;
+    }
+    pool->metadata.release_distance = distance;
+
+    for (int s = BA_SHARDS - 1; s >= 0; s--) {
+        struct umf_ba_shard_t *shard = &pool->metadata.shards[s];
+        shard->n_free_min = shard->n_free;
+        shard->n_freed = 0;
+        shard->release_threshold = distance;
+        util_mutex_unlock(&shard->free_lock);
+    }
+    util_mutex_unlock(&pool->metadata.pool_lock);
+}
 
-        align_ptr_size((void **)&data_ptr, &size_left, MEMORY_ALIGNMENT);
-        ba_divide_memory_into_chunks(pool, data_ptr, size_left);
+void *umf_ba_alloc(umf_ba_pool_t *pool) {
+    struct umf_ba_shard_t *shard = ba_shard(pool);
+
+    util_mutex_lock(&shard->free_lock);
+    umf_ba_chunk_t *chunk = shard->free_list;
+    if (chunk) {
+        shard->free_list = chunk->next;
+        if (--shard->n_free < shard->n_free_min) {
+            shard->n_free_min = shard->n_free;
+        }
+    }
+    util_mutex_unlock(&shard->free_lock);
+
+    if (!chunk) {
+        chunk = ba_refill(pool, shard);
+        if (!chunk) {
+            return NULL;
+        }
     }
 
-    umf_ba_chunk_t *chunk = pool->metadata.free_list;
-    pool->metadata.free_list = pool->metadata.free_list->next;
 #ifndef NDEBUG
-    pool->metadata.n_allocs++;
-    ba_debug_checks(pool);
+    util_atomic_increment(&pool->metadata.n_allocs);
 #endif /* NDEBUG */
-    util_mutex_unlock(&pool->metadata.free_lock);
 
     return chunk;
 }
@@ -202,15 +572,29 @@ void umf_ba_free(umf_ba_pool_t *pool, void *ptr) {
     }
 
     umf_ba_chunk_t *chunk = (umf_ba_chunk_t *)ptr;
+    struct umf_ba_shard_t *shard = ba_shard(pool);
 
-    util_mutex_lock(&pool->metadata.free_lock);
-    chunk->next = pool->metadata.free_list;
-    pool->metadata.free_list = chunk;
 #ifndef NDEBUG
-    pool->metadata.n_allocs--;
-    ba_debug_checks(pool);
+    util_atomic_decrement(&pool->metadata.n_allocs);
 #endif /* NDEBUG */
-    util_mutex_unlock(&pool->metadata.free_lock);
+
+    util_mutex_lock(&shard->free_lock);
+    chunk->next = shard->free_list;
+    shard->free_list = chunk;
+    shard->n_free++;
+    int release = (++shard->n_freed >= shard->release_threshold);
+    util_mutex_unlock(&shard->free_lock);
+
+    if (release) {
+        ba_release_free_regions(pool);
+    }
+}
+
+void umf_ba_get_stats(umf_ba_pool_t *pool, umf_ba_stats_t *stats) {
+    util_mutex_lock(&pool->metadata.pool_lock);
+    stats->n_regions = pool->metadata.n_regions + 1;
+    stats->n_region_maps = pool->metadata.n_region_maps + 1;
+    util_mutex_unlock(&pool->metadata.pool_lock);
 }
 
 void umf_ba_destroy(umf_ba_pool_t *pool) {
@@ -218,15 +602,21 @@ void umf_ba_destroy(umf_ba_pool_t *pool) {
     assert(pool->metadata.n_allocs == 0);
     ba_debug_checks(pool);
 #endif /* NDEBUG */
-    size_t size = pool->metadata.pool_size;
     umf_ba_next_pool_t *current_pool;
     umf_ba_next_pool_t *next_pool = pool->next_pool;
     while (next_pool) {
         current_pool = next_pool;
         next_pool = next_pool->next_pool;
-        ba_os_free(current_pool, size);
+        ba_os_free(current_pool, current_pool->pool_size);
     }
 
-    util_mutex_destroy_not_free(&pool->metadata.free_lock);
-    ba_os_free(pool, size);
+    if (pool->metadata.regions) {
+        ba_os_free(pool->metadata.regions, pool->metadata.regions_size);
+    }
+
+    for (int i = 0; i < BA_SHARDS; i++) {
+        util_mutex_destroy_not_free(&pool->metadata.shards[i].free_lock);
+    }
+    util_mutex_destroy_not_free(&pool->metadata.pool_lock);
+    ba_os_free(pool, pool->metadata.pool_size);
 }
@@ -18,9 +18,16 @@ extern "C" {
 
 typedef struct umf_ba_pool_t umf_ba_pool_t;
 
+// regions of memory mapped by a pool, the main one included
+typedef struct umf_ba_stats_t {
+    size_t n_regions;     // regions mapped now
+    size_t n_region_maps; // regions mapped since the pool was created
+} umf_ba_stats_t;
+
 umf_ba_pool_t *umf_ba_create(size_t size);
 void *umf_ba_alloc(umf_ba_pool_t *pool);
 void umf_ba_free(umf_ba_pool_t *pool, void *ptr);
+void umf_ba_get_stats(umf_ba_pool_t *pool, umf_ba_stats_t *stats);
 void umf_ba_destroy(umf_ba_pool_t *pool);
 
 #ifdef __cplusplus
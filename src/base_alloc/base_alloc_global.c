@@ -8,37 +8,62 @@
 #include <assert.h>
 
 #include "base_alloc.h"
+#include "base_alloc_global.h"
+#include "utils_concurrency.h"
 
-#define SIZE_BA_POOL_CHUNK 128
+// sizes of chunks of the global base allocator pools
+static const size_t BA_size_classes[] = {16, 32, 64, 128, 256, 512};
 
-// global base allocator used by all providers and pools
-static umf_ba_pool_t *BA_pool = NULL;
+#define NUM_SIZE_CLASSES (sizeof(BA_size_classes) / sizeof(BA_size_classes[0]))
 
-int umf_ba_create_global(void) {
-    assert(BA_pool == NULL);
+// global base allocator pools used by all providers and pools, one per size
+// class, each created on the first allocation of its size class
+static umf_ba_pool_t *BA_pools[NUM_SIZE_CLASSES];
 
-    BA_pool = umf_ba_create(SIZE_BA_POOL_CHUNK);
-    if (!BA_pool) {
-        return -1;
+int umf_ba_create_global(void) {
+    for (size_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+        assert(BA_pools[i] == NULL);
     }
 
     return 0;
 }
 
 void umf_ba_destroy_global(void) {
-    assert(BA_pool);
-    umf_ba_destroy(BA_pool);
-    BA_pool = NULL;
+    for (size_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+        if (BA_pools[i]) {
+            umf_ba_destroy(BA_pools[i]);
+            BA_pools[i] = NULL;
+        }
+    }
 }
 
 umf_ba_pool_t *umf_ba_get_pool(size_t size) {
-    // TODO: a specific class-size base allocator can be returned here
-    assert(BA_pool);
-    assert(size <= SIZE_BA_POOL_CHUNK);
+    size_t i = 0;
+    while (i < NUM_SIZE_CLASSES && BA_size_classes[i] < size) {
+        i++;
+    }
 
-    if (size > SIZE_BA_POOL_CHUNK) {
+    assert(i < NUM_SIZE_CLASSES);
+    if (i == NUM_SIZE_CLASSES) {
         return NULL;
     }
 
-    return BA_pool;
+    umf_ba_pool_t *pool;
+    util_atomic_load_acquire(&BA_pools[i], &pool);
+    if (pool) {
+        return pool;
+    }
+
+    umf_ba_pool_t *new_pool = umf_ba_create(BA_size_classes[i]);
+    if (!new_pool) {
+        return NULL;
+    }
+
+    if (!util_compare_exchange(&BA_pools[i], &pool, &new_pool)) {
+        // another thread has created the pool in the meantime
+        umf_ba_destroy(new_pool);
+        return pool;
+    }
+
+    return new_pool;
 }
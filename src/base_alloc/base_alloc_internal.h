@@ -18,10 +18,27 @@
 extern "C" {
 #endif
 
+#ifdef UMF_ENABLE_BA_HUGE_PAGES
+// the "next" pools of the base allocators grow geometrically up to this size,
+// ba_os_alloc() backs the regions of multiples of it with huge pages
+#define BA_MAX_REGION_SIZE (2 * 1024 * 1024)
+#else
+#define BA_MAX_REGION_SIZE 0 // all pools are of the same size
+#endif /* UMF_ENABLE_BA_HUGE_PAGES */
+
 void *ba_os_alloc(size_t size);
 void ba_os_free(void *ptr, size_t size);
 size_t ba_os_get_page_size(void);
 
+// ba_next_region_size - return the size of the pool following the pool
+// of 'size' bytes in a base allocator, the first pool of which has
+// 'pool_size' bytes
+static inline size_t ba_next_region_size(size_t size, size_t pool_size) {
+    size_t max_size =
+        (BA_MAX_REGION_SIZE > pool_size) ? BA_MAX_REGION_SIZE : pool_size;
+    return (2 * size < max_size) ? 2 * size : max_size;
+}
+
 #ifdef __cplusplus
 }
 #endif
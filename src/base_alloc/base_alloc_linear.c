@@ -21,12 +21,22 @@
 
 typedef struct umf_ba_next_linear_pool_t umf_ba_next_linear_pool_t;
 
+// bump pointer of a pool: the chunks are allocated by an atomic increment
+// of 'used', so 'used' can exceed 'size' after failed allocations
+typedef struct umf_ba_linear_cursor_t {
+    char *data;  // beginning of the data area of the pool
+    size_t size; // size of the data area of the pool
+    size_t used; // number of bytes allocated from the data area
+} umf_ba_linear_cursor_t;
+
 // metadata is set and used only in the main (the first) pool
 typedef struct umf_ba_main_linear_pool_meta_t {
-    size_t pool_size; // size of each pool (argument of each ba_os_alloc() call)
-    os_mutex_t lock;
-    char *data_ptr;
-    size_t size_left;
+    size_t pool_size;   // size of the main pool
+    size_t region_size; // size of the next "next" pool
+    os_mutex_t lock;    // lock of adding new pools
+    umf_ba_linear_cursor_t *cursor; // bump pointer of the current pool
+    umf_ba_linear_cursor_t main_cursor; // bump pointer of the main pool
+    umf_ba_next_linear_pool_t *spare_pool; // pool kept by umf_ba_linear_reset()
 #ifndef NDEBUG
     size_t n_pools;
 #endif /* NDEBUG */
@@ -52,6 +62,12 @@ struct umf_ba_next_linear_pool_t {
     // to be freed in umf_ba_linear_destroy())
     umf_ba_next_linear_pool_t *next_pool;
 
+    // size of this pool, larger than 'pool_size' for large allocations
+    size_t pool_size;
+
+    // bump pointer of this pool
+    umf_ba_linear_cursor_t cursor;
+
     // data area of all pools except of the main (the first one) starts here
     char data[];
 };
@@ -69,6 +85,14 @@ static void ba_debug_checks(umf_ba_linear_pool_t *pool) {
 }
 #endif /* NDEBUG */
 
+static void ba_cursor_init(umf_ba_linear_cursor_t *cursor, void *data_ptr,
+                           size_t size_left) {
+    align_ptr_size(&data_ptr, &size_left, MEMORY_ALIGNMENT);
+    cursor->data = data_ptr;
+    cursor->size = size_left;
+    cursor->used = 0;
+}
+
 umf_ba_linear_pool_t *umf_ba_linear_create(size_t pool_size) {
     size_t metadata_size = sizeof(umf_ba_main_linear_pool_meta_t);
     pool_size = pool_size + metadata_size;
@@ -83,14 +107,12 @@ umf_ba_linear_pool_t *umf_ba_linear_create(size_t pool_size) {
         return NULL;
     }
 
-    void *data_ptr = &pool->data;
-    size_t size_left = pool_size - offsetof(umf_ba_linear_pool_t, data);
-
-    align_ptr_size(&data_ptr, &size_left, MEMORY_ALIGNMENT);
-
     pool->metadata.pool_size = pool_size;
-    pool->metadata.data_ptr = data_ptr;
-    pool->metadata.size_left = size_left;
+    pool->metadata.region_size = ba_next_region_size(pool_size, pool_size);
+    ba_cursor_init(&pool->metadata.main_cursor, &pool->data,
+                   pool_size - offsetof(umf_ba_linear_pool_t, data));
+    pool->metadata.cursor = &pool->metadata.main_cursor;
+    pool->metadata.spare_pool = NULL;
     pool->next_pool = NULL; // this is the only pool now
 #ifndef NDEBUG
     pool->metadata.n_pools = 1;
@@ -106,57 +128,130 @@ umf_ba_linear_pool_t *umf_ba_linear_create(size_t pool_size) {
     return pool;
 }
 
-void *umf_ba_linear_alloc(umf_ba_linear_pool_t *pool, size_t size) {
-    size_t aligned_size = align_size(size, MEMORY_ALIGNMENT);
-    util_mutex_lock(&pool->metadata.lock);
-    if (pool->metadata.size_left < aligned_size) {
-        umf_ba_next_linear_pool_t *new_pool =
-            (umf_ba_next_linear_pool_t *)ba_os_alloc(pool->metadata.pool_size);
+// ba_add_pool - add a new pool with aligned_size bytes allocated from it
+// unless another thread has replaced the cursor already; called with the lock
+// held
+static void *ba_add_pool(umf_ba_linear_pool_t *pool,
+                         umf_ba_linear_cursor_t *cursor, size_t aligned_size,
+                         int *retry) {
+    if (pool->metadata.cursor != cursor) {
+        *retry = 1;
+        return NULL;
+    }
+
+    size_t pool_size = pool->metadata.region_size;
+    size_t header_size =
+        offsetof(umf_ba_next_linear_pool_t, data) + MEMORY_ALIGNMENT;
+    if (aligned_size > pool_size - header_size) {
+        pool_size =
+            align_size(aligned_size + header_size, ba_os_get_page_size());
+    }
+
+    // the pool kept by umf_ba_linear_reset() is used first
+    umf_ba_next_linear_pool_t *new_pool = pool->metadata.spare_pool;
+    if (new_pool && new_pool->pool_size >= pool_size) {
+        pool->metadata.spare_pool = NULL;
+    } else {
+        new_pool = (umf_ba_next_linear_pool_t *)ba_os_alloc(pool_size);
         if (!new_pool) {
-            util_mutex_unlock(&pool->metadata.lock);
             return NULL;
         }
+        new_pool->pool_size = pool_size;
+        pool->metadata.region_size =
+            ba_next_region_size(pool->metadata.region_size,
+                                pool->metadata.pool_size);
+    }
 
-        void *data_ptr = &new_pool->data;
-        size_t size_left = pool->metadata.pool_size -
-                           offsetof(umf_ba_next_linear_pool_t, data);
-        align_ptr_size(&data_ptr, &size_left, MEMORY_ALIGNMENT);
-
-        pool->metadata.data_ptr = data_ptr;
-        pool->metadata.size_left = size_left;
+    ba_cursor_init(&new_pool->cursor, &new_pool->data,
+                   new_pool->pool_size -
+                       offsetof(umf_ba_next_linear_pool_t, data));
+    new_pool->cursor.used = aligned_size;
 
-        // add the new pool to the list of pools
-        new_pool->next_pool = pool->next_pool;
-        pool->next_pool = new_pool;
+    // add the new pool to the list of pools
+    new_pool->next_pool = pool->next_pool;
+    pool->next_pool = new_pool;
 #ifndef NDEBUG
-        pool->metadata.n_pools++;
+    pool->metadata.n_pools++;
+    ba_debug_checks(pool);
 #endif /* NDEBUG */
+
+    // the allocations of other threads see the initialized cursor
+    util_atomic_store_release(&pool->metadata.cursor, &new_pool->cursor);
+
+    return new_pool->cursor.data;
+}
+
+void *umf_ba_linear_alloc(umf_ba_linear_pool_t *pool, size_t size) {
+    size_t aligned_size = align_size(size, MEMORY_ALIGNMENT);
+
+    for (;;) {
+        umf_ba_linear_cursor_t *cursor;
+        util_atomic_load_acquire(&pool->metadata.cursor, &cursor);
+
+        size_t used = util_fetch_and_add(&cursor->used, aligned_size);
+        if (used <= cursor->size && aligned_size <= cursor->size - used) {
+            return cursor->data + used;
+        }
+
+        // the current pool is full, add a new one
+        int retry = 0;
+        util_mutex_lock(&pool->metadata.lock);
+        void *ptr = ba_add_pool(pool, cursor, aligned_size, &retry);
+        util_mutex_unlock(&pool->metadata.lock);
+        if (!retry) {
+            return ptr;
+        }
     }
+}
 
-    void *ptr = pool->metadata.data_ptr;
-    pool->metadata.data_ptr += aligned_size;
-    pool->metadata.size_left -= aligned_size;
+void umf_ba_linear_reset(umf_ba_linear_pool_t *pool) {
 #ifndef NDEBUG
     ba_debug_checks(pool);
 #endif /* NDEBUG */
-    util_mutex_unlock(&pool->metadata.lock);
 
-    return ptr;
+    // the latest pool is kept for the next allocations, the other ones are
+    // freed
+    umf_ba_next_linear_pool_t *next_pool = pool->next_pool;
+    if (next_pool) {
+        if (pool->metadata.spare_pool) {
+            ba_os_free(pool->metadata.spare_pool,
+                       pool->metadata.spare_pool->pool_size);
+        }
+        pool->metadata.spare_pool = next_pool;
+        next_pool = next_pool->next_pool;
+    }
+
+    while (next_pool) {
+        umf_ba_next_linear_pool_t *current_pool = next_pool;
+        next_pool = next_pool->next_pool;
+        ba_os_free(current_pool, current_pool->pool_size);
+    }
+
+    pool->next_pool = NULL;
+    pool->metadata.main_cursor.used = 0;
+    pool->metadata.cursor = &pool->metadata.main_cursor;
+#ifndef NDEBUG
+    pool->metadata.n_pools = 1;
+#endif /* NDEBUG */
 }
 
 void umf_ba_linear_destroy(umf_ba_linear_pool_t *pool) {
 #ifndef NDEBUG
     ba_debug_checks(pool);
 #endif /* NDEBUG */
-    size_t size = pool->metadata.pool_size;
     umf_ba_next_linear_pool_t *current_pool;
     umf_ba_next_linear_pool_t *next_pool = pool->next_pool;
     while (next_pool) {
         current_pool = next_pool;
         next_pool = next_pool->next_pool;
-        ba_os_free(current_pool, size);
+        ba_os_free(current_pool, current_pool->pool_size);
+    }
+
+    if (pool->metadata.spare_pool) {
+        ba_os_free(pool->metadata.spare_pool,
+                   pool->metadata.spare_pool->pool_size);
     }
 
     util_mutex_destroy_not_free(&pool->metadata.lock);
-    ba_os_free(pool, size);
+    ba_os_free(pool, pool->metadata.pool_size);
 }
@@ -10,6 +10,8 @@
  * Useful for a few, small and different size allocations
  * for a most/whole life-time of an application
  * (since free() is not available).
+ * All allocations can be freed at once with umf_ba_linear_reset(),
+ * which must not be called concurrently with umf_ba_linear_alloc().
  */
 
 #ifndef UMF_BASE_ALLOC_LINEAR_H
@@ -25,6 +27,7 @@ typedef struct umf_ba_linear_pool umf_ba_linear_pool_t;
 
 umf_ba_linear_pool_t *umf_ba_linear_create(size_t pool_size);
 void *umf_ba_linear_alloc(umf_ba_linear_pool_t *pool, size_t size);
+void umf_ba_linear_reset(umf_ba_linear_pool_t *pool);
 void umf_ba_linear_destroy(umf_ba_linear_pool_t *pool);
 
 #ifdef __cplusplus
@@ -6,16 +6,81 @@
 */
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <sys/mman.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 
+#ifdef __linux__
+#include <linux/mman.h> // MAP_HUGE_2MB
+#endif
+
 #include "base_alloc.h"
+#include "base_alloc_internal.h"
+#include "utils_concurrency.h"
+
+static void *ba_os_map(size_t size, int flags) {
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    return (ptr == MAP_FAILED) ? NULL : ptr;
+}
+
+#ifdef UMF_ENABLE_BA_HUGE_PAGES
+// explicit huge pages were not available
+static int Ba_no_hugetlb;
+
+// ba_os_alloc_huge - map a region of a multiple of BA_MAX_REGION_SIZE bytes
+// backed by huge pages if possible
+static void *ba_os_alloc_huge(size_t size) {
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_2MB)
+    // explicit huge pages are used if the administrator reserved them;
+    // the size is given, as the default one may not divide the region
+    int no_hugetlb;
+    util_atomic_load_acquire(&Ba_no_hugetlb, &no_hugetlb);
+    if (!no_hugetlb) {
+        void *ptr = ba_os_map(size, MAP_HUGETLB | MAP_HUGE_2MB);
+        if (ptr) {
+            return ptr;
+        }
+        util_atomic_store_release(&Ba_no_hugetlb, 1);
+    }
+#endif /* MAP_HUGETLB && MAP_HUGE_2MB */
+
+    // transparent huge pages need a region aligned to the huge page size,
+    // so a larger one is mapped and trimmed
+    size_t map_size = size + BA_MAX_REGION_SIZE;
+    char *map = ba_os_map(map_size, 0);
+    if (!map) {
+        return NULL;
+    }
+
+    char *ptr = (char *)(((uintptr_t)map + BA_MAX_REGION_SIZE - 1) &
+                         ~((uintptr_t)BA_MAX_REGION_SIZE - 1));
+    if (ptr > map) {
+        munmap(map, ptr - map);
+    }
+    if (map + map_size > ptr + size) {
+        munmap(ptr + size, (map + map_size) - (ptr + size));
+    }
+
+#ifdef MADV_HUGEPAGE
+    // the region works with the normal pages as well, if the advice fails
+    (void)madvise(ptr, size, MADV_HUGEPAGE);
+#endif /* MADV_HUGEPAGE */
+
+    return ptr;
+}
+#endif /* UMF_ENABLE_BA_HUGE_PAGES */
 
 void *ba_os_alloc(size_t size) {
-    return mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
-                -1, 0);
+#ifdef UMF_ENABLE_BA_HUGE_PAGES
+    if (size >= BA_MAX_REGION_SIZE && size % BA_MAX_REGION_SIZE == 0) {
+        return ba_os_alloc_huge(size);
+    }
+#endif /* UMF_ENABLE_BA_HUGE_PAGES */
+
+    return ba_os_map(size, 0);
 }
 
 void ba_os_free(void *ptr, size_t size) {
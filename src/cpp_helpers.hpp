@@ -20,6 +20,7 @@
 #include <memory>
 #include <stdexcept>
 #include <tuple>
+#include <type_traits>
 #include <utility>
 
 namespace umf {
@@ -65,8 +66,25 @@ umf_result_t initialize(T *obj, ArgsTuple &&args) {
     }
 }
 
+// Optional operations are set only if T implements them, the batch ones
+// only if T implements both.
+template <typename T, typename = void>
+struct hasFreeSized : std::false_type {};
+
+template <typename T>
+struct hasFreeSized<T, std::void_t<decltype(&T::free_sized)>>
+    : std::true_type {};
+
+template <typename T, typename = void>
+struct hasBatchOps : std::false_type {};
+
+template <typename T>
+struct hasBatchOps<T, std::void_t<decltype(&T::malloc_batch),
+                                  decltype(&T::free_batch)>>
+    : std::true_type {};
+
 template <typename T> umf_memory_pool_ops_t poolOpsBase() {
-    umf_memory_pool_ops_t ops;
+    umf_memory_pool_ops_t ops{};
     ops.version = UMF_VERSION_CURRENT;
     ops.finalize = [](void *obj) { delete reinterpret_cast<T *>(obj); };
     UMF_ASSIGN_OP(ops, T, malloc, ((void *)nullptr));
@@ -76,6 +94,13 @@ template <typename T> umf_memory_pool_ops_t poolOpsBase() {
     UMF_ASSIGN_OP(ops, T, malloc_usable_size, ((size_t)0));
     UMF_ASSIGN_OP(ops, T, free, UMF_RESULT_SUCCESS);
     UMF_ASSIGN_OP(ops, T, get_last_allocation_error, UMF_RESULT_ERROR_UNKNOWN);
+    if constexpr (hasFreeSized<T>::value) {
+        UMF_ASSIGN_OP(ops, T, free_sized, UMF_RESULT_SUCCESS);
+    }
+    if constexpr (hasBatchOps<T>::value) {
+        UMF_ASSIGN_OP(ops, T, malloc_batch, ((size_t)0));
+        UMF_ASSIGN_OP(ops, T, free_batch, UMF_RESULT_ERROR_UNKNOWN);
+    }
     return ops;
 }
 
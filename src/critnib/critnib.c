@@ -35,27 +35,37 @@
 /*
  * CONCURRENCY ISSUES
  *
- * Reads are completely lock-free sync-free, but only almost wait-free:
- * if for some reason a read thread gets pathologically stalled, it will
- * notice the data being stale and restart the work.  In usual cases,
- * the structure having been modified does _not_ cause a restart.
+ * Reads are lock-free and wait-free: they only register themselves in the
+ * current epoch (see below) and walk the tree, they never restart.
  *
- * Writes could be easily made lock-free as well (with only a cmpxchg
- * sync), but this leads to problems with removes.  A possible solution
- * would be doing removes by overwriting by NULL w/o freeing -- yet this
- * would lead to the structure growing without bounds.  Complex per-node
- * locks would increase concurrency but they slow down individual writes
- * enough that in practice a simple global write lock works faster.
+ * Inserts are lock-free as well: a new leaf, or a new node holding the
+ * new leaf and the subtree it diverges from, is published with a single
+ * cmpxchg of the child pointer that was found, and the walk is retried if
+ * that pointer has changed in the meantime.
  *
- * Removes are the only operation that can break reads.  The structure
- * can do local RCU well -- the problem being knowing when it's safe to
- * free.  Any synchronization with reads would kill their speed, thus
- * instead we have a remove count.  The grace period is DELETED_LIFE,
- * after which any read will notice staleness and restart its work.
+ * Removes lock the node holding the removed leaf (one of REMOVE_LOCKS
+ * locks, by the node's address), so removes from different subtrees run
+ * in parallel.  Clearing the leaf's pointer is a cmpxchg too, as it races
+ * with inserts.  If the node is left with a single child, it's replaced by
+ * that child in its parent -- to keep inserts from adding to a node being
+ * cut out, the remove first freezes all its child pointers by setting the
+ * FROZEN bit with cmpxchg.  Writers that find a frozen pointer retry, and
+ * a removed node stays frozen, so writers can't modify it any more.
+ *
+ * A removed node or leaf must not be freed while any operation that might
+ * have seen it is in progress.  Each operation counts itself in one of two
+ * counters, by the parity of the current epoch, and removed items wait in
+ * the limbo of the epoch they were removed in.  The epoch advances once the
+ * counter of the previous one drops to zero, which frees the limbo of that
+ * epoch to the base allocator -- operations which started since then can't
+ * have seen those items, as they were removed before the epoch began.  The
+ * counters are sharded by thread (EPOCH_SHARDS), so that reads running in
+ * parallel don't contend on a single cache line.
  */
 #include <errno.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <string.h>
 
 #include "base_alloc.h"
 #include "base_alloc_linear.h"
@@ -64,23 +74,16 @@
 #include "utils_concurrency.h"
 
 /*
- * A node that has been deleted is left untouched for this many delete
- * cycles.  Reads have guaranteed correctness if they took no longer than
- * DELETED_LIFE concurrent deletes, otherwise they notice something is
- * wrong and restart.  The memory of deleted nodes is never freed to
- * malloc nor their pointers lead anywhere wrong, thus a stale read will
- * (temporarily) get a wrong answer but won't crash.
- *
- * There's no need to count writes as they never interfere with reads.
- *
- * Allowing stale reads (of arbitrarily old writes or of deletes less than
- * DELETED_LIFE old) might sound counterintuitive, but it doesn't affect
- * semantics in any way: the thread could have been stalled just after
- * returning from our code.  Thus, the guarantee is: the result of get() or
- * find_le() is a value that was current at any point between the call
- * start and end.
+ * Number of shards of the epoch counters, each thread counts its operations
+ * in one of them.
  */
-#define DELETED_LIFE 16
+#define EPOCH_SHARDS 16
+
+/*
+ * Number of locks serializing removes, each removes locks the one of the
+ * node holding the removed leaf.
+ */
+#define REMOVE_LOCKS 32
 
 #define SLICE 4
 #define NIB ((1ULL << SLICE) - 1)
@@ -89,6 +92,12 @@
 typedef uintptr_t word;
 typedef unsigned char sh_t;
 
+/*
+ * A child pointer with this bit set belongs to a node being removed and
+ * must not be modified by writes.  Reads ignore it.
+ */
+#define FROZEN ((word)2)
+
 struct critnib_node {
     /*
 	 * path is the part of a tree that's already traversed (be it through
@@ -108,27 +117,45 @@ struct critnib_node {
     struct critnib_node *child[SLNODES];
     word path;
     sh_t shift;
+
+    /* link of the limbo list, the node's fields may still be in use */
+    struct critnib_node *next_removed;
 };
 
 struct critnib_leaf {
     word key;
+
+    /* link of the limbo list, see critnib_node */
+    struct critnib_leaf *next_removed;
+
+    /*
+     * The value -- for critnibs created by critnib_new_inline() the leaf
+     * is larger and the value of value_size bytes starts here.
+     */
     void *value;
 };
 
+/* operations in progress, by the parity of the epoch they started in */
+struct epoch_shard {
+    uint64_t active[2];
+    char padding[64 - 2 * sizeof(uint64_t)]; /* avoid false sharing */
+};
+
 struct critnib {
     struct critnib_node *root;
 
-    /* pool of freed nodes: singly linked list, next at child[0] */
-    struct critnib_node *deleted_node;
-    struct critnib_leaf *deleted_leaf;
+    size_t value_size; /* size of values stored in leaves */
 
-    /* nodes removed but not yet eligible for reuse */
-    struct critnib_node *pending_del_nodes[DELETED_LIFE];
-    struct critnib_leaf *pending_del_leaves[DELETED_LIFE];
+    /* removed nodes waiting to be freed, by the parity of their epoch */
+    struct critnib_node *limbo_nodes[2];
+    struct critnib_leaf *limbo_leaves[2];
 
-    uint64_t remove_count;
+    uint64_t epoch;
+    struct epoch_shard shards[EPOCH_SHARDS];
 
-    struct os_mutex_t mutex; /* writes/removes */
+    struct os_mutex_t mutex; /* limbo lists, advancing the epoch */
+
+    struct os_mutex_t remove_locks[REMOVE_LOCKS];
 
     umf_ba_linear_pool_t *pool_linear;
     umf_ba_pool_t *pool_nodes;
@@ -153,6 +180,31 @@ static void store(void *dst, void *src) {
     util_atomic_store_release((word *)dst, (word)src);
 }
 
+/*
+ * atomic compare and exchange, returns true on success
+ */
+static bool cas(void *dst, void *expected, void *desired) {
+    word exp = (word)expected;
+    word des = (word)desired;
+    return util_compare_exchange((word *)dst, &exp, &des);
+}
+
+/*
+ * internal: is_frozen -- check whether a child pointer is frozen
+ */
+static inline bool is_frozen(struct critnib_node *n) {
+    return (word)n & FROZEN;
+}
+
+/*
+ * internal: load_child -- atomically load a child pointer, for reads
+ */
+static inline struct critnib_node *load_child(struct critnib_node **slot) {
+    struct critnib_node *n;
+    load(slot, &n);
+    return (void *)((word)n & ~FROZEN);
+}
+
 /*
  * internal: is_leaf -- check tagged pointer for leafness
  */
@@ -179,9 +231,10 @@ static inline unsigned slice_index(word key, sh_t shift) {
 }
 
 /*
- * critnib_new -- allocates a new critnib structure
+ * critnib_new_inline -- allocates a new critnib structure storing values of
+ * value_size bytes in its leaves
  */
-struct critnib *critnib_new(void) {
+struct critnib *critnib_new_inline(size_t value_size) {
     umf_ba_linear_pool_t *pool_linear =
         umf_ba_linear_create(0 /* minimal pool size */);
     if (!pool_linear) {
@@ -195,36 +248,56 @@ struct critnib *critnib_new(void) {
     }
 
     c->pool_linear = pool_linear;
+    c->value_size = value_size;
 
     void *mutex_ptr = util_mutex_init(&c->mutex);
     if (!mutex_ptr) {
         goto err_destroy_pool_linear;
     }
 
+    int nlocks;
+    for (nlocks = 0; nlocks < REMOVE_LOCKS; nlocks++) {
+        if (!util_mutex_init(&c->remove_locks[nlocks])) {
+            goto err_remove_locks_destroy;
+        }
+    }
+
     c->pool_nodes = umf_ba_create(sizeof(struct critnib_node));
     if (!c->pool_nodes) {
-        goto err_util_mutex_destroy;
+        goto err_remove_locks_destroy;
+    }
+
+    size_t leaf_size = offsetof(struct critnib_leaf, value) + value_size;
+    if (leaf_size < sizeof(struct critnib_leaf)) {
+        leaf_size = sizeof(struct critnib_leaf);
     }
 
-    c->pool_leaves = umf_ba_create(sizeof(struct critnib_leaf));
+    c->pool_leaves = umf_ba_create(leaf_size);
     if (!c->pool_leaves) {
         goto err_destroy_pool_nodes;
     }
 
     VALGRIND_HG_DRD_DISABLE_CHECKING(&c->root, sizeof(c->root));
-    VALGRIND_HG_DRD_DISABLE_CHECKING(&c->remove_count, sizeof(c->remove_count));
 
     return c;
 
 err_destroy_pool_nodes:
     umf_ba_destroy(c->pool_nodes);
-err_util_mutex_destroy:
+err_remove_locks_destroy:
+    while (nlocks--) {
+        util_mutex_destroy_not_free(&c->remove_locks[nlocks]);
+    }
     util_mutex_destroy_not_free(&c->mutex);
 err_destroy_pool_linear:
     umf_ba_linear_destroy(pool_linear); // free all its allocations and destroy
     return NULL;
 }
 
+/*
+ * critnib_new -- allocates a new critnib structure
+ */
+struct critnib *critnib_new(void) { return critnib_new_inline(sizeof(void *)); }
+
 /*
  * internal: delete_node -- recursively free (to malloc) a subtree
  */
@@ -233,8 +306,9 @@ static void delete_node(struct critnib *c, struct critnib_node *__restrict n) {
         umf_ba_free(c->pool_leaves, to_leaf(n));
     } else {
         for (int i = 0; i < SLNODES; i++) {
-            if (n->child[i]) {
-                delete_node(c, n->child[i]);
+            struct critnib_node *m = load_child(&n->child[i]);
+            if (m) {
+                delete_node(c, m);
             }
         }
 
@@ -242,6 +316,28 @@ static void delete_node(struct critnib *c, struct critnib_node *__restrict n) {
     }
 }
 
+/*
+ * internal: free_node_list -- free (to malloc) a list of removed nodes
+ */
+static void free_node_list(struct critnib *c, struct critnib_node *n) {
+    while (n) {
+        struct critnib_node *next = n->next_removed;
+        umf_ba_free(c->pool_nodes, n);
+        n = next;
+    }
+}
+
+/*
+ * internal: free_leaf_list -- free (to malloc) a list of removed leaves
+ */
+static void free_leaf_list(struct critnib *c, struct critnib_leaf *k) {
+    while (k) {
+        struct critnib_leaf *next = k->next_removed;
+        umf_ba_free(c->pool_leaves, k);
+        k = next;
+    }
+}
+
 /*
  * critnib_delete -- destroy and free a critnib struct
  */
@@ -250,24 +346,15 @@ void critnib_delete(struct critnib *c) {
         delete_node(c, c->root);
     }
 
-    // mutex is freed in umf_ba_linear_destroy(c->pool_linear) at the end
+    // mutexes are freed in umf_ba_linear_destroy(c->pool_linear) at the end
     util_mutex_destroy_not_free(&c->mutex);
-
-    for (struct critnib_node *m = c->deleted_node; m;) {
-        struct critnib_node *mm = m->child[0];
-        umf_ba_free(c->pool_nodes, m);
-        m = mm;
-    }
-
-    for (struct critnib_leaf *k = c->deleted_leaf; k;) {
-        struct critnib_leaf *kk = k->value;
-        umf_ba_free(c->pool_leaves, k);
-        k = kk;
+    for (int i = 0; i < REMOVE_LOCKS; i++) {
+        util_mutex_destroy_not_free(&c->remove_locks[i]);
     }
 
-    for (int i = 0; i < DELETED_LIFE; i++) {
-        umf_ba_free(c->pool_nodes, c->pending_del_nodes[i]);
-        umf_ba_free(c->pool_leaves, c->pending_del_leaves[i]);
+    for (int i = 0; i < 2; i++) {
+        free_node_list(c, c->limbo_nodes[i]);
+        free_leaf_list(c, c->limbo_leaves[i]);
     }
 
     umf_ba_destroy(c->pool_nodes);
@@ -279,287 +366,485 @@ void critnib_delete(struct critnib *c) {
 }
 
 /*
- * internal: free_node -- free (to internal pool, not malloc) a node.
- *
- * We cannot free them to malloc as a stalled reader thread may still walk
- * through such nodes; it will notice the result being bogus but only after
- * completing the walk, thus we need to ensure any freed nodes still point
- * to within the critnib structure.
+ * internal: alloc_node -- allocate a node from the base allocator
  */
-static void free_node(struct critnib *__restrict c,
-                      struct critnib_node *__restrict n) {
-    if (!n) {
-        return;
-    }
-
-    ASSERT(!is_leaf(n));
-    n->child[0] = c->deleted_node;
-    c->deleted_node = n;
+static struct critnib_node *alloc_node(struct critnib *__restrict c) {
+    return umf_ba_alloc(c->pool_nodes);
 }
 
 /*
- * internal: alloc_node -- allocate a node from our pool or from malloc
+ * internal: alloc_leaf -- allocate a leaf from the base allocator
  */
-static struct critnib_node *alloc_node(struct critnib *__restrict c) {
-    if (!c->deleted_node) {
-        return umf_ba_alloc(c->pool_nodes);
-    }
+static struct critnib_leaf *alloc_leaf(struct critnib *__restrict c) {
+    return umf_ba_alloc(c->pool_leaves);
+}
 
-    struct critnib_node *n = c->deleted_node;
+/* index+1 of the epoch shard of the thread, 0 if not assigned yet */
+static __TLS unsigned Epoch_shard;
+static uint64_t Epoch_next_shard;
 
-    c->deleted_node = n->child[0];
-    VALGRIND_ANNOTATE_NEW_MEMORY(n, sizeof(*n));
+/*
+ * internal: epoch_shard -- return the epoch counters of the calling thread
+ */
+static struct epoch_shard *epoch_shard(struct critnib *c) {
+    if (!Epoch_shard) {
+        Epoch_shard =
+            (unsigned)(util_atomic_increment(&Epoch_next_shard) %
+                       EPOCH_SHARDS) +
+            1;
+    }
 
-    return n;
+    return &c->shards[Epoch_shard - 1];
 }
 
 /*
- * internal: free_leaf -- free (to internal pool, not malloc) a leaf.
+ * internal: epoch_enter -- register an operation in the current epoch
  *
- * See free_node().
+ * Nodes and leaves reachable after this call are not freed until the
+ * matching epoch_exit().  Returns the epoch to be passed to it.
  */
-static void free_leaf(struct critnib *__restrict c,
-                      struct critnib_leaf *__restrict k) {
-    if (!k) {
-        return;
+static uint64_t epoch_enter(struct critnib *c) {
+    struct epoch_shard *shard = epoch_shard(c);
+    uint64_t epoch, cur_epoch;
+
+    load64(&c->epoch, &epoch);
+    while (1) {
+        util_atomic_increment(&shard->active[epoch & 1]);
+
+        /*
+         * The epoch might have advanced before we were counted.  The
+         * operations are sequentially consistent, so either retire() sees
+         * our counter or we see its epoch.
+         */
+        util_atomic_load_seq_cst(&c->epoch, &cur_epoch);
+        if (cur_epoch == epoch) {
+            return epoch;
+        }
+
+        util_atomic_decrement(&shard->active[epoch & 1]);
+        epoch = cur_epoch;
     }
+}
 
-    k->value = c->deleted_leaf;
-    c->deleted_leaf = k;
+/*
+ * internal: epoch_exit -- unregister an operation
+ */
+static void epoch_exit(struct critnib *c, uint64_t epoch) {
+    util_atomic_decrement(&epoch_shard(c)->active[epoch & 1]);
 }
 
 /*
- * internal: alloc_leaf -- allocate a leaf from our pool or from malloc
+ * internal: retire -- free a removed node and leaf once no operation that
+ * might have seen them is in progress
  */
-static struct critnib_leaf *alloc_leaf(struct critnib *__restrict c) {
-    if (!c->deleted_leaf) {
-        return umf_ba_alloc(c->pool_leaves);
+static void retire(struct critnib *c, struct critnib_node *n,
+                   struct critnib_leaf *k) {
+    util_mutex_lock(&c->mutex);
+
+    uint64_t epoch = c->epoch;
+    if (n) {
+        n->next_removed = c->limbo_nodes[epoch & 1];
+        c->limbo_nodes[epoch & 1] = n;
+    }
+    if (k) {
+        k->next_removed = c->limbo_leaves[epoch & 1];
+        c->limbo_leaves[epoch & 1] = k;
     }
 
-    struct critnib_leaf *k = c->deleted_leaf;
+    /*
+     * The epoch advances once all operations of the previous one are done,
+     * then nothing removed in the previous one can be in use.
+     */
+    for (int i = 0; i < EPOCH_SHARDS; i++) {
+        uint64_t active;
+        util_atomic_load_seq_cst(&c->shards[i].active[(epoch + 1) & 1],
+                                 &active);
+        if (active) {
+            util_mutex_unlock(&c->mutex);
+            return;
+        }
+    }
+
+    struct critnib_node *nodes = c->limbo_nodes[(epoch + 1) & 1];
+    struct critnib_leaf *leaves = c->limbo_leaves[(epoch + 1) & 1];
+    c->limbo_nodes[(epoch + 1) & 1] = NULL;
+    c->limbo_leaves[(epoch + 1) & 1] = NULL;
+    util_atomic_store_seq_cst(&c->epoch, epoch + 1);
+
+    util_mutex_unlock(&c->mutex);
+
+    free_node_list(c, nodes);
+    free_leaf_list(c, leaves);
+}
 
-    c->deleted_leaf = k->value;
-    VALGRIND_ANNOTATE_NEW_MEMORY(k, sizeof(*k));
+/*
+ * critnib_reserve_inline -- allocate a leaf for a later
+ * critnib_insert_reserved_inline()
+ *
+ * Returns NULL if we're out of memory.
+ */
+void *critnib_reserve_inline(struct critnib *c) { return alloc_leaf(c); }
 
-    return k;
+/*
+ * critnib_unreserve_inline -- free a leaf reserved but not inserted
+ */
+void critnib_unreserve_inline(struct critnib *c, void *reserved) {
+    umf_ba_free(c->pool_leaves, reserved);
 }
 
 /*
- * crinib_insert -- write a key:value pair to the critnib structure
+ * crinib_insert_inline -- write a key:value pair to the critnib structure,
+ * copying value_size bytes of the value into the leaf
  *
  * Returns:
  *  • 0 on success
  *  • EEXIST if such a key already exists
  *  • ENOMEM if we're out of memory
  *
- * Takes a global write lock but doesn't stall any readers.
+ * Lock-free, doesn't stall any readers nor other writers.
  */
-int critnib_insert(struct critnib *c, word key, void *value, int update) {
-    util_mutex_lock(&c->mutex);
-
+int critnib_insert_inline(struct critnib *c, word key, const void *value,
+                          int update) {
     struct critnib_leaf *k = alloc_leaf(c);
     if (!k) {
-        util_mutex_unlock(&c->mutex);
-
         return ENOMEM;
     }
 
+    return critnib_insert_reserved_inline(c, key, value, update, k);
+}
+
+/*
+ * critnib_insert_reserved_inline -- critnib_insert_inline() into a leaf
+ * from critnib_reserve_inline()
+ *
+ * The leaf is consumed whatever the result.  Updating an existing key
+ * allocates nothing, so it cannot fail.
+ */
+int critnib_insert_reserved_inline(struct critnib *c, word key,
+                                   const void *value, int update,
+                                   void *reserved) {
+    struct critnib_leaf *k = reserved;
+
     VALGRIND_HG_DRD_DISABLE_CHECKING(k, sizeof(struct critnib_leaf));
 
     k->key = key;
-    k->value = value;
+    memcpy(&k->value, value, c->value_size);
 
     struct critnib_node *kn = (void *)((word)k | 1);
 
-    struct critnib_node *n = c->root;
-    if (!n) {
-        c->root = kn;
+    /* a node for the diverging paths, kept if an attempt fails */
+    struct critnib_node *m = NULL;
+    int ret = 0;
 
-        util_mutex_unlock(&c->mutex);
+    uint64_t epoch = epoch_enter(c);
 
-        return 0;
-    }
+    while (1) {
+        struct critnib_node **parent = &c->root;
+        struct critnib_node *n;
+        load(parent, &n);
 
-    struct critnib_node **parent = &c->root;
-    struct critnib_node *prev = c->root;
+        while (n && !is_frozen(n) && !is_leaf(n) &&
+               (key & path_mask(n->shift)) == n->path) {
+            parent = &n->child[slice_index(key, n->shift)];
+            load(parent, &n);
+        }
 
-    while (n && !is_leaf(n) && (key & path_mask(n->shift)) == n->path) {
-        prev = n;
-        parent = &n->child[slice_index(key, n->shift)];
-        n = *parent;
-    }
+        if (is_frozen(n)) {
+            /* the node is being removed, retry once it's done */
+            continue;
+        }
 
-    if (!n) {
-        n = prev;
-        store(&n->child[slice_index(key, n->shift)], kn);
+        if (!n) {
+            if (cas(parent, NULL, kn)) {
+                break;
+            }
+            continue;
+        }
 
-        util_mutex_unlock(&c->mutex);
+        word path = is_leaf(n) ? to_leaf(n)->key : n->path;
+        /* Find where the path differs from our key. */
+        word at = path ^ key;
+        if (!at) {
+            ASSERT(is_leaf(n));
 
-        return 0;
-    }
+            if (!update) {
+                umf_ba_free(c->pool_leaves, k);
+                ret = EEXIST;
+                break;
+            }
 
-    word path = is_leaf(n) ? to_leaf(n)->key : n->path;
-    /* Find where the path differs from our key. */
-    word at = path ^ key;
-    if (!at) {
-        ASSERT(is_leaf(n));
-        free_leaf(c, to_leaf(kn));
+            /* the leaf is replaced, as reads may be using the old one */
+            if (cas(parent, n, kn)) {
+                retire(c, NULL, to_leaf(n));
+                break;
+            }
+            continue;
+        }
 
-        if (update) {
-            to_leaf(n)->value = value;
-            util_mutex_unlock(&c->mutex);
-            return 0;
-        } else {
-            util_mutex_unlock(&c->mutex);
-            return EEXIST;
+        /* and convert that to an index. */
+        sh_t sh = util_mssb_index(at) & (sh_t) ~(SLICE - 1);
+
+        if (!m) {
+            m = alloc_node(c);
+            if (!m) {
+                umf_ba_free(c->pool_leaves, k);
+                ret = ENOMEM;
+                break;
+            }
+            VALGRIND_HG_DRD_DISABLE_CHECKING(m, sizeof(struct critnib_node));
         }
-    }
 
-    /* and convert that to an index. */
-    sh_t sh = util_mssb_index(at) & (sh_t) ~(SLICE - 1);
+        for (int i = 0; i < SLNODES; i++) {
+            m->child[i] = NULL;
+        }
 
-    struct critnib_node *m = alloc_node(c);
-    if (!m) {
-        free_leaf(c, to_leaf(kn));
+        m->child[slice_index(key, sh)] = kn;
+        m->child[slice_index(path, sh)] = n;
+        m->shift = sh;
+        m->path = key & path_mask(sh);
+        if (cas(parent, n, m)) {
+            m = NULL;
+            break;
+        }
+    }
 
-        util_mutex_unlock(&c->mutex);
+    epoch_exit(c, epoch);
 
-        return ENOMEM;
+    if (m) {
+        umf_ba_free(c->pool_nodes, m);
     }
-    VALGRIND_HG_DRD_DISABLE_CHECKING(m, sizeof(struct critnib_node));
 
+    return ret;
+}
+
+/*
+ * internal: remove_lock -- return the lock of removes from a node
+ */
+static struct os_mutex_t *remove_lock(struct critnib *c,
+                                      struct critnib_node *n) {
+    return &c->remove_locks[((word)n / sizeof(struct critnib_node)) %
+                            REMOVE_LOCKS];
+}
+
+/*
+ * internal: collapse -- freeze a node left with a single child
+ *
+ * Returns the only child of the node, which is then frozen for good,
+ * or NULL if it has more children.  The node's remove lock must be held.
+ */
+static struct critnib_node *collapse(struct critnib_node *n) {
+    struct critnib_node *only = NULL;
+    int nchildren = 0;
+
+    /* Inserts might add children until the pointers are frozen. */
     for (int i = 0; i < SLNODES; i++) {
-        m->child[i] = NULL;
+        struct critnib_node *m;
+        load(&n->child[i], &m);
+        while (!cas(&n->child[i], m, (void *)((word)m | FROZEN))) {
+            load(&n->child[i], &m);
+        }
+
+        if (m) {
+            only = m;
+            nchildren++;
+        }
     }
 
-    m->child[slice_index(key, sh)] = kn;
-    m->child[slice_index(path, sh)] = n;
-    m->shift = sh;
-    m->path = key & path_mask(sh);
-    store(parent, m);
+    if (nchildren == 1) {
+        return only;
+    }
 
-    util_mutex_unlock(&c->mutex);
+    for (int i = 0; i < SLNODES; i++) {
+        store(&n->child[i], load_child(&n->child[i]));
+    }
 
-    return 0;
+    return NULL;
 }
 
 /*
- * critnib_remove -- delete a key from the critnib structure, return its value
+ * internal: replace_node -- replace a node by its only child in its parent
+ *
+ * The parent is found anew, as inserts might have put a node above.  If
+ * the parent is being removed, its pointer is frozen until it's done.
  */
-void *critnib_remove(struct critnib *c, word key) {
-    struct critnib_leaf *k;
-    void *value = NULL;
+static void replace_node(struct critnib *c, struct critnib_node *n,
+                         struct critnib_node *child) {
+    while (1) {
+        struct critnib_node **parent = &c->root;
+        struct critnib_node *m;
+        load(parent, &m);
 
-    util_mutex_lock(&c->mutex);
+        while (m && m != n && !is_frozen(m) && !is_leaf(m)) {
+            parent = &m->child[slice_index(n->path, m->shift)];
+            load(parent, &m);
+        }
 
-    struct critnib_node *n = c->root;
-    if (!n) {
-        goto not_found;
+        if (m == n && cas(parent, n, child)) {
+            return;
+        }
     }
+}
 
-    word del = (util_atomic_increment(&c->remove_count) - 1) % DELETED_LIFE;
-    free_node(c, c->pending_del_nodes[del]);
-    free_leaf(c, c->pending_del_leaves[del]);
-    c->pending_del_nodes[del] = NULL;
-    c->pending_del_leaves[del] = NULL;
+/*
+ * critnib_remove_inline -- delete a key from the critnib structure
+ *
+ * Returns 1 and copies the value to *value (if not NULL) if the key was
+ * found, 0 otherwise.
+ */
+int critnib_remove_inline(struct critnib *c, word key, void *value) {
+    int found = 0;
 
-    if (is_leaf(n)) {
-        k = to_leaf(n);
-        if (k->key == key) {
-            store(&c->root, NULL);
-            goto del_leaf;
+    uint64_t epoch = epoch_enter(c);
+
+    while (1) {
+        /*
+         * n and kn are a parent:child pair (after the first iteration); kn
+         * is the leaf that holds the key we're deleting.
+         */
+        struct critnib_node *n = NULL;
+        struct critnib_node **k_parent = &c->root;
+        struct critnib_node *kn;
+        load(k_parent, &kn);
+
+        while (kn && !is_frozen(kn) && !is_leaf(kn)) {
+            n = kn;
+            k_parent = &n->child[slice_index(key, n->shift)];
+            load(k_parent, &kn);
         }
 
-        goto not_found;
-    }
-    /*
-	 * n and k are a parent:child pair (after the first iteration); k is the
-	 * leaf that holds the key we're deleting.
-	 */
-    struct critnib_node **k_parent = &c->root;
-    struct critnib_node **n_parent = &c->root;
-    struct critnib_node *kn = n;
+        if (is_frozen(kn)) {
+            /* the node is being removed, retry once it's done */
+            continue;
+        }
+
+        if (!kn || to_leaf(kn)->key != key) {
+            break;
+        }
+
+        struct critnib_leaf *k = to_leaf(kn);
 
-    while (!is_leaf(kn)) {
-        n_parent = k_parent;
-        n = kn;
-        k_parent = &kn->child[slice_index(key, kn->shift)];
-        kn = *k_parent;
+        if (!n) {
+            if (!cas(&c->root, kn, NULL)) {
+                continue;
+            }
 
-        if (!kn) {
-            goto not_found;
+            found = 1;
+            if (value) {
+                memcpy(value, &k->value, c->value_size);
+            }
+            retire(c, NULL, k);
+            break;
         }
-    }
 
-    k = to_leaf(kn);
-    if (k->key != key) {
-        goto not_found;
-    }
+        struct os_mutex_t *lock = remove_lock(c, n);
+        util_mutex_lock(lock);
 
-    store(&n->child[slice_index(key, n->shift)], NULL);
+        /* fails if the leaf has moved or n has been removed meanwhile */
+        if (!cas(k_parent, kn, NULL)) {
+            util_mutex_unlock(lock);
+            continue;
+        }
 
-    /* Remove the node if there's only one remaining child. */
-    int ochild = -1;
-    for (int i = 0; i < SLNODES; i++) {
-        if (n->child[i]) {
-            if (ochild != -1) {
-                goto del_leaf;
+        /*
+         * Remove the node if there's only one remaining child.  Only
+         * inserts can change the number of children now, so a node with
+         * more children can be left alone without freezing it.
+         */
+        int nchildren = 0;
+        for (int i = 0; i < SLNODES && nchildren < 2; i++) {
+            if (load_child(&n->child[i])) {
+                nchildren++;
             }
+        }
+
+        ASSERTne(nchildren, 0);
+
+        struct critnib_node *child = nchildren == 1 ? collapse(n) : NULL;
+        if (child) {
+            replace_node(c, n, child);
+        }
+
+        util_mutex_unlock(lock);
 
-            ochild = i;
+        found = 1;
+        if (value) {
+            memcpy(value, &k->value, c->value_size);
         }
+        retire(c, child ? n : NULL, k);
+        break;
     }
 
-    ASSERTne(ochild, -1);
+    epoch_exit(c, epoch);
 
-    store(n_parent, n->child[ochild]);
-    c->pending_del_nodes[del] = n;
+    return found;
+}
 
-del_leaf:
-    value = k->value;
-    c->pending_del_leaves[del] = k;
+/*
+ * critnib_insert -- write a key:value pair to the critnib structure
+ *
+ * See critnib_insert_inline().
+ */
+int critnib_insert(struct critnib *c, word key, void *value, int update) {
+    ASSERT(c->value_size == sizeof(void *));
+    return critnib_insert_inline(c, key, &value, update);
+}
 
-not_found:
-    util_mutex_unlock(&c->mutex);
+/*
+ * critnib_remove -- delete a key from the critnib structure, return its value
+ */
+void *critnib_remove(struct critnib *c, word key) {
+    ASSERT(c->value_size == sizeof(void *));
+    void *value = NULL;
+    critnib_remove_inline(c, key, &value);
     return value;
 }
 
 /*
- * critnib_get -- query for a key ("==" match), returns value or NULL
+ * critnib_get_inline -- query for a key ("==" match)
  *
- * Doesn't need a lock but if many deletes happened while our thread was
- * somehow stalled the query is restarted (as freed nodes remain unused only
- * for a grace period).
+ * Returns 1 and copies the value to *value if found, 0 otherwise.
+ *
+ * Doesn't need a lock, nodes removed meanwhile are not freed until the
+ * query is done.
  *
  * Counterintuitively, it's pointless to return the most current answer,
  * we need only one that was valid at any point after the call started.
  */
-void *critnib_get(struct critnib *c, word key) {
-    uint64_t wrs1, wrs2;
-    void *res;
+int critnib_get_inline(struct critnib *c, word key, void *value) {
+    uint64_t epoch = epoch_enter(c);
 
-    do {
-        struct critnib_node *n;
+    struct critnib_node *n;
+    load(&c->root, &n);
 
-        load64(&c->remove_count, &wrs1);
-        load(&c->root, &n);
+    /*
+     * critbit algorithm: dive into the tree, looking at nothing but
+     * each node's critical bit^H^H^Hnibble.  This means we risk
+     * going wrong way if our path is missing, but that's ok...
+     */
+    while (n && !is_leaf(n)) {
+        n = load_child(&n->child[slice_index(key, n->shift)]);
+    }
 
-        /*
-		 * critbit algorithm: dive into the tree, looking at nothing but
-		 * each node's critical bit^H^H^Hnibble.  This means we risk
-		 * going wrong way if our path is missing, but that's ok...
-		 */
-        while (n && !is_leaf(n)) {
-            load(&n->child[slice_index(key, n->shift)], &n);
-        }
+    /* ... as we check it at the end. */
+    struct critnib_leaf *k = to_leaf(n);
+    int found = n && k->key == key;
+    if (found) {
+        memcpy(value, &k->value, c->value_size);
+    }
 
-        /* ... as we check it at the end. */
-        struct critnib_leaf *k = to_leaf(n);
-        res = (n && k->key == key) ? k->value : NULL;
-        load64(&c->remove_count, &wrs2);
-    } while (wrs1 + DELETED_LIFE <= wrs2);
+    epoch_exit(c, epoch);
 
-    return res;
+    return found;
+}
+
+/*
+ * critnib_get -- query for a key ("==" match), returns value or NULL
+ */
+void *critnib_get(struct critnib *c, word key) {
+    ASSERT(c->value_size == sizeof(void *));
+    void *value = NULL;
+    critnib_get_inline(c, key, &value);
+    return value;
 }
 
 /*
@@ -570,7 +855,7 @@ find_predecessor(struct critnib_node *__restrict n) {
     while (1) {
         int nib;
         for (nib = NIB; nib >= 0; nib--) {
-            if (n->child[nib]) {
+            if (load_child(&n->child[nib])) {
                 break;
             }
         }
@@ -579,7 +864,7 @@ find_predecessor(struct critnib_node *__restrict n) {
             return NULL;
         }
 
-        n = n->child[nib];
+        n = load_child(&n->child[nib]);
         if (is_leaf(n)) {
             return to_leaf(n);
         }
@@ -626,8 +911,7 @@ static struct critnib_leaf *find_le(struct critnib_node *__restrict n,
     unsigned nib = slice_index(key, n->shift);
     /* recursive call: follow the path */
     {
-        struct critnib_node *m;
-        load(&n->child[nib], &m);
+        struct critnib_node *m = load_child(&n->child[nib]);
         struct critnib_leaf *k = find_le(m, key);
         if (k) {
             return k;
@@ -640,8 +924,7 @@ static struct critnib_leaf *find_le(struct critnib_node *__restrict n,
 	 * need to dive into any but the first non-null, though.
 	 */
     for (; nib > 0; nib--) {
-        struct critnib_node *m;
-        load(&n->child[nib - 1], &m);
+        struct critnib_node *m = load_child(&n->child[nib - 1]);
         if (m) {
             n = m;
             if (is_leaf(n)) {
@@ -661,17 +944,15 @@ static struct critnib_leaf *find_le(struct critnib_node *__restrict n,
  * Same guarantees as critnib_get().
  */
 void *critnib_find_le(struct critnib *c, word key) {
-    uint64_t wrs1, wrs2;
-    void *res;
-
-    do {
-        load64(&c->remove_count, &wrs1);
-        struct critnib_node *n; /* avoid a subtle TOCTOU */
-        load(&c->root, &n);
-        struct critnib_leaf *k = n ? find_le(n, key) : NULL;
-        res = k ? k->value : NULL;
-        load64(&c->remove_count, &wrs2);
-    } while (wrs1 + DELETED_LIFE <= wrs2);
+    ASSERT(c->value_size == sizeof(void *));
+    uint64_t epoch = epoch_enter(c);
+
+    struct critnib_node *n; /* avoid a subtle TOCTOU */
+    load(&c->root, &n);
+    struct critnib_leaf *k = n ? find_le(n, key) : NULL;
+    void *res = k ? k->value : NULL;
+
+    epoch_exit(c, epoch);
 
     return res;
 }
@@ -683,7 +964,7 @@ static struct critnib_leaf *find_successor(struct critnib_node *__restrict n) {
     while (1) {
         unsigned nib;
         for (nib = 0; nib <= NIB; nib++) {
-            if (n->child[nib]) {
+            if (load_child(&n->child[nib])) {
                 break;
             }
         }
@@ -692,7 +973,7 @@ static struct critnib_leaf *find_successor(struct critnib_node *__restrict n) {
             return NULL;
         }
 
-        n = n->child[nib];
+        n = load_child(&n->child[nib]);
         if (is_leaf(n)) {
             return to_leaf(n);
         }
@@ -723,8 +1004,7 @@ static struct critnib_leaf *find_ge(struct critnib_node *__restrict n,
 
     unsigned nib = slice_index(key, n->shift);
     {
-        struct critnib_node *m;
-        load(&n->child[nib], &m);
+        struct critnib_node *m = load_child(&n->child[nib]);
         struct critnib_leaf *k = find_ge(m, key);
         if (k) {
             return k;
@@ -732,8 +1012,7 @@ static struct critnib_leaf *find_ge(struct critnib_node *__restrict n,
     }
 
     for (; nib < NIB; nib++) {
-        struct critnib_node *m;
-        load(&n->child[nib + 1], &m);
+        struct critnib_node *m = load_child(&n->child[nib + 1]);
         if (m) {
             n = m;
             if (is_leaf(n)) {
@@ -748,14 +1027,13 @@ static struct critnib_leaf *find_ge(struct critnib_node *__restrict n,
 }
 
 /*
- * critnib_find -- parametrized query, returns 1 if found
+ * critnib_find_inline -- parametrized query, returns 1 if found
+ *
+ * The key and value found are copied to *rkey and *rvalue, if not NULL.
  */
-int critnib_find(struct critnib *c, uintptr_t key, enum find_dir_t dir,
-                 uintptr_t *rkey, void **rvalue) {
-    uint64_t wrs1, wrs2;
+int critnib_find_inline(struct critnib *c, uintptr_t key, enum find_dir_t dir,
+                        uintptr_t *rkey, void *rvalue) {
     struct critnib_leaf *k;
-    uintptr_t _rkey = (uintptr_t)0x0;
-    void **_rvalue = NULL;
 
     /* <42 ≡ ≤41 */
     if (dir < -1) {
@@ -770,41 +1048,44 @@ int critnib_find(struct critnib *c, uintptr_t key, enum find_dir_t dir,
         key++;
     }
 
-    do {
-        load64(&c->remove_count, &wrs1);
-        struct critnib_node *n;
-        load(&c->root, &n);
-
-        if (dir < 0) {
-            k = find_le(n, key);
-        } else if (dir > 0) {
-            k = find_ge(n, key);
-        } else {
-            while (n && !is_leaf(n)) {
-                load(&n->child[slice_index(key, n->shift)], &n);
-            }
+    uint64_t epoch = epoch_enter(c);
 
-            struct critnib_leaf *kk = to_leaf(n);
-            k = (n && kk->key == key) ? kk : NULL;
-        }
-        if (k) {
-            _rkey = k->key;
-            _rvalue = k->value;
+    struct critnib_node *n;
+    load(&c->root, &n);
+
+    if (dir < 0) {
+        k = find_le(n, key);
+    } else if (dir > 0) {
+        k = find_ge(n, key);
+    } else {
+        while (n && !is_leaf(n)) {
+            n = load_child(&n->child[slice_index(key, n->shift)]);
         }
-        load64(&c->remove_count, &wrs2);
-    } while (wrs1 + DELETED_LIFE <= wrs2);
 
+        struct critnib_leaf *kk = to_leaf(n);
+        k = (n && kk->key == key) ? kk : NULL;
+    }
     if (k) {
         if (rkey) {
-            *rkey = _rkey;
+            *rkey = k->key;
         }
         if (rvalue) {
-            *rvalue = _rvalue;
+            memcpy(rvalue, &k->value, c->value_size);
         }
-        return 1;
     }
 
-    return 0;
+    epoch_exit(c, epoch);
+
+    return k != NULL;
+}
+
+/*
+ * critnib_find -- parametrized query, returns 1 if found
+ */
+int critnib_find(struct critnib *c, uintptr_t key, enum find_dir_t dir,
+                 uintptr_t *rkey, void **rvalue) {
+    ASSERT(c->value_size == sizeof(void *));
+    return critnib_find_inline(c, key, dir, rkey, rvalue);
 }
 
 /*
@@ -831,7 +1112,7 @@ static int iter(struct critnib_node *__restrict n, word min, word max,
     }
 
     for (int i = 0; i < SLNODES; i++) {
-        struct critnib_node *__restrict m = n->child[i];
+        struct critnib_node *__restrict m = load_child(&n->child[i]);
         if (m && iter(m, min, max, func, privdata)) {
             return 1;
         }
@@ -843,9 +1124,12 @@ static int iter(struct critnib_node *__restrict n, word min, word max,
 void critnib_iter(critnib *c, uintptr_t min, uintptr_t max,
                   int (*func)(uintptr_t key, void *value, void *privdata),
                   void *privdata) {
-    util_mutex_lock(&c->mutex);
-    if (c->root) {
-        iter(c->root, min, max, func, privdata);
+    ASSERT(c->value_size == sizeof(void *));
+    uint64_t epoch = epoch_enter(c);
+    struct critnib_node *root;
+    load(&c->root, &root);
+    if (root) {
+        iter(root, min, max, func, privdata);
     }
-    util_mutex_unlock(&c->mutex);
+    epoch_exit(c, epoch);
 }
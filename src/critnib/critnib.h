@@ -10,6 +10,7 @@
 #ifndef CRITNIB_H
 #define CRITNIB_H 1
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -30,6 +31,23 @@ enum find_dir_t {
 critnib *critnib_new(void);
 void critnib_delete(critnib *c);
 
+/*
+ * A critnib created by critnib_new_inline() stores values of value_size
+ * bytes in its leaves, and can be used only by the *_inline() functions.
+ */
+critnib *critnib_new_inline(size_t value_size);
+int critnib_insert_inline(critnib *c, uintptr_t key, const void *value,
+                          int update);
+void *critnib_reserve_inline(critnib *c);
+void critnib_unreserve_inline(critnib *c, void *reserved);
+int critnib_insert_reserved_inline(critnib *c, uintptr_t key,
+                                   const void *value, int update,
+                                   void *reserved);
+int critnib_remove_inline(critnib *c, uintptr_t key, void *value);
+int critnib_get_inline(critnib *c, uintptr_t key, void *value);
+int critnib_find_inline(critnib *c, uintptr_t key, enum find_dir_t dir,
+                        uintptr_t *rkey, void *rvalue);
+
 int critnib_insert(critnib *c, uintptr_t key, void *value, int update);
 void *critnib_remove(critnib *c, uintptr_t key);
 void *critnib_get(critnib *c, uintptr_t key);
@@ -63,6 +63,53 @@ umf_result_t umfPoolFree(umf_memory_pool_handle_t hPool, void *ptr) {
     return hPool->ops.free(hPool->pool_priv, ptr);
 }
 
+umf_result_t umfPoolFreeSized(umf_memory_pool_handle_t hPool, void *ptr,
+                              size_t size) {
+    UMF_CHECK((hPool != NULL), UMF_RESULT_ERROR_INVALID_ARGUMENT);
+    if (hPool->ops.free_sized) {
+        return hPool->ops.free_sized(hPool->pool_priv, ptr, size);
+    }
+    return hPool->ops.free(hPool->pool_priv, ptr);
+}
+
+size_t umfPoolMallocBatch(umf_memory_pool_handle_t hPool, size_t size,
+                          size_t num, void **ptrs) {
+    UMF_CHECK((hPool != NULL), 0);
+    UMF_CHECK((ptrs != NULL || num == 0), 0);
+    if (hPool->ops.malloc_batch) {
+        return hPool->ops.malloc_batch(hPool->pool_priv, size, num, ptrs);
+    }
+
+    size_t i;
+    for (i = 0; i < num; i++) {
+        ptrs[i] = hPool->ops.malloc(hPool->pool_priv, size);
+        if (!ptrs[i]) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+umf_result_t umfPoolFreeBatch(umf_memory_pool_handle_t hPool, void **ptrs,
+                              size_t num) {
+    UMF_CHECK((hPool != NULL), UMF_RESULT_ERROR_INVALID_ARGUMENT);
+    UMF_CHECK((ptrs != NULL || num == 0), UMF_RESULT_ERROR_INVALID_ARGUMENT);
+    if (hPool->ops.free_batch) {
+        return hPool->ops.free_batch(hPool->pool_priv, ptrs, num);
+    }
+
+    umf_result_t ret = UMF_RESULT_SUCCESS;
+    for (size_t i = 0; i < num; i++) {
+        umf_result_t free_ret = hPool->ops.free(hPool->pool_priv, ptrs[i]);
+        if (free_ret != UMF_RESULT_SUCCESS && ret == UMF_RESULT_SUCCESS) {
+            ret = free_ret;
+        }
+    }
+
+    return ret;
+}
+
 umf_result_t umfPoolGetLastAllocationError(umf_memory_pool_handle_t hPool) {
     UMF_CHECK((hPool != NULL), UMF_RESULT_ERROR_INVALID_ARGUMENT);
     return hPool->ops.get_last_allocation_error(hPool->pool_priv);
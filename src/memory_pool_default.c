@@ -60,7 +60,6 @@ void umfPoolDestroy(umf_memory_pool_handle_t hPool) {
         umfPoolGetMemoryProvider(hPool, &hProvider);
         umfMemoryProviderDestroy(hProvider);
     }
-    // TODO: this free keeps memory in base allocator, so it can lead to OOM in some scenarios (it should be optimized)
     umf_ba_free(hPool->base_allocator, hPool);
 }
 
@@ -84,3 +83,13 @@ umf_result_t umfPoolGetMemoryProvider(umf_memory_pool_handle_t hPool,
 
     return UMF_RESULT_SUCCESS;
 }
+
+umf_result_t
+umfPoolTrackMemoryProvider(umf_memory_provider_handle_t hPoolProvider,
+                           umf_memory_provider_handle_t hUpstream,
+                           umf_memory_provider_handle_t *hTrackedProvider) {
+    (void)hPoolProvider;
+    (void)hUpstream;
+    (void)hTrackedProvider;
+    return UMF_RESULT_ERROR_NOT_SUPPORTED;
+}
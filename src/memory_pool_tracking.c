@@ -73,7 +73,6 @@ void umfPoolDestroy(umf_memory_pool_handle_t hPool) {
     }
     // Destroy tracking provider.
     umfMemoryProviderDestroy(hPool->provider);
-    // TODO: this free keeps memory in base allocator, so it can lead to OOM in some scenarios (it should be optimized)
     umf_ba_free(hPool->base_allocator, hPool);
 }
 
@@ -100,3 +99,22 @@ umf_result_t umfPoolGetMemoryProvider(umf_memory_pool_handle_t hPool,
 
     return UMF_RESULT_SUCCESS;
 }
+
+umf_result_t
+umfPoolTrackMemoryProvider(umf_memory_provider_handle_t hPoolProvider,
+                           umf_memory_provider_handle_t hUpstream,
+                           umf_memory_provider_handle_t *hTrackedProvider) {
+    if (!hPoolProvider || !hUpstream || !hTrackedProvider) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    // only the provider wrapped by umfPoolCreate() knows its pool
+    if (!umfIsTrackingMemoryProvider(hPoolProvider)) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    umf_memory_pool_handle_t hPool = umfTrackingMemoryProviderGetPool(
+        umfMemoryProviderGetPriv(hPoolProvider));
+
+    return umfTrackingMemoryProviderCreate(hUpstream, hPool, hTrackedProvider);
+}
@@ -108,6 +108,12 @@ void *umfMemoryProviderGetPriv(umf_memory_provider_handle_t hProvider) {
     return hProvider->provider_priv;
 }
 
+const umf_memory_provider_ops_t *
+umfMemoryProviderGetOps(umf_memory_provider_handle_t hProvider) {
+    UMF_CHECK((hProvider != NULL), NULL);
+    return &hProvider->ops;
+}
+
 umf_result_t
 umfMemoryProviderGetRecommendedPageSize(umf_memory_provider_handle_t hProvider,
                                         size_t size, size_t *pageSize) {
@@ -11,12 +11,15 @@
 #define UMF_MEMORY_PROVIDER_INTERNAL_H 1
 
 #include <umf/memory_provider.h>
+#include <umf/memory_provider_ops.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 void *umfMemoryProviderGetPriv(umf_memory_provider_handle_t hProvider);
+const umf_memory_provider_ops_t *
+umfMemoryProviderGetOps(umf_memory_provider_handle_t hProvider);
 umf_memory_provider_handle_t *umfGetLastFailedMemoryProviderPtr(void);
 
 #ifdef __cplusplus
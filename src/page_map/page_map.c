@@ -0,0 +1,178 @@
+/*
+ *
+ * Copyright (C) 2024 Intel Corporation
+ *
+ * Under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ *
+ */
+
+/*
+ * page_map.c -- two-level radix map of memory pages to values
+ *
+ * The map covers the lower PAGE_MAP_ADDRESS_BITS bits of the address space.
+ * The root, indexed by the upper bits of the page number, points to leaves
+ * holding the values of PAGE_MAP_LEAF_SIZE consecutive pages, so a lookup
+ * takes two dependent loads.  Leaves are allocated on the first insert into
+ * their range and are never freed before the whole map, so lookups and
+ * updates need no locks -- a leaf is published with a cmpxchg of its root
+ * slot and the values are stored atomically.
+ *
+ * A page partially covered by a range may belong to another range as well,
+ * so only pages fully covered by a range are mapped.  Lookups of unmapped
+ * pages return NULL and the users have to fall back to a precise lookup
+ * (e.g. critnib).  Clearing a range unmaps all pages overlapping it, which
+ * also unmaps pages of the range's neighbours sharing a page with it --
+ * those were not mapped by the neighbours, but may have been mapped by a
+ * range which was split since.
+ *
+ * Both the root and the leaves are allocated directly from the OS, which
+ * provides them zeroed and commits their pages on first use only.
+ */
+
+#include <errno.h>
+
+#include "base_alloc_internal.h"
+#include "page_map.h"
+#include "utils_concurrency.h"
+
+#define PAGE_MAP_ADDRESS_BITS 48
+#define PAGE_MAP_LEAF_BITS 18
+#define PAGE_MAP_ROOT_BITS                                                     \
+    (PAGE_MAP_ADDRESS_BITS - PAGE_MAP_PAGE_SHIFT - PAGE_MAP_LEAF_BITS)
+
+#define PAGE_MAP_LEAF_SIZE ((uintptr_t)1 << PAGE_MAP_LEAF_BITS)
+#define PAGE_MAP_ROOT_SIZE ((uintptr_t)1 << PAGE_MAP_ROOT_BITS)
+#define PAGE_MAP_LEAF_MASK (PAGE_MAP_LEAF_SIZE - 1)
+
+// number of pages covered by the map
+#define PAGE_MAP_NUM_PAGES (PAGE_MAP_ROOT_SIZE << PAGE_MAP_LEAF_BITS)
+
+struct page_map_leaf {
+    void *values[PAGE_MAP_LEAF_SIZE];
+};
+
+struct page_map {
+    struct page_map_leaf *root[PAGE_MAP_ROOT_SIZE];
+};
+
+page_map *page_map_new(void) {
+    return (struct page_map *)ba_os_alloc(sizeof(struct page_map));
+}
+
+void page_map_delete(struct page_map *pm) {
+    for (uintptr_t i = 0; i < PAGE_MAP_ROOT_SIZE; i++) {
+        if (pm->root[i]) {
+            ba_os_free(pm->root[i], sizeof(struct page_map_leaf));
+        }
+    }
+
+    ba_os_free(pm, sizeof(struct page_map));
+}
+
+/*
+ * internal: get_leaf -- return the leaf of the page, allocate it if needed
+ */
+static struct page_map_leaf *get_leaf(struct page_map *pm, uintptr_t page) {
+    struct page_map_leaf **slot = &pm->root[page >> PAGE_MAP_LEAF_BITS];
+    struct page_map_leaf *leaf;
+    util_atomic_load_acquire(slot, &leaf);
+    if (leaf) {
+        return leaf;
+    }
+
+    struct page_map_leaf *new_leaf =
+        (struct page_map_leaf *)ba_os_alloc(sizeof(struct page_map_leaf));
+    if (!new_leaf) {
+        return NULL;
+    }
+
+    leaf = NULL;
+    if (!util_compare_exchange(slot, &leaf, &new_leaf)) {
+        // another thread has allocated the leaf in the meantime
+        ba_os_free(new_leaf, sizeof(struct page_map_leaf));
+        return leaf;
+    }
+
+    return new_leaf;
+}
+
+/*
+ * internal: page_end -- return the number of the page following the range,
+ *                       or of the page following its last partial page,
+ *                       if round_up is set, but not beyond the map
+ */
+static uintptr_t page_end(uintptr_t addr, size_t size, int round_up) {
+    uintptr_t end = addr + size;
+    if (end < addr || end > (PAGE_MAP_NUM_PAGES << PAGE_MAP_PAGE_SHIFT)) {
+        // the rest of the range is not covered by the map
+        return PAGE_MAP_NUM_PAGES;
+    }
+
+    if (round_up) {
+        end += PAGE_MAP_PAGE_SIZE - 1;
+    }
+
+    return end >> PAGE_MAP_PAGE_SHIFT;
+}
+
+int page_map_set(struct page_map *pm, uintptr_t addr, size_t size,
+                 void *value) {
+    uintptr_t page = (addr >> PAGE_MAP_PAGE_SHIFT) +
+                     ((addr & (PAGE_MAP_PAGE_SIZE - 1)) != 0);
+    uintptr_t end = page_end(addr, size, 0);
+
+    while (page < end) {
+        struct page_map_leaf *leaf = get_leaf(pm, page);
+        if (!leaf) {
+            return ENOMEM;
+        }
+
+        // map all pages of the range in this leaf
+        uintptr_t leaf_end = (page | PAGE_MAP_LEAF_MASK) + 1;
+        if (leaf_end > end) {
+            leaf_end = end;
+        }
+
+        for (; page < leaf_end; page++) {
+            util_atomic_store_release(&leaf->values[page & PAGE_MAP_LEAF_MASK],
+                                      value);
+        }
+    }
+
+    return 0;
+}
+
+void page_map_clear(struct page_map *pm, uintptr_t addr, size_t size) {
+    uintptr_t end = page_end(addr, size, 1);
+
+    for (uintptr_t page = addr >> PAGE_MAP_PAGE_SHIFT; page < end; page++) {
+        struct page_map_leaf *leaf;
+        util_atomic_load_acquire(&pm->root[page >> PAGE_MAP_LEAF_BITS], &leaf);
+        if (!leaf) {
+            // nothing was mapped in this leaf, skip it
+            page |= PAGE_MAP_LEAF_MASK;
+            continue;
+        }
+
+        util_atomic_store_release(&leaf->values[page & PAGE_MAP_LEAF_MASK],
+                                  NULL);
+    }
+}
+
+void *page_map_get(struct page_map *pm, uintptr_t addr) {
+    uintptr_t page = addr >> PAGE_MAP_PAGE_SHIFT;
+    if (page >= PAGE_MAP_NUM_PAGES) {
+        return NULL;
+    }
+
+    struct page_map_leaf *leaf;
+    util_atomic_load_acquire(&pm->root[page >> PAGE_MAP_LEAF_BITS], &leaf);
+    if (!leaf) {
+        return NULL;
+    }
+
+    void *value;
+    util_atomic_load_acquire(&leaf->values[page & PAGE_MAP_LEAF_MASK], &value);
+    return value;
+}
@@ -0,0 +1,44 @@
+/*
+ *
+ * Copyright (C) 2024 Intel Corporation
+ *
+ * Under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ *
+ */
+
+#ifndef PAGE_MAP_H
+#define PAGE_MAP_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Granularity of the page map
+#define PAGE_MAP_PAGE_SHIFT 12
+#define PAGE_MAP_PAGE_SIZE ((size_t)1 << PAGE_MAP_PAGE_SHIFT)
+
+struct page_map;
+typedef struct page_map page_map;
+
+page_map *page_map_new(void);
+void page_map_delete(page_map *pm);
+
+// Maps all pages fully covered by [addr, addr + size) to the value.
+// Returns 0 on success or ENOMEM if some of the pages could not be mapped.
+int page_map_set(page_map *pm, uintptr_t addr, size_t size, void *value);
+
+// Unmaps all pages overlapping [addr, addr + size).
+void page_map_clear(page_map *pm, uintptr_t addr, size_t size);
+
+// Returns the value of the page of addr or NULL if the page is not mapped.
+void *page_map_get(page_map *pm, uintptr_t addr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -8,30 +8,37 @@
 #include <bitset>
 #include <cassert>
 #include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <iomanip>
 #include <limits>
-#include <list>
 #include <memory>
 #include <mutex>
-#include <shared_mutex>
 #include <string>
-#include <unordered_map>
+#include <thread>
 #include <utility>
 #include <vector>
 
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 // TODO: replace with logger?
 #include <iostream>
 
 #include "../cpp_helpers.hpp"
+#include "base_alloc.h"
+#include "critnib.h"
 #include "pool_disjoint.h"
 #include "umf.h"
 #include "utils_math.h"
 
-typedef struct umf_disjoint_pool_shared_limits_t {
-    size_t MaxSize;
-    std::atomic<size_t> TotalSize;
-} umf_disjoint_pool_shared_limits_t;
-
 class DisjointPool {
   public:
     class AllocImpl;
@@ -45,7 +52,10 @@ class DisjointPool {
     void *aligned_malloc(size_t size, size_t alignment);
     size_t malloc_usable_size(void *);
     umf_result_t free(void *ptr);
+    umf_result_t free_sized(void *ptr, size_t size);
     umf_result_t get_last_allocation_error();
+    size_t malloc_batch(size_t size, size_t num, void **ptrs);
+    umf_result_t free_batch(void **ptrs, size_t num);
 
     DisjointPool();
     ~DisjointPool();
@@ -54,13 +64,74 @@ class DisjointPool {
     std::unique_ptr<AllocImpl> impl;
 };
 
+typedef struct umf_disjoint_pool_shared_limits_t {
+    // Limit of the memory cached by the pools using these limits
+    size_t MaxSize;
+    std::atomic<size_t> TotalSize;
+
+    // Limits of the memory obtained from the memory providers, in use or
+    // cached, by the pools using these limits or their descendants. Zero
+    // if not set.
+    size_t SoftLimit = 0;
+    size_t HardLimit = 0;
+    std::atomic<size_t> UsedSize{0};
+
+    umf_disjoint_pool_shared_limits_t *Parent = nullptr;
+
+    // Set when UsedSize exceeds SoftLimit, the cached memory of the pools
+    // is then released outside of their locks (see trimIfRequested()).
+    std::atomic<bool> TrimRequested{false};
+
+    // Pools using these limits and the child limits, the lock protects both
+    // lists and is held while the pools are trimmed.
+    std::mutex Lock;
+    std::vector<DisjointPool::AllocImpl *> Pools;
+    std::vector<umf_disjoint_pool_shared_limits_t *> Children;
+} umf_disjoint_pool_shared_limits_t;
+
 umf_disjoint_pool_shared_limits_t *
 umfDisjointPoolSharedLimitsCreate(size_t MaxSize) {
     return new umf_disjoint_pool_shared_limits_t{MaxSize, 0};
 }
 
+umf_disjoint_pool_shared_limits_t *umfDisjointPoolSharedLimitsCreateEx(
+    size_t MaxSize, size_t SoftLimit, size_t HardLimit,
+    umf_disjoint_pool_shared_limits_t *Parent) {
+    auto *Limits =
+        new (std::nothrow) umf_disjoint_pool_shared_limits_t{MaxSize, 0};
+    if (!Limits) {
+        return nullptr;
+    }
+
+    Limits->SoftLimit = SoftLimit;
+    Limits->HardLimit = HardLimit;
+    Limits->Parent = Parent;
+    if (Parent) {
+        try {
+            std::lock_guard<std::mutex> Lg(Parent->Lock);
+            Parent->Children.push_back(Limits);
+        } catch (std::bad_alloc &) {
+            delete Limits;
+            return nullptr;
+        }
+    }
+
+    return Limits;
+}
+
+size_t umfDisjointPoolSharedLimitsGetUsedSize(
+    umf_disjoint_pool_shared_limits_t *Limits) {
+    return Limits->UsedSize;
+}
+
 void umfDisjointPoolSharedLimitsDestroy(
     umf_disjoint_pool_shared_limits_t *limits) {
+    if (limits && limits->Parent) {
+        auto *Parent = limits->Parent;
+        std::lock_guard<std::mutex> Lg(Parent->Lock);
+        Parent->Children.erase(std::find(Parent->Children.begin(),
+                                         Parent->Children.end(), limits));
+    }
     delete limits;
 }
 
@@ -109,71 +180,151 @@ static size_t AlignUp(size_t Val, size_t Alignment) {
     return (Val + Alignment - 1) & (~(Alignment - 1));
 }
 
+// Return the NUMA node of the CPU the calling thread is running on, 0 if it
+// cannot be determined.
+static size_t getCurrentNumaNode() {
+#if defined(_WIN32)
+    PROCESSOR_NUMBER ProcNumber;
+    USHORT Node;
+    GetCurrentProcessorNumberEx(&ProcNumber);
+    if (GetNumaProcessorNodeEx(&ProcNumber, &Node)) {
+        return Node;
+    }
+#elif defined(__GLIBC__) &&                                                    \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+    // Served from vDSO, so it does not enter the kernel
+    unsigned Cpu, Node;
+    if (getcpu(&Cpu, &Node) == 0) {
+        return Node;
+    }
+#elif defined(__linux__) && defined(SYS_getcpu)
+    unsigned Cpu, Node;
+    if (syscall(SYS_getcpu, &Cpu, &Node, nullptr) == 0) {
+        return Node;
+    }
+#endif
+    return 0;
+}
+
 typedef struct MemoryProviderError {
     umf_result_t code;
 } MemoryProviderError_t;
 
 class Bucket;
 
-// Represents the allocated memory block of size 'SlabMinSize'
+// Represents the allocated memory block of at least 'SlabMinSize' bytes
 // Internally, it splits the memory block into chunks. The number of
-// chunks depends of the size of a Bucket which created the Slab.
+// chunks depends of the size of a Bucket which created the Slab and of the
+// slab size, which may differ between slabs of a bucket (see
+// Bucket::CurSlabSize).
 // Note: Bucket's methods are responsible for thread safety of Slab access,
 // so no locking happens here.
+// The slab object and its chunk bitmaps are placed in a single chunk of the
+// bucket's base allocator (see Bucket::createSlab()), so creating a slab does
+// not allocate from the system malloc.
 class Slab {
 
-    // Pointer to the allocated memory of SlabMinSize bytes
+    // Pointer to the allocated memory of SlabSize bytes
     void *MemPtr;
 
-    // Represents the current state of each chunk:
-    // if the bit is set then the chunk is allocated
-    // the chunk is free for allocation otherwise
-    std::vector<bool> Chunks;
+    // Size of the allocated memory
+    size_t SlabSize;
+
+    // Represents the current state of each chunk, 64 chunks per word:
+    // if the bit is set then the chunk is free for allocation,
+    // the chunk is allocated otherwise
+    uint64_t *FreeChunks;
+
+    // Summary of FreeChunks: if the bit is set then the corresponding word of
+    // FreeChunks has at least one free chunk. Together with FreeWordsHint it
+    // allows finding a free chunk without scanning the chunks one by one.
+    uint64_t *FreeWords;
+
+    // Total number of chunks in the slab
+    size_t NumChunks;
+
+    // Number of words of FreeChunks and FreeWords
+    size_t NumChunkWords;
+    size_t NumSummaryWords;
 
     // Total number of allocated chunks at the moment.
     size_t NumAllocated = 0;
 
+    // Chunks are allocated lowest index first, so chunks at indexes starting
+    // from this one have never been allocated and still hold the memory as
+    // returned by the memory provider. A slab used as a whole counts as one
+    // chunk.
+    size_t NumTouchedChunks = 0;
+
     // The bucket which the slab belongs to
     Bucket &bucket;
 
-    using ListIter = std::list<std::unique_ptr<Slab>>::iterator;
+    // NUMA node whose memory provider allocated the slab, always 0 if the
+    // pool does not keep slabs per node.
+    size_t Node;
+
+    // Neighbours in the bucket's list of available or unavailable slabs
+    Slab *Prev = nullptr;
+    Slab *Next = nullptr;
+    friend class SlabList;
 
-    // Store iterator to the corresponding node in avail/unavail list
-    // to achieve O(1) removal
-    ListIter SlabListIter;
+    // Index of the first word of FreeWords which might be non-zero
+    size_t FreeWordsHint = 0;
 
-    // Hints where to start search for free chunk in a slab
-    size_t FirstFreeChunkIdx = 0;
+    // Time when the empty slab was put in the pool, and whether its memory
+    // has been purged since then. Used for decay of pooled slabs.
+    std::chrono::steady_clock::time_point IdleSince;
+    bool Purged = false;
 
     // Return the index of the first available chunk, SIZE_MAX otherwise
-    size_t FindFirstAvailableChunkIdx() const;
+    size_t FindFirstAvailableChunkIdx();
 
-    // Register/Unregister the slab in the global slab address map.
-    void regSlab(Slab &);
-    void unregSlab(Slab &);
-    static void regSlabByAddr(void *, Slab &);
-    static void unregSlabByAddr(void *, Slab &);
+    // Register/Unregister the slab in the pool's slab address map.
+    void regSlab();
+    void unregSlab();
 
   public:
-    Slab(Bucket &);
+    // The metadata must be placed in memory of getMetadataSize() bytes.
+    Slab(Bucket &, size_t SlabSize, size_t Node);
     ~Slab();
 
-    void setIterator(ListIter It) { SlabListIter = It; }
-    ListIter getIterator() const { return SlabListIter; }
+    // Size of the slab object together with its bitmaps
+    static size_t getMetadataSize(size_t NumChunks);
+
+    Slab *getNext() const { return Next; }
+    Slab *getPrev() const { return Prev; }
+
+    void setIdle(std::chrono::steady_clock::time_point Now) {
+        IdleSince = Now;
+        Purged = false;
+    }
+    std::chrono::steady_clock::time_point getIdleSince() const {
+        return IdleSince;
+    }
+    bool isPurged() const { return Purged; }
+    void setPurged() { Purged = true; }
 
     size_t getNumAllocated() const { return NumAllocated; }
 
+    size_t getNode() const { return Node; }
+
     // Get pointer to allocation that is one piece of this slab.
-    void *getChunk();
+    // Fresh is set if the chunk has never been allocated before.
+    void *getChunk(bool &Fresh);
 
     // Get pointer to allocation that is this entire slab.
-    void *getSlab();
+    // Fresh is set if the slab has never been allocated before.
+    void *getSlab(bool &Fresh);
 
     void *getPtr() const { return MemPtr; }
     void *getEnd() const;
+    size_t getSize() const { return SlabSize; }
 
     size_t getChunkSize() const;
-    size_t getNumChunks() const { return Chunks.size(); }
+    size_t getNumChunks() const { return NumChunks; }
+
+    // Get pointer to the beginning of the chunk which contains Ptr.
+    void *getChunkStart(void *Ptr) const;
 
     bool hasAvail();
 
@@ -183,23 +334,181 @@ class Slab {
     void freeChunk(void *Ptr);
 };
 
+// Intrusive doubly linked list of slabs. Slabs are linked through their own
+// Prev/Next pointers, so adding and removing them does not allocate memory.
+class SlabList {
+    Slab *Head = nullptr;
+    Slab *Tail = nullptr;
+    size_t Count = 0;
+
+  public:
+    bool empty() const { return Head == nullptr; }
+    size_t size() const { return Count; }
+    Slab *front() const { return Head; }
+    Slab *back() const { return Tail; }
+
+    void pushFront(Slab *S) {
+        assert(!S->Prev && !S->Next);
+        S->Next = Head;
+        if (Head) {
+            Head->Prev = S;
+        } else {
+            Tail = S;
+        }
+        Head = S;
+        ++Count;
+    }
+
+    void pushBack(Slab *S) {
+        assert(!S->Prev && !S->Next);
+        S->Prev = Tail;
+        if (Tail) {
+            Tail->Next = S;
+        } else {
+            Head = S;
+        }
+        Tail = S;
+        ++Count;
+    }
+
+    void remove(Slab *S) {
+        if (S->Prev) {
+            S->Prev->Next = S->Next;
+        } else {
+            assert(Head == S);
+            Head = S->Next;
+        }
+        if (S->Next) {
+            S->Next->Prev = S->Prev;
+        } else {
+            assert(Tail == S);
+            Tail = S->Prev;
+        }
+        S->Prev = S->Next = nullptr;
+        --Count;
+    }
+};
+
+// A free chunk held in a per-thread cache together with the slab it belongs
+// to. Cached chunks are still accounted as allocated in their slabs, so the
+// slab cannot be destroyed while any of its chunks is cached.
+struct CachedChunk {
+    void *Ptr;
+    Slab *ChunkSlab;
+};
+
+// Per-thread cache of free chunks of a single pool, with one bounded magazine
+// per bucket. Magazines are accessed only by the owning thread, so the
+// allocation and free paths do not take any lock. The lock protects the Owner
+// pointer: the cache is flushed to its pool on thread exit or on pool
+// destruction, whichever comes first, and then detached from the pool.
+struct ThreadCache {
+    ThreadCache(DisjointPool::AllocImpl *Owner, size_t NumBuckets)
+        : Magazines(NumBuckets), Owner(Owner) {}
+
+    std::vector<std::vector<CachedChunk>> Magazines;
+    std::mutex Lock;
+    DisjointPool::AllocImpl *Owner;
+};
+
+// Bounded lock-free queue of chunks freed while the lock of their bucket was
+// held by another thread. Any thread can push, only the holder of the bucket
+// lock pops, so the freeing threads do not wait for the lock. It is the
+// bounded MPMC queue by Dmitry Vyukov, with a single consumer. The chunk
+// memory is not touched, as it might not be accessible from the host.
+class RemoteFreeQueue {
+    struct Cell {
+        std::atomic<size_t> Seq;
+        CachedChunk Chunk;
+    };
+
+    std::unique_ptr<Cell[]> Cells;
+    const size_t Mask;
+    std::atomic<size_t> EnqueuePos{0};
+    size_t DequeuePos = 0;
+
+  public:
+    // Capacity must be a power of 2
+    explicit RemoteFreeQueue(size_t Capacity)
+        : Cells(new Cell[Capacity]), Mask(Capacity - 1) {
+        for (size_t i = 0; i < Capacity; i++) {
+            Cells[i].Seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Returns false if the queue is full.
+    bool push(const CachedChunk &Chunk) {
+        size_t Pos = EnqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            auto &C = Cells[Pos & Mask];
+            size_t Seq = C.Seq.load(std::memory_order_acquire);
+            auto Diff =
+                static_cast<intptr_t>(Seq) - static_cast<intptr_t>(Pos);
+            if (Diff == 0) {
+                if (EnqueuePos.compare_exchange_weak(
+                        Pos, Pos + 1, std::memory_order_relaxed)) {
+                    C.Chunk = Chunk;
+                    C.Seq.store(Pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (Diff < 0) {
+                return false;
+            } else {
+                Pos = EnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false if the queue is empty, the bucket lock must be acquired.
+    bool pop(CachedChunk &Chunk) {
+        auto &C = Cells[DequeuePos & Mask];
+        if (C.Seq.load(std::memory_order_acquire) != DequeuePos + 1) {
+            return false;
+        }
+        Chunk = C.Chunk;
+        C.Seq.store(DequeuePos + Mask + 1, std::memory_order_release);
+        ++DequeuePos;
+        return true;
+    }
+};
+
 class Bucket {
     const size_t Size;
 
-    // List of slabs which have at least 1 available chunk.
-    std::list<std::unique_ptr<Slab>> AvailableSlabs;
+    // Alignment of the slabs requested from the memory provider, 0 if the
+    // provider's default alignment is sufficient for this bucket.
+    const size_t Alignment;
+
+    // Lists of slabs which have at least 1 available chunk, one per NUMA node
+    // (see DisjointPool::AllocImpl::getNumNodes()). Empty slabs kept in the
+    // pool are at the back of each list, the most recently pooled last.
+    std::vector<SlabList> AvailableSlabs;
 
     // List of slabs with 0 available chunk.
-    std::list<std::unique_ptr<Slab>> UnavailableSlabs;
+    SlabList UnavailableSlabs;
+
+    // Allocators of the slab metadata, one per slab size (see CurSlabSize),
+    // each created with the first slab of that size.
+    std::vector<umf_ba_pool_t *> SlabAllocators;
+
+    // Size of the next slab of a chunked bucket. It doubles with each new
+    // slab, up to SlabMaxSize(), and halves with each slab returned to the
+    // memory provider, down to SlabAllocSize().
+    size_t CurSlabSize;
 
     // Protects the bucket and all the corresponding slabs
     std::mutex BucketLock;
 
+    // Chunks freed while BucketLock was held by another thread, created on
+    // first use if enabled (see RemoteFreeQueueSize).
+    std::atomic<RemoteFreeQueue *> RemoteFrees{nullptr};
+
     // Reference to the allocator context, used access memory allocation
     // routines, slab map and etc.
     DisjointPool::AllocImpl &OwnAllocCtx;
 
-    // For buckets used in chunked mode, a counter of slabs in the pool.
+    // For buckets used in chunked mode, a counter of slabs in the pool, per
+    // NUMA node.
     // For allocations that use an entire slab each, the entries in the Available
     // list are entries in the pool.Each slab is available for a new
     // allocation.The size of the Available list is the size of the pool.
@@ -216,7 +525,7 @@ class Bucket {
     // if any of them is entirely free. Instead we keep a counter of entirely
     // empty slabs within the Available list to speed up the process of checking
     // if a slab in this bucket is already pooled.
-    size_t chunkedSlabsInPool;
+    std::vector<size_t> chunkedSlabsInPool;
 
     // Statistics
     size_t allocPoolCount;
@@ -230,41 +539,64 @@ class Bucket {
     size_t allocCount;
     size_t maxSlabsInUse;
 
-    Bucket(size_t Sz, DisjointPool::AllocImpl &AllocCtx)
-        : Size{Sz}, OwnAllocCtx{AllocCtx}, chunkedSlabsInPool(0),
-          allocPoolCount(0), freeCount(0), currSlabsInUse(0),
-          currSlabsInPool(0), maxSlabsInPool(0), allocCount(0),
-          maxSlabsInUse(0) {}
+    Bucket(size_t Sz, DisjointPool::AllocImpl &AllocCtx, size_t Align = 0);
+
+    ~Bucket();
 
     // Get pointer to allocation that is one piece of an available slab in this
-    // bucket.
-    void *getChunk(bool &FromPool);
+    // bucket. Fresh is set if the memory has not been used since it was
+    // obtained from the memory provider.
+    void *getChunk(bool &FromPool, bool &Fresh);
+
+    // Get up to Count chunks of this bucket under a single lock and append
+    // them to Chunks. A new slab is allocated only when there are no available
+    // slabs at all. Returns the number of chunks appended.
+    size_t getChunks(std::vector<CachedChunk> &Chunks, size_t Count,
+                     bool &FromPool);
+
+    // Get Count chunks of this bucket under a single lock, allocating new
+    // slabs as needed, and store them in Ptrs. Returns the number of chunks
+    // stored, less than Count only if a slab cannot be allocated after some
+    // chunks are stored.
+    size_t getChunks(void **Ptrs, size_t Count, bool &FromPool);
 
     // Get pointer to allocation that is a full slab in this bucket.
-    void *getSlab(bool &FromPool);
+    // Fresh is set if the memory has not been used since it was obtained from
+    // the memory provider.
+    void *getSlab(bool &FromPool, bool &Fresh);
 
     // Return the allocation size of this bucket.
     size_t getSize() const { return Size; }
 
+    // Return the alignment of this bucket's slabs, 0 for the default one.
+    size_t getAlignment() const { return Alignment; }
+
     // Free an allocation that is one piece of a slab in this bucket.
     void freeChunk(void *Ptr, Slab &Slab, bool &ToPool);
 
+    // Free Count chunks of this bucket under a single lock.
+    void freeChunks(const CachedChunk *Chunks, size_t Count);
+
     // Free an allocation that is a full slab in this bucket.
     void freeSlab(Slab &Slab, bool &ToPool);
 
-    umf_memory_provider_handle_t getMemHandle();
+    // Return the memory provider of the slabs of the NUMA node.
+    umf_memory_provider_handle_t getMemHandle(size_t Node);
 
     DisjointPool::AllocImpl &getAllocCtx() { return OwnAllocCtx; }
 
-    // Check whether an allocation to be freed can be placed in the pool.
-    bool CanPool(bool &ToPool);
+    // Check whether an empty slab can be placed in the pool.
+    bool CanPool(bool &ToPool, Slab &Slab);
 
     // The minimum allocation size for any slab.
     size_t SlabMinSize();
 
-    // The allocation size for a slab in this bucket.
+    // The minimum allocation size for a slab in this bucket.
     size_t SlabAllocSize();
 
+    // The maximum allocation size for a slab in this bucket.
+    size_t SlabMaxSize();
+
     // The minimum size of a chunk from this bucket's slabs.
     size_t ChunkCutOff();
 
@@ -281,92 +613,425 @@ class Bucket {
     void countFree();
 
     // Update statistics of Available/Unavailable
-    void updateStats(int InUse, int InPool);
+    void updateStats(int InUse, int InPool, size_t SlabSize);
 
     // Print bucket statistics
     void printStats(bool &TitlePrinted, const std::string &Label);
 
+    // Purge or release the pooled slabs which have been idle for longer than
+    // the configured delays.
+    void decay(std::chrono::steady_clock::time_point Now);
+
+    // Release all the pooled slabs. Unless Wait is set, nothing is released
+    // if the bucket is locked.
+    void trim(bool Wait);
+
   private:
     void onFreeChunk(Slab &, bool &ToPool);
 
+    // Queue the free of a chunk to be done by the holder of the lock.
+    // Returns false if it cannot be queued.
+    bool deferFree(void *Ptr, Slab &Slab);
+
+    // Free the queued chunks, the lock must be acquired.
+    void drainRemoteFrees();
+
+    // Get a chunk from an available slab of the NUMA node, the lock must be
+    // acquired.
+    void *getChunkLocked(Slab *&ChunkSlab, size_t Node, bool &FromPool,
+                         bool &Fresh);
+
     // Update statistics of pool usage, and indicate that an allocation was made
     // from the pool.
-    void decrementPool(bool &FromPool);
+    void decrementPool(bool &FromPool, Slab &Slab);
+
+    // Get a slab of the NUMA node to be used for chunked allocations.
+    Slab *getAvailSlab(size_t Node, bool &FromPool);
+
+    // Get a slab of the NUMA node that will be used as a whole for a single
+    // allocation.
+    Slab *getAvailFullSlab(size_t Node, bool &FromPool);
+
+    // Create a new slab of the NUMA node with metadata from SlabAllocators.
+    Slab *createSlab(size_t SlabSize, size_t Node);
+
+    // Destroy the slab, which must not be on any list.
+    void destroySlab(Slab *S);
+
+    // Index of SlabAllocators for slabs of SlabSize.
+    size_t slabSizeLevel(size_t SlabSize);
+
+    // Put an empty slab at the back of the available slabs.
+    void poolSlab(Slab *S);
+
+    // Return a pooled slab of the NUMA node to the memory provider, the lock
+    // must be acquired.
+    void releaseSlab(size_t Node, Slab *S);
+};
+
+// Slabs are registered in the slab address map under the address of their
+// first byte and, with the lowest bit of the value set, under the address of
+// their last byte. The nearest key at or below a pointer is then either the
+// start of the slab containing the pointer, or the end of a slab preceding it
+// (the pointer is within that slab only if it equals the key).
+static constexpr uintptr_t SlabEndTag = 1;
+
+// Sizes are split into sub-ranges for the size class lookup table: sizes
+// below 16 have one entry each, every next power of 2 range is split into 16
+// sub-ranges by the 4 bits following the leftmost set bit.
+static constexpr size_t SizeClassSubRangesLog2 = 4;
+static constexpr size_t SizeClassSubRanges = 1 << SizeClassSubRangesLog2;
+
+static size_t sizeClassKey(size_t Size) {
+    size_t Exp = getLeftmostSetBitPos(Size);
+    if (Exp < SizeClassSubRangesLog2) {
+        return Size;
+    }
+
+    size_t Shift = Exp - SizeClassSubRangesLog2;
+    return SizeClassSubRanges * (Shift + 1) +
+           ((Size >> Shift) & (SizeClassSubRanges - 1));
+}
+
+// The smallest size which maps to Key, an inverse of sizeClassKey().
+static size_t sizeClassKeyMinSize(size_t Key) {
+    if (Key < SizeClassSubRanges) {
+        return std::max(Key, (size_t)1);
+    }
+
+    size_t Shift = Key / SizeClassSubRanges - 1;
+    return (SizeClassSubRanges + Key % SizeClassSubRanges) << Shift;
+}
+
+// Cache of the memory of freed allocations larger than MaxPoolableSize, so
+// that allocations of similar sizes are served without calling the memory
+// provider. Cached regions are kept in free lists per power of 2 size class
+// and in a list ordered by the time they were freed, oldest first, which are
+// evicted when the cache is full. The cache is bounded by LargeCacheSize and
+// the cached bytes count against the pool's limits.
+class LargeCache {
+    struct Entry {
+        void *Ptr;
+        size_t Size;
+        std::chrono::steady_clock::time_point IdleSince;
+
+        // Neighbours in the size class list and in the list of all entries
+        Entry *Prev;
+        Entry *Next;
+        Entry *LruPrev;
+        Entry *LruNext;
+    };
+
+    static constexpr size_t NumSizeClasses = sizeof(size_t) * 8;
+    std::array<Entry *, NumSizeClasses> SizeClassLists{};
+    Entry *LruHead = nullptr;
+    Entry *LruTail = nullptr;
+    size_t CachedBytes = 0;
+
+    // Allocator of the entries, created with the first one
+    umf_ba_pool_t *EntryAllocator = nullptr;
+
+    std::mutex Lock;
+
+    DisjointPool::AllocImpl &OwnAllocCtx;
+
+    // Remove the entry from the cache, the lock must be acquired.
+    void unlink(Entry *E);
+
+    // Remove the entry from the cache and free it, the lock must be acquired.
+    void remove(Entry *E);
+
+    // Move the entry from the cache to the Evicted list, the lock must be
+    // acquired.
+    void evict(Entry *E, Entry *&Evicted);
+
+    // Return the memory of the evicted entries to the provider and free
+    // them. Called without the lock, so that the provider does not stall
+    // the other users of the cache.
+    void release(Entry *Evicted);
+
+  public:
+    LargeCache(DisjointPool::AllocImpl &AllocCtx) : OwnAllocCtx(AllocCtx) {}
+    ~LargeCache();
+
+    // Take a cached region which is not smaller than Size, at most a quarter
+    // larger, and aligned to Alignment. Returns nullptr if there is none.
+    void *get(size_t Size, size_t Alignment, size_t &RegionSize);
+
+    // Cache the region, returns false if it cannot be cached.
+    bool put(void *Ptr, size_t Size);
 
-    // Get a slab to be used for chunked allocations.
-    decltype(AvailableSlabs.begin()) getAvailSlab(bool &FromPool);
+    // Return the regions which have been cached for at least Delay to the
+    // memory provider.
+    void decay(std::chrono::steady_clock::time_point Now,
+               std::chrono::steady_clock::duration Delay);
 
-    // Get a slab that will be used as a whole for a single allocation.
-    decltype(AvailableSlabs.begin()) getAvailFullSlab(bool &FromPool);
+    // Return all the cached regions to the memory provider.
+    void clear();
+};
+
+// Memory providers of the NUMA nodes (see NodeProviders in
+// umf_disjoint_pool_params_t), wrapped with umfPoolTrackMemoryProvider() so
+// that the slabs allocated from them are attributed to the pool.
+class NodeProviderList {
+    std::vector<umf_memory_provider_handle_t> Providers;
+
+    // Whether Providers are the wrappers, which have to be destroyed
+    bool OwnProviders = false;
+
+  public:
+    NodeProviderList(umf_memory_provider_handle_t hPoolProvider,
+                     const umf_disjoint_pool_params_t &Params);
+    ~NodeProviderList();
+
+    NodeProviderList(const NodeProviderList &) = delete;
+    NodeProviderList &operator=(const NodeProviderList &) = delete;
+
+    bool empty() const { return Providers.empty(); }
+    size_t size() const { return Providers.size(); }
+    umf_memory_provider_handle_t operator[](size_t Node) const {
+        return Providers[Node];
+    }
 };
 
 class DisjointPool::AllocImpl {
-    // It's important for the map to be destroyed last after buckets and their
-    // slabs This is because slab's destructor removes the object from the map.
-    std::unordered_multimap<void *, Slab &> KnownSlabs;
-    std::shared_timed_mutex KnownSlabsMapLock;
+    // Slab address map, see SlabEndTag. Lookups are lock-free, so frees do not
+    // contend on it. It's important for the map to be destroyed last after
+    // buckets and their slabs. This is because slab's destructor removes the
+    // object from the map.
+    critnib *KnownSlabs;
+
+    // Sizes of the allocations done directly from the memory provider, i.e.
+    // larger than MaxPoolableSize, keyed by their addresses.
+    critnib *LargeAllocs;
 
     // Handle to the memory provider
     umf_memory_provider_handle_t MemHandle;
 
+    // Memory providers of the slabs of each NUMA node, empty if the slabs
+    // are not kept per node.
+    NodeProviderList NodeProviders;
+
     // Store as unique_ptrs since Bucket is not Movable(because of std::mutex)
     std::vector<std::unique_ptr<Bucket>> Buckets;
 
+    // Buckets for allocations aligned to more than ProviderMinPageSize,
+    // indexed by the alignment exponent. Their slabs are requested from the
+    // memory provider with that alignment, so that no padding is needed.
+    // Each set is created on first use.
+    static constexpr size_t MaxAlignmentExp = sizeof(size_t) * 8;
+    std::array<std::vector<std::unique_ptr<Bucket>>, MaxAlignmentExp>
+        AlignedBuckets;
+    std::array<std::once_flag, MaxAlignmentExp> AlignedBucketsOnce;
+
+    // Set once the corresponding set of AlignedBuckets is created
+    std::array<std::atomic<bool>, MaxAlignmentExp> AlignedBucketsReady{};
+
     // Configuration for this instance
     umf_disjoint_pool_params_t params;
 
     umf_disjoint_pool_shared_limits_t DefaultSharedLimits = {
         (std::numeric_limits<size_t>::max)(), 0};
 
-    // Used in algorithm for finding buckets
-    std::size_t MinBucketSizeExp;
+    // Lookup table for finding buckets, see sizeClassKey(). Each entry holds
+    // the index of the first bucket not smaller than the smallest size of
+    // the entry's sub-range.
+    std::vector<uint32_t> SizeClassLut;
 
     // Coarse-grain allocation min alignment
     size_t ProviderMinPageSize;
 
+    // Unique identifier of this pool instance, used by threads to find their
+    // caches of this pool. Unlike the pool address it is never reused.
+    const size_t Id;
+
+    // Per-thread caches of this pool which are not flushed yet
+    std::vector<std::shared_ptr<ThreadCache>> ThreadCaches;
+    std::mutex ThreadCachesLock;
+
+    // Interval between decays of pooled slabs, zero if decay is disabled
+    std::chrono::steady_clock::duration DecayInterval{0};
+
+    // Time of the next lazy decay, in steady_clock ticks
+    std::atomic<std::chrono::steady_clock::rep> NextDecayTime{0};
+
+    // Background decay thread, if enabled
+    std::thread DecayThread;
+    std::mutex DecayLock;
+    std::condition_variable DecayCv;
+    bool DecayStop = false;
+
+    // Statistics of decay
+    std::atomic<size_t> PurgedBytes{0};
+    std::atomic<size_t> ReleasedBytes{0};
+
+    // Memory of freed allocations larger than MaxPoolableSize
+    LargeCache LargeRegions{*this};
+
   public:
     AllocImpl(umf_memory_provider_handle_t hProvider,
               umf_disjoint_pool_params_t *params)
-        : MemHandle{hProvider}, params(*params) {
-
-        // Generate buckets sized such as: 64, 96, 128, 192, ..., CutOff.
-        // Powers of 2 and the value halfway between the powers of 2.
-        auto Size1 = this->params.MinBucketSize;
-        // MinBucketSize cannot be larger than CutOff.
-        Size1 = std::min(Size1, CutOff);
-        // Buckets sized smaller than the bucket default size- 8 aren't needed.
-        Size1 = std::max(Size1, UMF_DISJOINT_POOL_MIN_BUCKET_DEFAULT_SIZE);
-        // Calculate the exponent for MinBucketSize used for finding buckets.
-        MinBucketSizeExp = (size_t)log2Utils(Size1);
-        auto Size2 = Size1 + Size1 / 2;
-        for (; Size2 < CutOff; Size1 *= 2, Size2 *= 2) {
-            Buckets.push_back(std::make_unique<Bucket>(Size1, *this));
-            Buckets.push_back(std::make_unique<Bucket>(Size2, *this));
-        }
-        Buckets.push_back(std::make_unique<Bucket>(CutOff, *this));
+        : MemHandle{hProvider}, NodeProviders(hProvider, *params),
+          params(*params), Id(NextPoolId++) {
+
+        KnownSlabs = critnib_new();
+        if (!KnownSlabs) {
+            throw std::bad_alloc();
+        }
+
+        LargeAllocs = critnib_new();
+        if (!LargeAllocs) {
+            critnib_delete(KnownSlabs);
+            throw std::bad_alloc();
+        }
+
+        if (this->params.SizeClasses) {
+            for (size_t i = 0; i < this->params.NumSizeClasses; i++) {
+                Buckets.push_back(std::make_unique<Bucket>(
+                    this->params.SizeClasses[i], *this));
+            }
+        } else {
+            // Generate buckets sized such as: 64, 80, 96, 112, 128, 160, ...,
+            // CutOff. Four size classes per power of 2, at least 8 bytes
+            // apart, so that chunks stay 8-byte aligned.
+            auto Size1 = this->params.MinBucketSize;
+            // MinBucketSize cannot be larger than CutOff.
+            Size1 = std::min(Size1, CutOff);
+            // Buckets sized smaller than the bucket default size- 8 aren't
+            // needed.
+            Size1 = std::max(Size1, UMF_DISJOINT_POOL_MIN_BUCKET_DEFAULT_SIZE);
+            for (; Size1 < CutOff; Size1 *= 2) {
+                auto Step = std::max(Size1 / 4, (size_t)8);
+                for (auto Size2 = Size1; Size2 < 2 * Size1; Size2 += Step) {
+                    Buckets.push_back(std::make_unique<Bucket>(Size2, *this));
+                }
+            }
+            Buckets.push_back(std::make_unique<Bucket>(CutOff, *this));
+        }
+
+        // Larger allocations don't fit in any bucket
+        this->params.MaxPoolableSize = std::min(this->params.MaxPoolableSize,
+                                                Buckets.back()->getSize());
+
+        auto NumKeys = sizeClassKey(Buckets.back()->getSize()) + 1;
+        SizeClassLut.resize(NumKeys);
+        uint32_t Idx = 0;
+        for (size_t Key = 0; Key < NumKeys; Key++) {
+            while (Buckets[Idx]->getSize() < sizeClassKeyMinSize(Key)) {
+                Idx++;
+            }
+            SizeClassLut[Key] = Idx;
+        }
 
         auto ret = umfMemoryProviderGetMinPageSize(hProvider, nullptr,
                                                    &ProviderMinPageSize);
         if (ret != UMF_RESULT_SUCCESS) {
             ProviderMinPageSize = 0;
         }
+
+        // Decay twice per the shortest delay, so that slabs are purged or
+        // released at most half of the delay late.
+        size_t DecayDelayMs = std::min(
+            this->params.PurgeDelayMs ? this->params.PurgeDelayMs : SIZE_MAX,
+            this->params.ReleaseDelayMs ? this->params.ReleaseDelayMs
+                                        : SIZE_MAX);
+        if (DecayDelayMs != SIZE_MAX) {
+            DecayInterval = std::chrono::microseconds(DecayDelayMs * 500);
+        }
+
+        // Only the limits' lock is held while the pool is trimmed, so the
+        // pool must be ready before it is registered.
+        auto *Limits = getLimits();
+        {
+            std::lock_guard<std::mutex> Lg(Limits->Lock);
+            try {
+                Limits->Pools.push_back(this);
+            } catch (std::bad_alloc &) {
+                critnib_delete(KnownSlabs);
+                critnib_delete(LargeAllocs);
+                throw;
+            }
+        }
+
+        if (isDecayEnabled() && this->params.DecayThread) {
+            try {
+                DecayThread = std::thread([this] { decayThreadMain(); });
+            } catch (std::system_error &) {
+                {
+                    std::lock_guard<std::mutex> Lg(Limits->Lock);
+                    Limits->Pools.pop_back();
+                }
+                critnib_delete(KnownSlabs);
+                critnib_delete(LargeAllocs);
+                throw std::bad_alloc();
+            }
+        }
     }
 
+    ~AllocImpl();
+
     void *allocate(size_t Size, size_t Alignment, bool &FromPool);
     void *allocate(size_t Size, bool &FromPool);
+    void *allocateZeroed(size_t Size, bool &FromPool);
     void deallocate(void *Ptr, bool &ToPool);
 
+    // Free an allocation of Size bytes, done by allocate(Size) or
+    // allocateZeroed(Size). Large allocations skip the slab lookup.
+    void deallocate(void *Ptr, size_t Size, bool &ToPool);
+
+    // Allocate Num blocks of Size bytes and store them in Ptrs. The chunks
+    // are taken from the calling thread's cache first, the rest from the
+    // bucket under a single lock. Returns the number of blocks allocated.
+    size_t allocateBatch(size_t Size, size_t Num, void **Ptrs);
+
+    // Free Num blocks, freeing consecutive chunks of the same bucket under a
+    // single lock. Returns the error of the first free which failed.
+    umf_result_t deallocateBatch(void **Ptrs, size_t Num);
+
+    // Return the number of bytes available at Ptr, 0 for unknown pointers.
+    size_t getUsableSize(void *Ptr);
+
+    // Check whether the allocation at Ptr can be resized to Size in place.
+    bool canResizeInPlace(void *Ptr, size_t Size);
+
+    // Return all chunks held in Cache to their buckets.
+    void flushThreadCache(ThreadCache &Cache);
+
+    // Remove Cache from the list of caches flushed on pool destruction.
+    void unregisterThreadCache(ThreadCache *Cache);
+
     umf_memory_provider_handle_t getMemHandle() { return MemHandle; }
 
-    std::shared_timed_mutex &getKnownSlabsMapLock() {
-        return KnownSlabsMapLock;
+    // Return the memory provider of the slabs of the NUMA node.
+    umf_memory_provider_handle_t getMemHandle(size_t Node) {
+        return NodeProviders.empty() ? MemHandle : NodeProviders[Node];
+    }
+
+    // Number of NUMA nodes whose slabs are kept separately by buckets.
+    size_t getNumNodes() const {
+        return NodeProviders.empty() ? 1 : NodeProviders.size();
     }
-    std::unordered_multimap<void *, Slab &> &getKnownSlabs() {
-        return KnownSlabs;
+
+    // Return the NUMA node of the calling thread's slabs.
+    size_t getCurrentNode() const {
+        if (NodeProviders.empty()) {
+            return 0;
+        }
+        return getCurrentNumaNode() % NodeProviders.size();
     }
 
+    critnib *getKnownSlabs() { return KnownSlabs; }
+
     size_t SlabMinSize() { return params.SlabMinSize; };
 
+    // Check whether pooled slabs are purged or released after a delay.
+    bool isDecayEnabled() const { return DecayInterval.count() != 0; }
+
+    void countPurged(size_t Size) { PurgedBytes += Size; }
+    void countReleased(size_t Size) { ReleasedBytes += Size; }
+    size_t getPurgedBytes() const { return PurgedBytes; }
+    size_t getReleasedBytes() const { return ReleasedBytes; }
+
     umf_disjoint_pool_params_t &getParams() { return params; }
 
     umf_disjoint_pool_shared_limits_t *getLimits() {
@@ -377,14 +1042,153 @@ class DisjointPool::AllocImpl {
         }
     };
 
+    // Account Size bytes obtained from the memory provider against the
+    // limits and their ancestors. If a hard limit would be exceeded, the
+    // pools below it are trimmed and the charge is retried once, before
+    // throwing. LockedBucket is the bucket whose lock the caller holds, if
+    // any, it is not trimmed.
+    void chargeLimits(size_t Size, Bucket *LockedBucket = nullptr);
+
+    // Charge Size to Limits and their ancestors, all of them or none.
+    // Returns the limits whose hard limit would be exceeded, if any.
+    static umf_disjoint_pool_shared_limits_t *
+    tryChargeLimits(umf_disjoint_pool_shared_limits_t *Limits, size_t Size);
+
+    // Account Size bytes returned to the memory provider.
+    void unchargeLimits(size_t Size);
+
+    // Check whether the limits or any of their ancestors are over the soft
+    // limit, no memory is cached then.
+    bool isOverSoftLimit();
+
+    // Release all the memory cached by the pool, see Bucket::trim(), except
+    // that of SkipBucket.
+    void trim(bool Wait, Bucket *SkipBucket = nullptr);
+
     void printStats(bool &TitlePrinted, size_t &HighBucketSize,
                     size_t &HighPeakSlabsInUse, const std::string &Label);
 
   private:
     Bucket &findBucket(size_t Size);
     std::size_t sizeToIdx(size_t Size);
+
+    // Find the bucket for an allocation of Size, which must be a multiple of
+    // Alignment, among the buckets with slabs aligned to Alignment.
+    Bucket &findAlignedBucket(size_t Size, size_t Alignment);
+
+    static std::atomic<size_t> NextPoolId;
+
+    // Check whether chunks of the bucket are served from per-thread caches.
+    bool isCacheable(Bucket &Bucket);
+
+    // Get the calling thread's cache of this pool, creating it if needed.
+    // Returns nullptr if the cache cannot be used.
+    ThreadCache *getThreadCache();
+
+    // Get a chunk from the calling thread's cache or directly from the bucket.
+    void *getChunk(Bucket &Bucket, bool &FromPool);
+
+    // Find the slab containing Ptr, nullptr if Ptr is not within any slab.
+    Slab *findSlab(void *Ptr);
+
+    // Allocate from the large allocation cache or directly from the memory
+    // provider and record the size. Fresh is set if the memory is obtained
+    // from the provider.
+    void *allocateLarge(size_t Size, size_t Alignment, bool &Fresh);
+
+    // Free an allocation done by allocateLarge() or not known to the pool.
+    void deallocateLarge(void *Ptr);
+
+    // Free a chunk to the calling thread's cache or directly to the bucket.
+    void freeChunk(void *Ptr, Slab &Slab, bool &ToPool);
+
+    // Decay pooled slabs of all buckets.
+    void decay();
+
+    // Decay lazily, if it's time to, when decay is not done by a thread.
+    void tickDecay();
+
+    // Trim the pools below the limits which have exceeded the soft limit.
+    void trimIfRequested();
+
+    // Trim all the pools below Limits, recursively, except SkipBucket.
+    // Unless Wait is set, the limits and buckets locked by other threads are
+    // skipped, so that it can be called with the lock of SkipBucket held.
+    static void trimLimits(umf_disjoint_pool_shared_limits_t *Limits,
+                           bool Wait, Bucket *SkipBucket = nullptr);
+
+    void decayThreadMain();
+};
+
+std::atomic<size_t> DisjointPool::AllocImpl::NextPoolId{0};
+
+// Caches of all the pools used by the current thread. They are flushed to
+// their pools when the thread exits.
+class ThreadCacheList {
+  public:
+    ~ThreadCacheList();
+
+    std::vector<std::pair<size_t, std::shared_ptr<ThreadCache>>> Caches;
 };
 
+static thread_local ThreadCacheList TLThreadCaches;
+
+// Set when TLThreadCaches of the current thread is destroyed, the caches are
+// bypassed afterwards (e.g. for frees done by other thread_local destructors).
+static thread_local bool TLThreadCachesDestroyed = false;
+
+ThreadCacheList::~ThreadCacheList() {
+    TLThreadCachesDestroyed = true;
+    for (auto &Entry : Caches) {
+        auto &Cache = *Entry.second;
+        std::lock_guard<std::mutex> Lg(Cache.Lock);
+        if (Cache.Owner) {
+            Cache.Owner->flushThreadCache(Cache);
+            Cache.Owner->unregisterThreadCache(&Cache);
+            Cache.Owner = nullptr;
+        }
+    }
+}
+
+NodeProviderList::NodeProviderList(umf_memory_provider_handle_t hPoolProvider,
+                                   const umf_disjoint_pool_params_t &Params) {
+    if (!Params.NodeProviders) {
+        return;
+    }
+
+    Providers.reserve(Params.NumNodeProviders);
+    OwnProviders = true;
+    for (size_t i = 0; i < Params.NumNodeProviders; i++) {
+        umf_memory_provider_handle_t hProvider;
+        auto ret = umfPoolTrackMemoryProvider(
+            hPoolProvider, Params.NodeProviders[i], &hProvider);
+        if (ret == UMF_RESULT_ERROR_NOT_SUPPORTED) {
+            // Pools are not tracked, the providers can be used directly
+            assert(Providers.empty());
+            OwnProviders = false;
+            Providers.assign(Params.NodeProviders,
+                             Params.NodeProviders + Params.NumNodeProviders);
+            return;
+        }
+        if (ret != UMF_RESULT_SUCCESS) {
+            // The destructor is not called if the constructor throws
+            for (auto hCreated : Providers) {
+                umfMemoryProviderDestroy(hCreated);
+            }
+            throw MemoryProviderError{ret};
+        }
+        Providers.push_back(hProvider);
+    }
+}
+
+NodeProviderList::~NodeProviderList() {
+    if (OwnProviders) {
+        for (auto hProvider : Providers) {
+            umfMemoryProviderDestroy(hProvider);
+        }
+    }
+}
+
 static void *memoryProviderAlloc(umf_memory_provider_handle_t hProvider,
                                  size_t size, size_t alignment = 0) {
     void *ptr;
@@ -396,8 +1200,8 @@ static void *memoryProviderAlloc(umf_memory_provider_handle_t hProvider,
 }
 
 static void memoryProviderFree(umf_memory_provider_handle_t hProvider,
-                               void *ptr) {
-    auto ret = umfMemoryProviderFree(hProvider, ptr, 0);
+                               void *ptr, size_t size) {
+    auto ret = umfMemoryProviderFree(hProvider, ptr, size);
     if (ret != UMF_RESULT_SUCCESS) {
         throw MemoryProviderError{ret};
     }
@@ -413,25 +1217,72 @@ std::ostream &operator<<(std::ostream &Os, const Slab &Slab) {
     return Os;
 }
 
-Slab::Slab(Bucket &Bkt)
-    : // In case bucket size is not a multiple of SlabMinSize, we would have
-      // some padding at the end of the slab.
-      Chunks(Bkt.SlabMinSize() / Bkt.getSize()), NumAllocated{0},
-      bucket(Bkt), SlabListIter{}, FirstFreeChunkIdx{0} {
-    auto SlabSize = Bkt.SlabAllocSize();
-    MemPtr = memoryProviderAlloc(Bkt.getMemHandle(), SlabSize);
-    regSlab(*this);
+static constexpr size_t BitsPerWord = 64;
+
+static size_t numBitmapWords(size_t NumBits) {
+    return (NumBits + BitsPerWord - 1) / BitsPerWord;
 }
 
-Slab::~Slab() {
+size_t Slab::getMetadataSize(size_t NumChunks) {
+    size_t NumWords = numBitmapWords(NumChunks);
+    return sizeof(Slab) +
+           (NumWords + numBitmapWords(NumWords)) * sizeof(uint64_t);
+}
+
+Slab::Slab(Bucket &Bkt, size_t SlabSize, size_t Node)
+    : SlabSize(SlabSize),
+      // In case bucket size is not a multiple of SlabSize, we would have
+      // some padding at the end of the slab.
+      NumChunks(SlabSize / Bkt.getSize()), NumAllocated{0}, bucket(Bkt),
+      Node(Node), FreeWordsHint{0} {
+    // The bitmaps are placed right after the slab object
+    NumChunkWords = numBitmapWords(NumChunks);
+    NumSummaryWords = numBitmapWords(NumChunkWords);
+    FreeChunks = reinterpret_cast<uint64_t *>(this + 1);
+    FreeWords = FreeChunks + NumChunkWords;
+
+    // All chunks are free initially
+    std::fill_n(FreeChunks, NumChunkWords, ~(uint64_t)0);
+    if (NumChunks % BitsPerWord) {
+        FreeChunks[NumChunkWords - 1] =
+            ((uint64_t)1 << (NumChunks % BitsPerWord)) - 1;
+    }
+
+    std::fill_n(FreeWords, NumSummaryWords, ~(uint64_t)0);
+    if (NumChunkWords % BitsPerWord) {
+        FreeWords[NumSummaryWords - 1] =
+            ((uint64_t)1 << (NumChunkWords % BitsPerWord)) - 1;
+    }
+
+    auto &AllocCtx = Bkt.getAllocCtx();
+    // The bucket lock is held by the caller of Bucket::createSlab()
+    AllocCtx.chargeLimits(SlabSize, &Bkt);
+    try {
+        MemPtr = memoryProviderAlloc(Bkt.getMemHandle(Node), SlabSize,
+                                     Bkt.getAlignment());
+    } catch (MemoryProviderError &) {
+        AllocCtx.unchargeLimits(SlabSize);
+        throw;
+    }
+
     try {
-        unregSlab(*this);
-    } catch (std::exception &e) {
-        std::cerr << "DisjointPool: unexpected error: " << e.what() << "\n";
+        regSlab();
+    } catch (MemoryProviderError &) {
+        umfMemoryProviderFree(Bkt.getMemHandle(Node), MemPtr, SlabSize);
+        AllocCtx.unchargeLimits(SlabSize);
+        throw;
     }
+}
+
+Slab::~Slab() {
+    unregSlab();
+
+    // The slab is not used by the pool anymore, even if the provider fails
+    // to free it
+    bucket.getAllocCtx().unchargeLimits(SlabSize);
 
     try {
-        memoryProviderFree(bucket.getMemHandle(), MemPtr);
+        memoryProviderFree(bucket.getMemHandle(Node), MemPtr, SlabSize);
     } catch (MemoryProviderError &e) {
         std::cerr << "DisjointPool: error from memory provider: " << e.code
                   << "\n";
@@ -448,84 +1299,91 @@ Slab::~Slab() {
 }
 
 // Return the index of the first available chunk, SIZE_MAX otherwise
-size_t Slab::FindFirstAvailableChunkIdx() const {
-    // Use the first free chunk index as a hint for the search.
-    auto It = std::find_if(Chunks.begin() + FirstFreeChunkIdx, Chunks.end(),
-                           [](auto x) { return !x; });
-    if (It != Chunks.end()) {
-        return It - Chunks.begin();
+size_t Slab::FindFirstAvailableChunkIdx() {
+    // Words of FreeWords before the hint are known to be zero.
+    while (FreeWordsHint < NumSummaryWords && !FreeWords[FreeWordsHint]) {
+        ++FreeWordsHint;
+    }
+
+    if (FreeWordsHint == NumSummaryWords) {
+        return std::numeric_limits<size_t>::max();
     }
 
-    return std::numeric_limits<size_t>::max();
+    size_t WordIdx = FreeWordsHint * BitsPerWord +
+                     getRightmostSetBitPos(FreeWords[FreeWordsHint]);
+    return WordIdx * BitsPerWord + getRightmostSetBitPos(FreeChunks[WordIdx]);
 }
 
-void *Slab::getChunk() {
-    // assert(NumAllocated != Chunks.size());
+void *Slab::getChunk(bool &Fresh) {
+    // assert(NumAllocated != NumChunks);
 
     const size_t ChunkIdx = FindFirstAvailableChunkIdx();
     // Free chunk must exist, otherwise we would have allocated another slab
     assert(ChunkIdx != (std::numeric_limits<size_t>::max()));
 
+    Fresh = ChunkIdx >= NumTouchedChunks;
+    NumTouchedChunks = std::max(NumTouchedChunks, ChunkIdx + 1);
+
     void *const FreeChunk =
         (static_cast<uint8_t *>(getPtr())) + ChunkIdx * getChunkSize();
-    Chunks[ChunkIdx] = true;
-    NumAllocated += 1;
 
-    // Use the found index as the next hint
-    FirstFreeChunkIdx = ChunkIdx;
+    const size_t WordIdx = ChunkIdx / BitsPerWord;
+    FreeChunks[WordIdx] &= ~((uint64_t)1 << (ChunkIdx % BitsPerWord));
+    if (!FreeChunks[WordIdx]) {
+        FreeWords[WordIdx / BitsPerWord] &=
+            ~((uint64_t)1 << (WordIdx % BitsPerWord));
+    }
+    NumAllocated += 1;
 
     return FreeChunk;
 }
 
-void *Slab::getSlab() { return getPtr(); }
+void *Slab::getSlab(bool &Fresh) {
+    Fresh = NumTouchedChunks == 0;
+    NumTouchedChunks = 1;
+    return getPtr();
+}
 
 Bucket &Slab::getBucket() { return bucket; }
 const Bucket &Slab::getBucket() const { return bucket; }
 
 size_t Slab::getChunkSize() const { return bucket.getSize(); }
 
-void Slab::regSlabByAddr(void *Addr, Slab &Slab) {
-    auto &Lock = Slab.getBucket().getAllocCtx().getKnownSlabsMapLock();
-    auto &Map = Slab.getBucket().getAllocCtx().getKnownSlabs();
+void Slab::regSlab() {
+    auto *Map = bucket.getAllocCtx().getKnownSlabs();
+    auto StartAddr = reinterpret_cast<uintptr_t>(getPtr());
+    auto LastAddr = reinterpret_cast<uintptr_t>(getEnd()) - 1;
+    assert(StartAddr < LastAddr);
+
+    if (critnib_insert(Map, StartAddr, this, 0) != 0) {
+        throw MemoryProviderError{UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY};
+    }
 
-    std::lock_guard<std::shared_timed_mutex> Lg(Lock);
-    Map.insert({Addr, Slab});
+    auto *TaggedSlab = reinterpret_cast<void *>(
+        reinterpret_cast<uintptr_t>(this) | SlabEndTag);
+    if (critnib_insert(Map, LastAddr, TaggedSlab, 0) != 0) {
+        critnib_remove(Map, StartAddr);
+        throw MemoryProviderError{UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY};
+    }
 }
 
-void Slab::unregSlabByAddr(void *Addr, Slab &Slab) {
-    auto &Lock = Slab.getBucket().getAllocCtx().getKnownSlabsMapLock();
-    auto &Map = Slab.getBucket().getAllocCtx().getKnownSlabs();
-
-    std::lock_guard<std::shared_timed_mutex> Lg(Lock);
-
-    auto Slabs = Map.equal_range(Addr);
-    // At least the must get the current slab from the map.
-    assert(Slabs.first != Slabs.second && "Slab is not found");
-
-    for (auto It = Slabs.first; It != Slabs.second; ++It) {
-        if (It->second == Slab) {
-            Map.erase(It);
-            return;
-        }
-    }
-
-    assert(false && "Slab is not found");
-}
-
-void Slab::regSlab(Slab &Slab) {
-    void *StartAddr = AlignPtrDown(Slab.getPtr(), bucket.SlabMinSize());
-    void *EndAddr = static_cast<char *>(StartAddr) + bucket.SlabMinSize();
-
-    regSlabByAddr(StartAddr, Slab);
-    regSlabByAddr(EndAddr, Slab);
+void Slab::unregSlab() {
+    auto *Map = bucket.getAllocCtx().getKnownSlabs();
+    auto StartAddr = reinterpret_cast<uintptr_t>(getPtr());
+    auto LastAddr = reinterpret_cast<uintptr_t>(getEnd()) - 1;
+
+    [[maybe_unused]] void *Value = critnib_remove(Map, StartAddr);
+    assert(Value == this && "Slab is not found");
+    Value = critnib_remove(Map, LastAddr);
+    assert(reinterpret_cast<uintptr_t>(Value) ==
+               (reinterpret_cast<uintptr_t>(this) | SlabEndTag) &&
+           "Slab is not found");
 }
 
-void Slab::unregSlab(Slab &Slab) {
-    void *StartAddr = AlignPtrDown(Slab.getPtr(), bucket.SlabMinSize());
-    void *EndAddr = static_cast<char *>(StartAddr) + bucket.SlabMinSize();
-
-    unregSlabByAddr(StartAddr, Slab);
-    unregSlabByAddr(EndAddr, Slab);
+void *Slab::getChunkStart(void *Ptr) const {
+    auto ChunkIdx = (static_cast<char *>(Ptr) - static_cast<char *>(MemPtr)) /
+                    getChunkSize();
+    return static_cast<char *>(MemPtr) + ChunkIdx * getChunkSize();
 }
 
 void Slab::freeChunk(void *Ptr) {
@@ -540,137 +1398,314 @@ void Slab::freeChunk(void *Ptr) {
     auto ChunkIdx = (static_cast<char *>(Ptr) - static_cast<char *>(MemPtr)) /
                     getChunkSize();
 
+    const size_t WordIdx = ChunkIdx / BitsPerWord;
+    const uint64_t ChunkBit = (uint64_t)1 << (ChunkIdx % BitsPerWord);
+
     // Make sure that the chunk was allocated
-    assert(Chunks[ChunkIdx] && "double free detected");
+    assert(!(FreeChunks[WordIdx] & ChunkBit) && "double free detected");
 
-    Chunks[ChunkIdx] = false;
+    FreeChunks[WordIdx] |= ChunkBit;
+    FreeWords[WordIdx / BitsPerWord] |= (uint64_t)1 << (WordIdx % BitsPerWord);
     NumAllocated -= 1;
 
-    if (ChunkIdx < FirstFreeChunkIdx) {
-        FirstFreeChunkIdx = ChunkIdx;
+    if (WordIdx / BitsPerWord < FreeWordsHint) {
+        FreeWordsHint = WordIdx / BitsPerWord;
     }
 }
 
 void *Slab::getEnd() const {
-    return static_cast<char *>(getPtr()) + bucket.SlabMinSize();
+    return static_cast<char *>(getPtr()) + SlabSize;
 }
 
 bool Slab::hasAvail() { return NumAllocated != getNumChunks(); }
 
 // If a slab was available in the pool then note that the current pooled
 // size has reduced by the size of a slab in this bucket.
-void Bucket::decrementPool(bool &FromPool) {
+void Bucket::decrementPool(bool &FromPool, Slab &Slab) {
     FromPool = true;
-    updateStats(1, -1);
-    OwnAllocCtx.getLimits()->TotalSize -= SlabAllocSize();
+    updateStats(1, -1, Slab.getSize());
+    OwnAllocCtx.getLimits()->TotalSize -= Slab.getSize();
+}
+
+Bucket::Bucket(size_t Sz, DisjointPool::AllocImpl &AllocCtx, size_t Align)
+    : Size{Sz}, Alignment{Align}, AvailableSlabs(AllocCtx.getNumNodes()),
+      OwnAllocCtx{AllocCtx}, chunkedSlabsInPool(AllocCtx.getNumNodes(), 0),
+      allocPoolCount(0), freeCount(0), currSlabsInUse(0), currSlabsInPool(0),
+      maxSlabsInPool(0), allocCount(0), maxSlabsInUse(0) {
+    CurSlabSize = SlabAllocSize();
+    SlabAllocators.resize(slabSizeLevel(SlabMaxSize()) + 1);
+}
+
+Bucket::~Bucket() {
+    auto destroyAll = [this](SlabList &List) {
+        while (!List.empty()) {
+            auto *S = List.front();
+            List.remove(S);
+            destroySlab(S);
+        }
+    };
+
+    for (auto &List : AvailableSlabs) {
+        destroyAll(List);
+    }
+    destroyAll(UnavailableSlabs);
+
+    delete RemoteFrees.load();
+
+    for (auto *SlabAllocator : SlabAllocators) {
+        if (SlabAllocator) {
+            umf_ba_destroy(SlabAllocator);
+        }
+    }
+}
+
+size_t Bucket::slabSizeLevel(size_t SlabSize) {
+    // Slab sizes are SlabAllocSize() multiplied by powers of 2
+    return log2Utils(SlabSize / SlabAllocSize());
+}
+
+Slab *Bucket::createSlab(size_t SlabSize, size_t Node) {
+    auto *&SlabAllocator = SlabAllocators[slabSizeLevel(SlabSize)];
+    if (!SlabAllocator) {
+        SlabAllocator =
+            umf_ba_create(Slab::getMetadataSize(SlabSize / getSize()));
+        if (!SlabAllocator) {
+            throw MemoryProviderError{UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY};
+        }
+    }
+
+    void *Mem = umf_ba_alloc(SlabAllocator);
+    if (!Mem) {
+        throw MemoryProviderError{UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY};
+    }
+
+    try {
+        return new (Mem) Slab(*this, SlabSize, Node);
+    } catch (MemoryProviderError &) {
+        umf_ba_free(SlabAllocator, Mem);
+        throw;
+    }
+}
+
+void Bucket::destroySlab(Slab *S) {
+    auto *SlabAllocator = SlabAllocators[slabSizeLevel(S->getSize())];
+
+    if (getSize() <= ChunkCutOff()) {
+        // Demand for the bucket has dropped, the next slabs get smaller
+        CurSlabSize = std::max(CurSlabSize / 2, SlabAllocSize());
+    }
+
+    S->~Slab();
+    umf_ba_free(SlabAllocator, S);
+}
+
+void Bucket::poolSlab(Slab *S) {
+    if (OwnAllocCtx.isDecayEnabled()) {
+        S->setIdle(std::chrono::steady_clock::now());
+    }
+    AvailableSlabs[S->getNode()].pushBack(S);
 }
 
-auto Bucket::getAvailFullSlab(bool &FromPool)
-    -> decltype(AvailableSlabs.begin()) {
+Slab *Bucket::getAvailFullSlab(size_t Node, bool &FromPool) {
+    auto &Available = AvailableSlabs[Node];
+
     // Return a slab that will be used for a single allocation.
-    if (AvailableSlabs.size() == 0) {
-        auto It = AvailableSlabs.insert(AvailableSlabs.begin(),
-                                        std::make_unique<Slab>(*this));
-        (*It)->setIterator(It);
+    if (Available.empty()) {
+        Available.pushFront(createSlab(SlabAllocSize(), Node));
         FromPool = false;
-        updateStats(1, 0);
+        updateStats(1, 0, SlabAllocSize());
     } else {
-        decrementPool(FromPool);
+        // Prefer the most recently pooled slab, which is the least likely to
+        // be purged.
+        decrementPool(FromPool, *Available.back());
     }
 
-    return AvailableSlabs.begin();
+    return Available.back();
 }
 
-void *Bucket::getSlab(bool &FromPool) {
+void *Bucket::getSlab(bool &FromPool, bool &Fresh) {
+    size_t Node = OwnAllocCtx.getCurrentNode();
+
     std::lock_guard<std::mutex> Lg(BucketLock);
+    drainRemoteFrees();
 
-    auto SlabIt = getAvailFullSlab(FromPool);
-    auto *FreeSlab = (*SlabIt)->getSlab();
-    auto It =
-        UnavailableSlabs.insert(UnavailableSlabs.begin(), std::move(*SlabIt));
-    AvailableSlabs.erase(SlabIt);
-    (*It)->setIterator(It);
+    auto *FullSlab = getAvailFullSlab(Node, FromPool);
+    auto *FreeSlab = FullSlab->getSlab(Fresh);
+    AvailableSlabs[Node].remove(FullSlab);
+    UnavailableSlabs.pushFront(FullSlab);
     return FreeSlab;
 }
 
 void Bucket::freeSlab(Slab &Slab, bool &ToPool) {
     std::lock_guard<std::mutex> Lg(BucketLock);
-    auto SlabIter = Slab.getIterator();
-    assert(SlabIter != UnavailableSlabs.end());
-    if (CanPool(ToPool)) {
-        auto It =
-            AvailableSlabs.insert(AvailableSlabs.begin(), std::move(*SlabIter));
-        UnavailableSlabs.erase(SlabIter);
-        (*It)->setIterator(It);
+    UnavailableSlabs.remove(&Slab);
+    if (CanPool(ToPool, Slab)) {
+        poolSlab(&Slab);
     } else {
-        UnavailableSlabs.erase(SlabIter);
+        destroySlab(&Slab);
     }
 }
 
-auto Bucket::getAvailSlab(bool &FromPool) -> decltype(AvailableSlabs.begin()) {
+Slab *Bucket::getAvailSlab(size_t Node, bool &FromPool) {
+    auto &Available = AvailableSlabs[Node];
 
-    if (AvailableSlabs.size() == 0) {
-        auto It = AvailableSlabs.insert(AvailableSlabs.begin(),
-                                        std::make_unique<Slab>(*this));
-        (*It)->setIterator(It);
+    if (Available.empty()) {
+        Available.pushFront(createSlab(CurSlabSize, Node));
 
-        updateStats(1, 0);
+        // Demand for the bucket rises, the next slab gets larger
+        if (CurSlabSize <= SlabMaxSize() / 2) {
+            CurSlabSize *= 2;
+        }
+
+        updateStats(1, 0, Available.front()->getSize());
         FromPool = false;
     } else {
-        if ((*(AvailableSlabs.begin()))->getNumAllocated() == 0) {
+        if (Available.front()->getNumAllocated() == 0) {
+            // There are no partially used slabs, take the most recently
+            // pooled one.
+            auto *PooledSlab = Available.back();
+            Available.remove(PooledSlab);
+            Available.pushFront(PooledSlab);
+
             // If this was an empty slab, it was in the pool.
             // Now it is no longer in the pool, so update count.
-            --chunkedSlabsInPool;
-            decrementPool(FromPool);
+            --chunkedSlabsInPool[Node];
+            decrementPool(FromPool, *PooledSlab);
         } else {
             // Allocation from existing slab is treated as from pool for statistics.
             FromPool = true;
         }
     }
 
-    return AvailableSlabs.begin();
+    return Available.front();
+}
+
+// The lock must be acquired before calling this method
+void *Bucket::getChunkLocked(Slab *&ChunkSlab, size_t Node, bool &FromPool,
+                             bool &Fresh) {
+    ChunkSlab = getAvailSlab(Node, FromPool);
+    auto *FreeChunk = ChunkSlab->getChunk(Fresh);
+
+    // If the slab is full, move it to unavailable slabs
+    if (!ChunkSlab->hasAvail()) {
+        AvailableSlabs[Node].remove(ChunkSlab);
+        UnavailableSlabs.pushFront(ChunkSlab);
+    }
+
+    return FreeChunk;
+}
+
+void *Bucket::getChunk(bool &FromPool, bool &Fresh) {
+    size_t Node = OwnAllocCtx.getCurrentNode();
+
+    std::lock_guard<std::mutex> Lg(BucketLock);
+    drainRemoteFrees();
+
+    Slab *ChunkSlab;
+    return getChunkLocked(ChunkSlab, Node, FromPool, Fresh);
 }
 
-void *Bucket::getChunk(bool &FromPool) {
+size_t Bucket::getChunks(std::vector<CachedChunk> &Chunks, size_t Count,
+                         bool &FromPool) {
+    size_t Node = OwnAllocCtx.getCurrentNode();
+
     std::lock_guard<std::mutex> Lg(BucketLock);
+    drainRemoteFrees();
+
+    size_t NumChunks = 0;
+    for (; NumChunks < Count; NumChunks++) {
+        // Do not allocate new slabs just to fill up the cache
+        if (NumChunks > 0 && AvailableSlabs[Node].empty()) {
+            break;
+        }
+
+        bool ChunkFromPool, Fresh;
+        Slab *ChunkSlab;
+        void *Ptr = getChunkLocked(ChunkSlab, Node, ChunkFromPool, Fresh);
+        if (NumChunks == 0) {
+            FromPool = ChunkFromPool;
+        }
+        Chunks.push_back({Ptr, ChunkSlab});
+    }
 
-    auto SlabIt = getAvailSlab(FromPool);
-    auto *FreeChunk = (*SlabIt)->getChunk();
+    return NumChunks;
+}
+
+size_t Bucket::getChunks(void **Ptrs, size_t Count, bool &FromPool) {
+    size_t Node = OwnAllocCtx.getCurrentNode();
+
+    std::lock_guard<std::mutex> Lg(BucketLock);
+    drainRemoteFrees();
 
-    // If the slab is full, move it to unavailable slabs and update its iterator
-    if (!((*SlabIt)->hasAvail())) {
-        auto It = UnavailableSlabs.insert(UnavailableSlabs.begin(),
-                                          std::move(*SlabIt));
-        AvailableSlabs.erase(SlabIt);
-        (*It)->setIterator(It);
+    size_t NumChunks = 0;
+    try {
+        for (; NumChunks < Count; NumChunks++) {
+            bool ChunkFromPool, Fresh;
+            Slab *ChunkSlab;
+            Ptrs[NumChunks] =
+                getChunkLocked(ChunkSlab, Node, ChunkFromPool, Fresh);
+            if (NumChunks == 0) {
+                FromPool = ChunkFromPool;
+            }
+        }
+    } catch (MemoryProviderError &) {
+        // Return the chunks stored so far, the caller gets the error when
+        // it asks for the rest.
+        if (NumChunks == 0) {
+            throw;
+        }
     }
 
-    return FreeChunk;
+    return NumChunks;
 }
 
 void Bucket::freeChunk(void *Ptr, Slab &Slab, bool &ToPool) {
-    std::lock_guard<std::mutex> Lg(BucketLock);
+    // Rather than wait for the lock, leave the chunk to its holder
+    if (!BucketLock.try_lock()) {
+        if (deferFree(Ptr, Slab)) {
+            ToPool = true;
+
+            // The holder may have drained the queue before the chunk was
+            // pushed, so complete the frees if it has released the lock since
+            if (BucketLock.try_lock()) {
+                std::lock_guard<std::mutex> Lg(BucketLock, std::adopt_lock);
+                drainRemoteFrees();
+            }
+            return;
+        }
+        BucketLock.lock();
+    }
+    std::lock_guard<std::mutex> Lg(BucketLock, std::adopt_lock);
+    drainRemoteFrees();
 
     Slab.freeChunk(Ptr);
 
     onFreeChunk(Slab, ToPool);
 }
 
+void Bucket::freeChunks(const CachedChunk *Chunks, size_t Count) {
+    std::lock_guard<std::mutex> Lg(BucketLock);
+    drainRemoteFrees();
+
+    for (size_t i = 0; i < Count; i++) {
+        bool ToPool;
+        Chunks[i].ChunkSlab->freeChunk(Chunks[i].Ptr);
+        onFreeChunk(*Chunks[i].ChunkSlab, ToPool);
+    }
+}
+
 // The lock must be acquired before calling this method
 void Bucket::onFreeChunk(Slab &Slab, bool &ToPool) {
     ToPool = true;
 
+    // Chunks are returned to the slab's node, whichever thread frees them
+    auto &Available = AvailableSlabs[Slab.getNode()];
+
     // In case if the slab was previously full and now has 1 available
     // chunk, it should be moved to the list of available slabs
     if (Slab.getNumAllocated() == (Slab.getNumChunks() - 1)) {
-        auto SlabIter = Slab.getIterator();
-        assert(SlabIter != UnavailableSlabs.end());
-
-        auto It =
-            AvailableSlabs.insert(AvailableSlabs.begin(), std::move(*SlabIter));
-        UnavailableSlabs.erase(SlabIter);
-
-        (*It)->setIterator(It);
+        UnavailableSlabs.remove(&Slab);
+        Available.pushFront(&Slab);
     }
 
     // Check if slab is empty, and pool it if we can.
@@ -679,29 +1714,79 @@ void Bucket::onFreeChunk(Slab &Slab, bool &ToPool) {
         // If pool has capacity then put the slab in the pool.
         // The ToPool parameter indicates whether the Slab will be put in the
         // pool or freed.
-        if (!CanPool(ToPool)) {
-            // Note: since the slab is stored as unique_ptr, just remove it from
-            // the list to destroy the object.
-            auto It = Slab.getIterator();
-            assert(It != AvailableSlabs.end());
-            AvailableSlabs.erase(It);
+        Available.remove(&Slab);
+        if (CanPool(ToPool, Slab)) {
+            poolSlab(&Slab);
+        } else {
+            destroySlab(&Slab);
+        }
+    }
+}
+
+bool Bucket::deferFree(void *Ptr, Slab &Slab) {
+    size_t QueueSize = OwnAllocCtx.getParams().RemoteFreeQueueSize;
+    if (!QueueSize) {
+        return false;
+    }
+
+    auto *Queue = RemoteFrees.load(std::memory_order_acquire);
+    if (!Queue) {
+        size_t Capacity = 1;
+        while (Capacity < QueueSize) {
+            Capacity *= 2;
+        }
+
+        RemoteFreeQueue *NewQueue;
+        try {
+            NewQueue = new RemoteFreeQueue(Capacity);
+        } catch (std::bad_alloc &) {
+            return false;
+        }
+
+        if (RemoteFrees.compare_exchange_strong(Queue, NewQueue,
+                                                std::memory_order_acq_rel)) {
+            Queue = NewQueue;
+        } else {
+            // Another thread has created the queue in the meantime
+            delete NewQueue;
         }
     }
+
+    return Queue->push({Ptr, &Slab});
+}
+
+// The lock must be acquired before calling this method
+void Bucket::drainRemoteFrees() {
+    auto *Queue = RemoteFrees.load(std::memory_order_acquire);
+    if (!Queue) {
+        return;
+    }
+
+    CachedChunk Chunk;
+    while (Queue->pop(Chunk)) {
+        bool ToPool;
+        Chunk.ChunkSlab->freeChunk(Chunk.Ptr);
+        onFreeChunk(*Chunk.ChunkSlab, ToPool);
+    }
 }
 
-bool Bucket::CanPool(bool &ToPool) {
+bool Bucket::CanPool(bool &ToPool, Slab &Slab) {
+    size_t SlabSize = Slab.getSize();
+    size_t Node = Slab.getNode();
+
+    // The capacity applies to each NUMA node separately.
     size_t NewFreeSlabsInBucket;
     // Check if this bucket is used in chunked form or as full slabs.
     bool chunkedBucket = getSize() <= ChunkCutOff();
     if (chunkedBucket) {
-        NewFreeSlabsInBucket = chunkedSlabsInPool + 1;
+        NewFreeSlabsInBucket = chunkedSlabsInPool[Node] + 1;
     } else {
-        NewFreeSlabsInBucket = AvailableSlabs.size() + 1;
+        NewFreeSlabsInBucket = AvailableSlabs[Node].size() + 1;
     }
-    if (Capacity() >= NewFreeSlabsInBucket) {
+    if (Capacity() >= NewFreeSlabsInBucket && !OwnAllocCtx.isOverSoftLimit()) {
         size_t PoolSize = OwnAllocCtx.getLimits()->TotalSize;
         while (true) {
-            size_t NewPoolSize = PoolSize + SlabAllocSize();
+            size_t NewPoolSize = PoolSize + SlabSize;
 
             if (OwnAllocCtx.getLimits()->MaxSize < NewPoolSize) {
                 break;
@@ -710,29 +1795,43 @@ bool Bucket::CanPool(bool &ToPool) {
             if (OwnAllocCtx.getLimits()->TotalSize.compare_exchange_strong(
                     PoolSize, NewPoolSize)) {
                 if (chunkedBucket) {
-                    ++chunkedSlabsInPool;
+                    ++chunkedSlabsInPool[Node];
                 }
 
-                updateStats(-1, 1);
+                updateStats(-1, 1, SlabSize);
                 ToPool = true;
                 return true;
             }
         }
     }
 
-    updateStats(-1, 0);
+    updateStats(-1, 0, SlabSize);
     ToPool = false;
     return false;
 }
 
-umf_memory_provider_handle_t Bucket::getMemHandle() {
-    return OwnAllocCtx.getMemHandle();
+umf_memory_provider_handle_t Bucket::getMemHandle(size_t Node) {
+    return OwnAllocCtx.getMemHandle(Node);
 }
 
 size_t Bucket::SlabMinSize() { return OwnAllocCtx.getParams().SlabMinSize; }
 
 size_t Bucket::SlabAllocSize() { return std::max(getSize(), SlabMinSize()); }
 
+size_t Bucket::SlabMaxSize() {
+    // Slabs used as a whole are not resized
+    if (getSize() > ChunkCutOff()) {
+        return SlabAllocSize();
+    }
+
+    // The largest power of 2 multiple of SlabAllocSize() within the limit
+    size_t MaxSize = SlabAllocSize();
+    while (MaxSize <= OwnAllocCtx.getParams().SlabMaxSize / 2) {
+        MaxSize *= 2;
+    }
+    return MaxSize;
+}
+
 size_t Bucket::Capacity() {
     // For buckets used in chunked mode, just one slab in pool is sufficient.
     // For larger buckets, the capacity could be more and is adjustable.
@@ -758,7 +1857,7 @@ void Bucket::countAlloc(bool FromPool) {
 
 void Bucket::countFree() { ++freeCount; }
 
-void Bucket::updateStats(int InUse, int InPool) {
+void Bucket::updateStats(int InUse, int InPool, size_t SlabSize) {
     if (OwnAllocCtx.getParams().PoolTrace == 0) {
         return;
     }
@@ -768,7 +1867,7 @@ void Bucket::updateStats(int InUse, int InPool) {
     maxSlabsInPool = std::max(currSlabsInPool, maxSlabsInPool);
     // Increment or decrement current pool sizes based on whether
     // slab was added to or removed from pool.
-    OwnAllocCtx.getParams().CurPoolSize += InPool * SlabAllocSize();
+    OwnAllocCtx.getParams().CurPoolSize += InPool * SlabSize;
 }
 
 void Bucket::printStats(bool &TitlePrinted, const std::string &Label) {
@@ -789,6 +1888,70 @@ void Bucket::printStats(bool &TitlePrinted, const std::string &Label) {
     }
 }
 
+void Bucket::decay(std::chrono::steady_clock::time_point Now) {
+    std::lock_guard<std::mutex> Lg(BucketLock);
+    drainRemoteFrees();
+
+    auto &Params = OwnAllocCtx.getParams();
+    auto PurgeDelay = std::chrono::milliseconds(Params.PurgeDelayMs);
+    auto ReleaseDelay = std::chrono::milliseconds(Params.ReleaseDelayMs);
+
+    for (size_t Node = 0; Node < AvailableSlabs.size(); Node++) {
+        auto &Available = AvailableSlabs[Node];
+
+        // Empty slabs kept in the pool are at the back of the available list
+        Slab *S = Available.back();
+        while (S && S->getNumAllocated() == 0) {
+            Slab *Prev = S->getPrev();
+            auto IdleTime = Now - S->getIdleSince();
+
+            if (Params.ReleaseDelayMs && IdleTime >= ReleaseDelay) {
+                releaseSlab(Node, S);
+            } else if (Params.PurgeDelayMs && !S->isPurged() &&
+                       IdleTime >= PurgeDelay) {
+                // The slab is kept in the pool even if the provider does not
+                // support purging.
+                S->setPurged();
+                if (umfMemoryProviderPurgeLazy(getMemHandle(Node),
+                                               S->getPtr(), S->getSize()) ==
+                    UMF_RESULT_SUCCESS) {
+                    OwnAllocCtx.countPurged(S->getSize());
+                }
+            }
+
+            S = Prev;
+        }
+    }
+}
+
+void Bucket::trim(bool Wait) {
+    std::unique_lock<std::mutex> Lk(BucketLock, std::defer_lock);
+    if (Wait) {
+        Lk.lock();
+    } else if (!Lk.try_lock()) {
+        return;
+    }
+    drainRemoteFrees();
+
+    for (size_t Node = 0; Node < AvailableSlabs.size(); Node++) {
+        auto &Available = AvailableSlabs[Node];
+        while (!Available.empty() && Available.back()->getNumAllocated() == 0) {
+            releaseSlab(Node, Available.back());
+        }
+    }
+}
+
+void Bucket::releaseSlab(size_t Node, Slab *S) {
+    AvailableSlabs[Node].remove(S);
+    if (getSize() <= ChunkCutOff()) {
+        --chunkedSlabsInPool[Node];
+    }
+    updateStats(0, -1, S->getSize());
+    OwnAllocCtx.getLimits()->TotalSize -= S->getSize();
+    OwnAllocCtx.countReleased(S->getSize());
+    destroySlab(S);
+}
+
 void *DisjointPool::AllocImpl::allocate(size_t Size, bool &FromPool) try {
     void *Ptr;
 
@@ -796,17 +1959,22 @@ void *DisjointPool::AllocImpl::allocate(size_t Size, bool &FromPool) try {
         return nullptr;
     }
 
+    tickDecay();
+    trimIfRequested();
+
     FromPool = false;
     if (Size > getParams().MaxPoolableSize) {
-        return memoryProviderAlloc(getMemHandle(), Size);
+        bool Fresh;
+        return allocateLarge(Size, 0, Fresh);
     }
 
     auto &Bucket = findBucket(Size);
 
-    if (Size > Bucket.ChunkCutOff()) {
-        Ptr = Bucket.getSlab(FromPool);
+    if (Bucket.getSize() > Bucket.ChunkCutOff()) {
+        bool Fresh;
+        Ptr = Bucket.getSlab(FromPool, Fresh);
     } else {
-        Ptr = Bucket.getChunk(FromPool);
+        Ptr = getChunk(Bucket, FromPool);
     }
 
     if (getParams().PoolTrace > 1) {
@@ -831,32 +1999,37 @@ void *DisjointPool::AllocImpl::allocate(size_t Size, size_t Alignment,
         return allocate(Size, FromPool);
     }
 
-    size_t AlignedSize;
-    if (Alignment <= ProviderMinPageSize) {
-        // This allocation will be served from a Bucket which size is multiple
-        // of Alignment and Slab address is aligned to ProviderMinPageSize
-        // so the address will be properly aligned.
-        AlignedSize = (Size > 1) ? AlignUp(Size, Alignment) : Alignment;
-    } else {
-        // Slabs are only aligned to ProviderMinPageSize, we need to compensate
-        // for that in case the allocation is within pooling limit.
-        // TODO: consider creating properly-aligned Slabs on demand
-        AlignedSize = Size + Alignment - 1;
-    }
+    tickDecay();
+    trimIfRequested();
+
+    // This allocation will be served from a Bucket which size is multiple
+    // of Alignment and Slab address is aligned at least to Alignment
+    // so the address will be properly aligned.
+    size_t AlignedSize = (Size > 1) ? AlignUp(Size, Alignment) : Alignment;
 
     // Check if requested allocation size is within pooling limit.
     // If not, just request aligned pointer from the system.
     FromPool = false;
     if (AlignedSize > getParams().MaxPoolableSize) {
-        return memoryProviderAlloc(getMemHandle(), Size, Alignment);
+        bool Fresh;
+        return allocateLarge(Size, Alignment, Fresh);
     }
 
-    auto &Bucket = findBucket(AlignedSize);
+    // Slabs of the regular buckets are only aligned to ProviderMinPageSize,
+    // larger alignments are served from buckets with aligned slabs. The
+    // same applies to size classes which are not multiples of Alignment.
+    auto *FoundBucket = &findBucket(AlignedSize);
+    if (Alignment > ProviderMinPageSize ||
+        FoundBucket->getSize() % Alignment) {
+        FoundBucket = &findAlignedBucket(AlignedSize, Alignment);
+    }
+    auto &Bucket = *FoundBucket;
 
-    if (AlignedSize > Bucket.ChunkCutOff()) {
-        Ptr = Bucket.getSlab(FromPool);
+    if (Bucket.getSize() > Bucket.ChunkCutOff()) {
+        bool Fresh;
+        Ptr = Bucket.getSlab(FromPool, Fresh);
     } else {
-        Ptr = Bucket.getChunk(FromPool);
+        Ptr = getChunk(Bucket, FromPool);
     }
 
     if (getParams().PoolTrace > 1) {
@@ -869,172 +2042,1064 @@ void *DisjointPool::AllocImpl::allocate(size_t Size, size_t Alignment,
     return nullptr;
 }
 
-std::size_t DisjointPool::AllocImpl::sizeToIdx(size_t Size) {
-    assert(Size <= CutOff && "Unexpected size");
-    assert(Size > 0 && "Unexpected size");
+void *DisjointPool::AllocImpl::allocateZeroed(size_t Size,
+                                              bool &FromPool) try {
+    void *Ptr;
+    bool Fresh;
 
-    size_t MinBucketSize = (size_t)1 << MinBucketSizeExp;
-    if (Size < MinBucketSize) {
-        return 0;
+    if (Size == 0) {
+        return nullptr;
     }
 
-    // Get the position of the leftmost set bit.
-    size_t position = getLeftmostSetBitPos(Size);
+    tickDecay();
+    trimIfRequested();
 
-    auto isPowerOf2 = 0 == (Size & (Size - 1));
-    auto largerThanHalfwayBetweenPowersOf2 =
-        !isPowerOf2 & bool((Size - 1) & (uint64_t(1) << (position - 1)));
-    auto index = (position - MinBucketSizeExp) * 2 + !isPowerOf2 +
-                 largerThanHalfwayBetweenPowersOf2;
+    FromPool = false;
+    if (Size > getParams().MaxPoolableSize) {
+        Ptr = allocateLarge(Size, 0, Fresh);
+    } else {
+        auto &Bucket = findBucket(Size);
 
-    return index;
-}
+        // The per-thread caches are bypassed, since they do not keep track
+        // of which chunks are fresh.
+        if (Bucket.getSize() > Bucket.ChunkCutOff()) {
+            Ptr = Bucket.getSlab(FromPool, Fresh);
+        } else {
+            Ptr = Bucket.getChunk(FromPool, Fresh);
+        }
 
-Bucket &DisjointPool::AllocImpl::findBucket(size_t Size) {
-    auto calculatedIdx = sizeToIdx(Size);
-    assert(calculatedIdx >= 0);
-    assert((*(Buckets[calculatedIdx])).getSize() >= Size);
-    if (calculatedIdx > 0) {
-        assert((*(Buckets[calculatedIdx - 1])).getSize() < Size);
+        if (getParams().PoolTrace > 1) {
+            Bucket.countAlloc(FromPool);
+        }
     }
 
-    return *(Buckets[calculatedIdx]);
+    if (!Fresh || !getParams().ProviderMemoryZeroed) {
+        memset(Ptr, 0, Size);
+    }
+
+    return Ptr;
+} catch (MemoryProviderError &e) {
+    umf::getPoolLastStatusRef<DisjointPool>() = e.code;
+    return nullptr;
 }
 
-void DisjointPool::AllocImpl::deallocate(void *Ptr, bool &ToPool) {
-    auto *SlabPtr = AlignPtrDown(Ptr, SlabMinSize());
+void *DisjointPool::AllocImpl::allocateLarge(size_t Size, size_t Alignment,
+                                             bool &Fresh) {
+    size_t RegionSize = Size;
+    void *Ptr = nullptr;
+    if (params.LargeCacheSize) {
+        Ptr = LargeRegions.get(Size, Alignment, RegionSize);
+    }
 
-    // Lock the map on read
-    std::shared_lock<std::shared_timed_mutex> Lk(getKnownSlabsMapLock());
+    Fresh = !Ptr;
+    if (!Ptr) {
+        chargeLimits(Size);
+        try {
+            Ptr = memoryProviderAlloc(getMemHandle(), Size, Alignment);
+        } catch (MemoryProviderError &) {
+            unchargeLimits(Size);
+            throw;
+        }
+    }
 
-    ToPool = false;
-    auto Slabs = getKnownSlabs().equal_range(SlabPtr);
-    if (Slabs.first == Slabs.second) {
-        Lk.unlock();
-        memoryProviderFree(getMemHandle(), Ptr);
-        return;
+    if (critnib_insert(LargeAllocs, reinterpret_cast<uintptr_t>(Ptr),
+                       reinterpret_cast<void *>(RegionSize), 0) != 0) {
+        umfMemoryProviderFree(getMemHandle(), Ptr, RegionSize);
+        unchargeLimits(RegionSize);
+        throw MemoryProviderError{UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY};
     }
 
-    for (auto It = Slabs.first; It != Slabs.second; ++It) {
-        // The slab object won't be deleted until it's removed from the map which is
-        // protected by the lock, so it's safe to access it here.
-        auto &Slab = It->second;
-        if (Ptr >= Slab.getPtr() && Ptr < Slab.getEnd()) {
-            // Unlock the map before freeing the chunk, it may be locked on write
-            // there
-            Lk.unlock();
-            auto &Bucket = Slab.getBucket();
+    return Ptr;
+}
 
-            if (getParams().PoolTrace > 1) {
-                Bucket.countFree();
-            }
+void DisjointPool::AllocImpl::deallocateLarge(void *Ptr) {
+    auto Addr = reinterpret_cast<uintptr_t>(Ptr);
 
-            if (Bucket.getSize() <= Bucket.ChunkCutOff()) {
-                Bucket.freeChunk(Ptr, Slab, ToPool);
-            } else {
-                Bucket.freeSlab(Slab, ToPool);
-            }
+    // Remove the entry before freeing the memory, otherwise another thread
+    // could get the same address from the provider and fail to record it.
+    auto Size = reinterpret_cast<size_t>(critnib_remove(LargeAllocs, Addr));
 
-            return;
-        }
+    if (Size && params.LargeCacheSize && LargeRegions.put(Ptr, Size)) {
+        return;
     }
 
-    Lk.unlock();
-    // There is a rare case when we have a pointer from system allocation next
-    // to some slab with an entry in the map. So we find a slab
-    // but the range checks fail.
-    memoryProviderFree(getMemHandle(), Ptr);
-}
-
-void DisjointPool::AllocImpl::printStats(bool &TitlePrinted,
-                                         size_t &HighBucketSize,
-                                         size_t &HighPeakSlabsInUse,
-                                         const std::string &MTName) {
-    HighBucketSize = 0;
-    HighPeakSlabsInUse = 0;
-    for (auto &B : Buckets) {
-        (*B).printStats(TitlePrinted, MTName);
-        HighPeakSlabsInUse = std::max((*B).maxSlabsInUse, HighPeakSlabsInUse);
-        if ((*B).allocCount) {
-            HighBucketSize = std::max((*B).SlabAllocSize(), HighBucketSize);
+    try {
+        memoryProviderFree(getMemHandle(), Ptr, Size);
+    } catch (MemoryProviderError &) {
+        // The memory is still allocated, so keep its size
+        if (Size) {
+            critnib_insert(LargeAllocs, Addr, reinterpret_cast<void *>(Size),
+                           0);
         }
+        throw;
     }
+    unchargeLimits(Size);
 }
 
-umf_result_t DisjointPool::initialize(umf_memory_provider_handle_t provider,
-                                      umf_disjoint_pool_params_t *parameters) {
-    if (!provider) {
-        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
-    }
-    // MinBucketSize parameter must be a power of 2 for bucket sizes
-    // to generate correctly.
-    if (!parameters->MinBucketSize ||
-        !((parameters->MinBucketSize & (parameters->MinBucketSize - 1)) == 0)) {
-        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+std::size_t DisjointPool::AllocImpl::sizeToIdx(size_t Size) {
+    assert(Size <= Buckets.back()->getSize() && "Unexpected size");
+    assert(Size > 0 && "Unexpected size");
+
+    // The entry points to the first bucket which may fit the size, the next
+    // ones are checked only if there are several buckets in the sub-range.
+    size_t Idx = SizeClassLut[sizeClassKey(Size)];
+    while (Buckets[Idx]->getSize() < Size) {
+        Idx++;
     }
 
-    impl = std::make_unique<AllocImpl>(provider, parameters);
-    return UMF_RESULT_SUCCESS;
+    return Idx;
 }
 
-void *DisjointPool::malloc(size_t size) { // For full-slab allocations indicates
-                                          // whether slab is from Pool.
-    bool FromPool;
-    auto Ptr = impl->allocate(size, FromPool);
-
-    if (impl->getParams().PoolTrace > 2) {
-        auto MT = impl->getParams().Name;
-        std::cout << "Allocated " << std::setw(8) << size << " " << MT
-                  << " bytes from " << (FromPool ? "Pool" : "Provider") << " ->"
-                  << Ptr << std::endl;
+Bucket &DisjointPool::AllocImpl::findBucket(size_t Size) {
+    auto calculatedIdx = sizeToIdx(Size);
+    assert(calculatedIdx >= 0);
+    assert((*(Buckets[calculatedIdx])).getSize() >= Size);
+    if (calculatedIdx > 0) {
+        assert((*(Buckets[calculatedIdx - 1])).getSize() < Size);
     }
-    return Ptr;
-}
 
-void *DisjointPool::calloc(size_t, size_t) {
-    // Not supported
-    umf::getPoolLastStatusRef<DisjointPool>() = UMF_RESULT_ERROR_NOT_SUPPORTED;
-    return NULL;
+    return *(Buckets[calculatedIdx]);
 }
 
-void *DisjointPool::realloc(void *, size_t) {
-    // Not supported
-    umf::getPoolLastStatusRef<DisjointPool>() = UMF_RESULT_ERROR_NOT_SUPPORTED;
-    return NULL;
+Bucket &DisjointPool::AllocImpl::findAlignedBucket(size_t Size,
+                                                   size_t Alignment) {
+    auto AlignmentExp = log2Utils(Alignment);
+    auto &AlignedSet = AlignedBuckets[AlignmentExp];
+
+    std::call_once(AlignedBucketsOnce[AlignmentExp], [&] {
+        // Generate buckets sized such as: A, 2A, 3A, 4A, 6A, 8A, ..., i.e.
+        // multiples of Alignment that are powers of 2 and the values halfway
+        // between them, up to the first one reaching MaxPoolableSize.
+        AlignedSet.push_back(
+            std::make_unique<Bucket>(Alignment, *this, Alignment));
+        for (size_t Size1 = 2 * Alignment;
+             AlignedSet.back()->getSize() < params.MaxPoolableSize;
+             Size1 *= 2) {
+            AlignedSet.push_back(
+                std::make_unique<Bucket>(Size1, *this, Alignment));
+            if (Size1 < params.MaxPoolableSize) {
+                AlignedSet.push_back(std::make_unique<Bucket>(
+                    Size1 + Size1 / 2, *this, Alignment));
+            }
+        }
+        AlignedBucketsReady[AlignmentExp].store(true,
+                                                std::memory_order_release);
+    });
+
+    auto It = std::lower_bound(
+        AlignedSet.begin(), AlignedSet.end(), Size,
+        [](const std::unique_ptr<Bucket> &B, size_t Sz) {
+            return B->getSize() < Sz;
+        });
+    assert(It != AlignedSet.end());
+    assert((*It)->getSize() % Alignment == 0);
+
+    return **It;
 }
 
-void *DisjointPool::aligned_malloc(size_t size, size_t alignment) {
-    bool FromPool;
-    auto Ptr = impl->allocate(size, alignment, FromPool);
+Slab *DisjointPool::AllocImpl::findSlab(void *Ptr) {
+    auto Addr = reinterpret_cast<uintptr_t>(Ptr);
+    uintptr_t Key;
+    void *Value;
 
-    if (impl->getParams().PoolTrace > 2) {
-        auto MT = impl->getParams().Name;
-        std::cout << "Allocated " << std::setw(8) << size << " " << MT
-                  << " bytes aligned at " << alignment << " from "
-                  << (FromPool ? "Pool" : "Provider") << " ->" << Ptr
-                  << std::endl;
+    if (!critnib_find(KnownSlabs, Addr, FIND_LE, &Key, &Value) ||
+        ((reinterpret_cast<uintptr_t>(Value) & SlabEndTag) && Key != Addr)) {
+        return nullptr;
     }
-    return Ptr;
-}
 
-size_t DisjointPool::malloc_usable_size(void *) {
-    // Not supported
-    return 0;
+    // The slab object won't be deleted until all its chunks are freed, so
+    // it's safe to access it for a pointer to an allocated chunk.
+    auto *FoundSlab = reinterpret_cast<Slab *>(
+        reinterpret_cast<uintptr_t>(Value) & ~SlabEndTag);
+    assert(Ptr >= FoundSlab->getPtr() && Ptr < FoundSlab->getEnd());
+    return FoundSlab;
 }
 
-umf_result_t DisjointPool::free(void *ptr) try {
-    bool ToPool;
-    impl->deallocate(ptr, ToPool);
+void DisjointPool::AllocImpl::deallocate(void *Ptr, bool &ToPool) {
+    ToPool = false;
 
-    if (impl->getParams().PoolTrace > 2) {
-        auto MT = impl->getParams().Name;
-        std::cout << "Freed " << MT << " " << ptr << " to "
-                  << (ToPool ? "Pool" : "Provider")
-                  << ", Current total pool size "
-                  << impl->getLimits()->TotalSize.load()
-                  << ", Current pool size for " << MT << " "
-                  << impl->getParams().CurPoolSize << "\n";
-    }
+    tickDecay();
+
+    auto *FoundSlab = findSlab(Ptr);
+    if (!FoundSlab) {
+        // The pointer is not within any slab, it comes from a direct
+        // allocation from the memory provider.
+        deallocateLarge(Ptr);
+        return;
+    }
+
+    auto &Slab = *FoundSlab;
+    auto &Bucket = Slab.getBucket();
+
+    if (getParams().PoolTrace > 1) {
+        Bucket.countFree();
+    }
+
+    if (Bucket.getSize() <= Bucket.ChunkCutOff()) {
+        freeChunk(Ptr, Slab, ToPool);
+    } else {
+        Bucket.freeSlab(Slab, ToPool);
+    }
+}
+
+void DisjointPool::AllocImpl::deallocate(void *Ptr, size_t Size,
+                                         bool &ToPool) {
+    // Only allocations larger than MaxPoolableSize are served directly by the
+    // memory provider, and they are never resized in place below it.
+    if (Size <= getParams().MaxPoolableSize) {
+        deallocate(Ptr, ToPool);
+        return;
+    }
+
+    ToPool = false;
+
+    tickDecay();
+
+    deallocateLarge(Ptr);
+}
+
+size_t DisjointPool::AllocImpl::allocateBatch(size_t Size, size_t Num,
+                                              void **Ptrs) {
+    if (Size == 0) {
+        return 0;
+    }
+
+    tickDecay();
+    trimIfRequested();
+
+    size_t NumAllocated = 0;
+    try {
+        if (Size > getParams().MaxPoolableSize) {
+            for (; NumAllocated < Num; NumAllocated++) {
+                bool Fresh;
+                Ptrs[NumAllocated] = allocateLarge(Size, 0, Fresh);
+            }
+            return NumAllocated;
+        }
+
+        auto &Bucket = findBucket(Size);
+        bool FromPool;
+
+        if (Bucket.getSize() > Bucket.ChunkCutOff()) {
+            for (; NumAllocated < Num; NumAllocated++) {
+                bool Fresh;
+                Ptrs[NumAllocated] = Bucket.getSlab(FromPool, Fresh);
+                if (getParams().PoolTrace > 1) {
+                    Bucket.countAlloc(FromPool);
+                }
+            }
+            return NumAllocated;
+        }
+
+        ThreadCache *Cache = isCacheable(Bucket) ? getThreadCache() : nullptr;
+        if (Cache) {
+            auto &Magazine = Cache->Magazines[sizeToIdx(Bucket.getSize())];
+            while (NumAllocated < Num && !Magazine.empty()) {
+                Ptrs[NumAllocated++] = Magazine.back().Ptr;
+                Magazine.pop_back();
+                if (getParams().PoolTrace > 1) {
+                    Bucket.countAlloc(true);
+                }
+            }
+        }
+
+        while (NumAllocated < Num) {
+            size_t NumChunks = Bucket.getChunks(
+                Ptrs + NumAllocated, Num - NumAllocated, FromPool);
+            if (getParams().PoolTrace > 1) {
+                for (size_t i = 0; i < NumChunks; i++) {
+                    Bucket.countAlloc(FromPool);
+                }
+            }
+            NumAllocated += NumChunks;
+        }
+    } catch (MemoryProviderError &e) {
+        umf::getPoolLastStatusRef<DisjointPool>() = e.code;
+    }
+
+    return NumAllocated;
+}
+
+umf_result_t DisjointPool::AllocImpl::deallocateBatch(void **Ptrs,
+                                                      size_t Num) {
+    umf_result_t Ret = UMF_RESULT_SUCCESS;
+
+    tickDecay();
+
+    // Chunks are freed directly to their buckets, bypassing the thread cache,
+    // in runs of consecutive chunks of the same bucket.
+    static constexpr size_t MaxRunLength = 64;
+    CachedChunk Run[MaxRunLength];
+    size_t RunLength = 0;
+    Bucket *RunBucket = nullptr;
+
+    for (size_t i = 0; i < Num; i++) {
+        if (!Ptrs[i]) {
+            continue;
+        }
+
+        auto *FoundSlab = findSlab(Ptrs[i]);
+        if (!FoundSlab) {
+            try {
+                deallocateLarge(Ptrs[i]);
+            } catch (MemoryProviderError &e) {
+                if (Ret == UMF_RESULT_SUCCESS) {
+                    Ret = e.code;
+                }
+            }
+            continue;
+        }
+
+        auto &Bucket = FoundSlab->getBucket();
+
+        if (getParams().PoolTrace > 1) {
+            Bucket.countFree();
+        }
+
+        if (Bucket.getSize() > Bucket.ChunkCutOff()) {
+            bool ToPool;
+            Bucket.freeSlab(*FoundSlab, ToPool);
+            continue;
+        }
+
+        if (&Bucket != RunBucket || RunLength == MaxRunLength) {
+            if (RunLength) {
+                RunBucket->freeChunks(Run, RunLength);
+            }
+            RunBucket = &Bucket;
+            RunLength = 0;
+        }
+        // The pointer might have been aligned up within the chunk
+        Run[RunLength++] = {FoundSlab->getChunkStart(Ptrs[i]), FoundSlab};
+    }
+
+    if (RunLength) {
+        RunBucket->freeChunks(Run, RunLength);
+    }
+
+    return Ret;
+}
+
+// Number of allocations and frees done by a thread between checks whether
+// lazy decay is due. The first operation of each thread checks as well, so
+// that threads doing fewer operations still check once.
+static constexpr size_t DecayTickPeriod = 256;
+
+static thread_local size_t TLDecayTicks = 0;
+
+void DisjointPool::AllocImpl::tickDecay() {
+    if (!isDecayEnabled() || DecayThread.joinable() ||
+        TLDecayTicks++ % DecayTickPeriod) {
+        return;
+    }
+
+    auto Now = std::chrono::steady_clock::now().time_since_epoch().count();
+    auto Next = NextDecayTime.load(std::memory_order_relaxed);
+    if (Now < Next ||
+        !NextDecayTime.compare_exchange_strong(Next,
+                                               Now + DecayInterval.count())) {
+        // Not yet, or another thread is about to decay
+        return;
+    }
+
+    decay();
+}
+
+void DisjointPool::AllocImpl::decay() {
+    auto Now = std::chrono::steady_clock::now();
+
+    for (auto &B : Buckets) {
+        B->decay(Now);
+    }
+    for (size_t i = 0; i < MaxAlignmentExp; i++) {
+        if (AlignedBucketsReady[i].load(std::memory_order_acquire)) {
+            for (auto &B : AlignedBuckets[i]) {
+                B->decay(Now);
+            }
+        }
+    }
+
+    if (params.LargeCacheSize && params.ReleaseDelayMs) {
+        LargeRegions.decay(Now,
+                           std::chrono::milliseconds(params.ReleaseDelayMs));
+    }
+}
+
+void DisjointPool::AllocImpl::chargeLimits(size_t Size,
+                                           Bucket *LockedBucket) {
+    auto *Exceeded = tryChargeLimits(getLimits(), Size);
+    if (!Exceeded) {
+        return;
+    }
+
+    // The memory cached below the limit may be enough to fit the charge.
+    // The lock of LockedBucket is held here and must not be taken again, the
+    // other buckets are skipped if they are locked by other threads.
+    trimLimits(Exceeded, false, LockedBucket);
+    if (tryChargeLimits(getLimits(), Size)) {
+        throw MemoryProviderError{UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY};
+    }
+}
+
+umf_disjoint_pool_shared_limits_t *DisjointPool::AllocImpl::tryChargeLimits(
+    umf_disjoint_pool_shared_limits_t *Limits, size_t Size) {
+    if (!Limits) {
+        return nullptr;
+    }
+
+    size_t Used = Limits->UsedSize.load();
+    do {
+        if (Limits->HardLimit && Used + Size > Limits->HardLimit) {
+            return Limits;
+        }
+    } while (!Limits->UsedSize.compare_exchange_weak(Used, Used + Size));
+
+    if (auto *Exceeded = tryChargeLimits(Limits->Parent, Size)) {
+        Limits->UsedSize -= Size;
+        return Exceeded;
+    }
+
+    // A trim is requested only once all the limits accepted the charge
+    if (Limits->SoftLimit && Used <= Limits->SoftLimit &&
+        Used + Size > Limits->SoftLimit) {
+        Limits->TrimRequested = true;
+    }
+    return nullptr;
+}
+
+void DisjointPool::AllocImpl::unchargeLimits(size_t Size) {
+    for (auto *L = getLimits(); L; L = L->Parent) {
+        L->UsedSize -= Size;
+    }
+}
+
+bool DisjointPool::AllocImpl::isOverSoftLimit() {
+    for (auto *L = getLimits(); L; L = L->Parent) {
+        if (L->SoftLimit && L->UsedSize > L->SoftLimit) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void DisjointPool::AllocImpl::trim(bool Wait, Bucket *SkipBucket) {
+    for (auto &B : Buckets) {
+        if (B.get() != SkipBucket) {
+            B->trim(Wait);
+        }
+    }
+    for (size_t i = 0; i < MaxAlignmentExp; i++) {
+        if (AlignedBucketsReady[i].load(std::memory_order_acquire)) {
+            for (auto &B : AlignedBuckets[i]) {
+                if (B.get() != SkipBucket) {
+                    B->trim(Wait);
+                }
+            }
+        }
+    }
+
+    LargeRegions.clear();
+}
+
+void DisjointPool::AllocImpl::trimIfRequested() {
+    for (auto *L = getLimits(); L; L = L->Parent) {
+        if (L->TrimRequested.load(std::memory_order_relaxed) &&
+            L->TrimRequested.exchange(false)) {
+            trimLimits(L, true);
+        }
+    }
+}
+
+void DisjointPool::AllocImpl::trimLimits(
+    umf_disjoint_pool_shared_limits_t *Limits, bool Wait, Bucket *SkipBucket) {
+    std::unique_lock<std::mutex> Lk(Limits->Lock, std::defer_lock);
+    if (Wait) {
+        Lk.lock();
+    } else if (!Lk.try_lock()) {
+        return;
+    }
+
+    for (auto *Pool : Limits->Pools) {
+        Pool->trim(Wait, SkipBucket);
+    }
+    for (auto *Child : Limits->Children) {
+        trimLimits(Child, Wait, SkipBucket);
+    }
+}
+
+void DisjointPool::AllocImpl::decayThreadMain() {
+    std::unique_lock<std::mutex> Lk(DecayLock);
+    while (!DecayCv.wait_for(Lk, DecayInterval, [this] { return DecayStop; })) {
+        Lk.unlock();
+        decay();
+        Lk.lock();
+    }
+}
+
+LargeCache::~LargeCache() {
+    clear();
+    if (EntryAllocator) {
+        umf_ba_destroy(EntryAllocator);
+    }
+}
+
+void LargeCache::unlink(Entry *E) {
+    auto &List = SizeClassLists[log2Utils(E->Size)];
+    if (E->Prev) {
+        E->Prev->Next = E->Next;
+    } else {
+        List = E->Next;
+    }
+    if (E->Next) {
+        E->Next->Prev = E->Prev;
+    }
+
+    if (E->LruPrev) {
+        E->LruPrev->LruNext = E->LruNext;
+    } else {
+        LruHead = E->LruNext;
+    }
+    if (E->LruNext) {
+        E->LruNext->LruPrev = E->LruPrev;
+    } else {
+        LruTail = E->LruPrev;
+    }
+
+    CachedBytes -= E->Size;
+    OwnAllocCtx.getLimits()->TotalSize -= E->Size;
+}
+
+void LargeCache::remove(Entry *E) {
+    unlink(E);
+    umf_ba_free(EntryAllocator, E);
+}
+
+void LargeCache::evict(Entry *E, Entry *&Evicted) {
+    unlink(E);
+    E->Next = Evicted;
+    Evicted = E;
+}
+
+void LargeCache::release(Entry *Evicted) {
+    while (Evicted) {
+        Entry *E = Evicted;
+        Evicted = E->Next;
+
+        // The region is lost if the provider fails to free it, there is no
+        // allocation to report the error to.
+        umfMemoryProviderFree(OwnAllocCtx.getMemHandle(), E->Ptr, E->Size);
+        OwnAllocCtx.unchargeLimits(E->Size);
+        umf_ba_free(EntryAllocator, E);
+    }
+}
+
+void *LargeCache::get(size_t Size, size_t Alignment, size_t &RegionSize) {
+    std::lock_guard<std::mutex> Lg(Lock);
+
+    if (!CachedBytes) {
+        return nullptr;
+    }
+
+    // Best fit among the regions wasting at most a quarter of Size, which
+    // are in at most two size classes.
+    size_t MaxSize = Size + Size / 4;
+    Entry *Best = nullptr;
+    for (size_t Class = log2Utils(Size); Class <= log2Utils(MaxSize);
+         Class++) {
+        for (Entry *E = SizeClassLists[Class]; E; E = E->Next) {
+            if (E->Size >= Size && E->Size <= MaxSize &&
+                (!Alignment ||
+                 reinterpret_cast<uintptr_t>(E->Ptr) % Alignment == 0) &&
+                (!Best || E->Size < Best->Size)) {
+                Best = E;
+            }
+        }
+        if (Best) {
+            break;
+        }
+    }
+
+    if (!Best) {
+        return nullptr;
+    }
+
+    void *Ptr = Best->Ptr;
+    RegionSize = Best->Size;
+    remove(Best);
+    return Ptr;
+}
+
+bool LargeCache::put(void *Ptr, size_t Size) {
+    size_t Capacity = OwnAllocCtx.getParams().LargeCacheSize;
+    if (Size > Capacity || OwnAllocCtx.isOverSoftLimit()) {
+        return false;
+    }
+
+    // The region is accounted before anything is evicted for it, so that
+    // the cache is not emptied for a region which cannot be cached.
+    auto *Limits = OwnAllocCtx.getLimits();
+    size_t PoolSize = Limits->TotalSize;
+    do {
+        if (Limits->MaxSize < PoolSize + Size) {
+            return false;
+        }
+    } while (!Limits->TotalSize.compare_exchange_strong(PoolSize,
+                                                        PoolSize + Size));
+
+    std::unique_lock<std::mutex> Lk(Lock);
+
+    if (!EntryAllocator) {
+        EntryAllocator = umf_ba_create(sizeof(Entry));
+        if (!EntryAllocator) {
+            Lk.unlock();
+            Limits->TotalSize -= Size;
+            return false;
+        }
+    }
+
+    auto *E = static_cast<Entry *>(umf_ba_alloc(EntryAllocator));
+    if (!E) {
+        Lk.unlock();
+        Limits->TotalSize -= Size;
+        return false;
+    }
+
+    // Make room for the region, evicting the oldest ones
+    Entry *Evicted = nullptr;
+    while (CachedBytes + Size > Capacity) {
+        evict(LruHead, Evicted);
+    }
+
+    E->Ptr = Ptr;
+    E->Size = Size;
+    if (OwnAllocCtx.isDecayEnabled()) {
+        E->IdleSince = std::chrono::steady_clock::now();
+    }
+
+    auto &List = SizeClassLists[log2Utils(Size)];
+    E->Prev = nullptr;
+    E->Next = List;
+    if (List) {
+        List->Prev = E;
+    }
+    List = E;
+
+    E->LruPrev = LruTail;
+    E->LruNext = nullptr;
+    if (LruTail) {
+        LruTail->LruNext = E;
+    } else {
+        LruHead = E;
+    }
+    LruTail = E;
+
+    CachedBytes += Size;
+
+    Lk.unlock();
+    release(Evicted);
+    return true;
+}
+
+void LargeCache::decay(std::chrono::steady_clock::time_point Now,
+                       std::chrono::steady_clock::duration Delay) {
+    Entry *Evicted = nullptr;
+    {
+        std::lock_guard<std::mutex> Lg(Lock);
+
+        while (LruHead && Now - LruHead->IdleSince >= Delay) {
+            OwnAllocCtx.countReleased(LruHead->Size);
+            evict(LruHead, Evicted);
+        }
+    }
+    release(Evicted);
+}
+
+void LargeCache::clear() {
+    Entry *Evicted = nullptr;
+    {
+        std::lock_guard<std::mutex> Lg(Lock);
+
+        while (LruHead) {
+            evict(LruHead, Evicted);
+        }
+    }
+    release(Evicted);
+}
+
+DisjointPool::AllocImpl::~AllocImpl() {
+    // Wait for any trimming of the pool to finish
+    {
+        auto *Limits = getLimits();
+        std::lock_guard<std::mutex> Lg(Limits->Lock);
+        Limits->Pools.erase(
+            std::find(Limits->Pools.begin(), Limits->Pools.end(), this));
+    }
+
+    if (DecayThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> Lg(DecayLock);
+            DecayStop = true;
+        }
+        DecayCv.notify_one();
+        DecayThread.join();
+    }
+
+    // Caches of threads which are still alive have to be flushed here, before
+    // the buckets and their slabs are destroyed.
+    std::vector<std::shared_ptr<ThreadCache>> Caches;
+    {
+        std::lock_guard<std::mutex> Lg(ThreadCachesLock);
+        Caches.swap(ThreadCaches);
+    }
+
+    for (auto &Cache : Caches) {
+        std::lock_guard<std::mutex> Lg(Cache->Lock);
+        if (Cache->Owner) {
+            flushThreadCache(*Cache);
+            Cache->Owner = nullptr;
+        }
+    }
+
+    LargeRegions.clear();
+
+    // Slabs unregister themselves from the map when destroyed
+    Buckets.clear();
+    for (auto &AlignedSet : AlignedBuckets) {
+        AlignedSet.clear();
+    }
+    critnib_delete(KnownSlabs);
+    critnib_delete(LargeAllocs);
+}
+
+bool DisjointPool::AllocImpl::isCacheable(Bucket &Bucket) {
+    // Magazines are indexed like the regular buckets, aligned buckets are
+    // not cached.
+    return params.ThreadCacheSize && !Bucket.getAlignment() &&
+           Bucket.getSize() <= Bucket.ChunkCutOff() &&
+           (!params.ThreadCacheMaxSize ||
+            Bucket.getSize() <= params.ThreadCacheMaxSize);
+}
+
+ThreadCache *DisjointPool::AllocImpl::getThreadCache() {
+    if (TLThreadCachesDestroyed) {
+        return nullptr;
+    }
+
+    auto &Caches = TLThreadCaches.Caches;
+    for (auto &Entry : Caches) {
+        if (Entry.first == Id) {
+            return Entry.second.get();
+        }
+    }
+
+    try {
+        // Drop the caches of pools which have been destroyed in the meantime
+        Caches.erase(std::remove_if(Caches.begin(), Caches.end(),
+                                    [](auto &Entry) {
+                                        auto &Cache = *Entry.second;
+                                        std::lock_guard<std::mutex> Lg(
+                                            Cache.Lock);
+                                        return Cache.Owner == nullptr;
+                                    }),
+                     Caches.end());
+        Caches.reserve(Caches.size() + 1);
+
+        auto Cache = std::make_shared<ThreadCache>(this, Buckets.size());
+        for (size_t i = 0; i < Buckets.size(); i++) {
+            if (isCacheable(*Buckets[i])) {
+                Cache->Magazines[i].reserve(params.ThreadCacheSize);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> Lg(ThreadCachesLock);
+            ThreadCaches.push_back(Cache);
+        }
+        Caches.emplace_back(Id, std::move(Cache));
+    } catch (std::bad_alloc &) {
+        return nullptr;
+    }
+
+    return Caches.back().second.get();
+}
+
+void DisjointPool::AllocImpl::unregisterThreadCache(ThreadCache *Cache) {
+    std::lock_guard<std::mutex> Lg(ThreadCachesLock);
+    auto It = std::find_if(ThreadCaches.begin(), ThreadCaches.end(),
+                           [Cache](auto &C) { return C.get() == Cache; });
+    if (It != ThreadCaches.end()) {
+        ThreadCaches.erase(It);
+    }
+}
+
+void DisjointPool::AllocImpl::flushThreadCache(ThreadCache &Cache) {
+    for (size_t i = 0; i < Cache.Magazines.size(); i++) {
+        auto &Magazine = Cache.Magazines[i];
+        if (!Magazine.empty()) {
+            Buckets[i]->freeChunks(Magazine.data(), Magazine.size());
+            Magazine.clear();
+        }
+    }
+}
+
+void *DisjointPool::AllocImpl::getChunk(Bucket &Bucket, bool &FromPool) {
+    ThreadCache *Cache = isCacheable(Bucket) ? getThreadCache() : nullptr;
+    if (!Cache) {
+        bool Fresh;
+        return Bucket.getChunk(FromPool, Fresh);
+    }
+
+    auto &Magazine = Cache->Magazines[sizeToIdx(Bucket.getSize())];
+    if (Magazine.empty()) {
+        // Refill half of the magazine, leaving room for subsequent frees
+        Bucket.getChunks(Magazine,
+                         std::max(params.ThreadCacheSize / 2, (size_t)1),
+                         FromPool);
+    } else {
+        FromPool = true;
+    }
+
+    void *Ptr = Magazine.back().Ptr;
+    Magazine.pop_back();
+    return Ptr;
+}
+
+void DisjointPool::AllocImpl::freeChunk(void *Ptr, Slab &Slab, bool &ToPool) {
+    auto &Bucket = Slab.getBucket();
+    ThreadCache *Cache = isCacheable(Bucket) ? getThreadCache() : nullptr;
+    // Chunks of slabs of other NUMA nodes are not reused by this thread
+    if (!Cache || (getNumNodes() > 1 && Slab.getNode() != getCurrentNode())) {
+        Bucket.freeChunk(Ptr, Slab, ToPool);
+        return;
+    }
+
+    auto &Magazine = Cache->Magazines[sizeToIdx(Bucket.getSize())];
+    if (Magazine.size() >= params.ThreadCacheSize) {
+        // Return the older half of the magazine to the bucket
+        size_t NumChunks = std::max(Magazine.size() / 2, (size_t)1);
+        Bucket.freeChunks(Magazine.data(), NumChunks);
+        Magazine.erase(Magazine.begin(), Magazine.begin() + NumChunks);
+    }
+
+    // The pointer might have been aligned up within the chunk
+    Magazine.push_back({Slab.getChunkStart(Ptr), &Slab});
+    ToPool = true;
+}
+
+size_t DisjointPool::AllocImpl::getUsableSize(void *Ptr) {
+    auto *Slab = findSlab(Ptr);
+    if (!Slab) {
+        return reinterpret_cast<size_t>(
+            critnib_get(LargeAllocs, reinterpret_cast<uintptr_t>(Ptr)));
+    }
+
+    // The pointer might have been aligned up within the chunk
+    auto *ChunkEnd = static_cast<char *>(Slab->getChunkStart(Ptr)) +
+                     Slab->getBucket().getSize();
+    return ChunkEnd - static_cast<char *>(Ptr);
+}
+
+bool DisjointPool::AllocImpl::canResizeInPlace(void *Ptr, size_t Size) {
+    auto *Slab = findSlab(Ptr);
+    if (!Slab) {
+        // Shrink large allocations in place unless it would waste more than
+        // half of the memory.
+        auto OldSize = reinterpret_cast<size_t>(
+            critnib_get(LargeAllocs, reinterpret_cast<uintptr_t>(Ptr)));
+        return Size > getParams().MaxPoolableSize && Size <= OldSize &&
+               Size >= OldSize / 2;
+    }
+
+    return Size <= getParams().MaxPoolableSize && Size <= getUsableSize(Ptr) &&
+           &findBucket(Size) == &Slab->getBucket();
+}
+
+void DisjointPool::AllocImpl::printStats(bool &TitlePrinted,
+                                         size_t &HighBucketSize,
+                                         size_t &HighPeakSlabsInUse,
+                                         const std::string &MTName) {
+    HighBucketSize = 0;
+    HighPeakSlabsInUse = 0;
+    auto printBucketStats = [&](Bucket &B) {
+        B.printStats(TitlePrinted, MTName);
+        HighPeakSlabsInUse = std::max(B.maxSlabsInUse, HighPeakSlabsInUse);
+        if (B.allocCount) {
+            HighBucketSize = std::max(B.SlabAllocSize(), HighBucketSize);
+        }
+    };
+
+    for (auto &B : Buckets) {
+        printBucketStats(*B);
+    }
+    for (auto &AlignedSet : AlignedBuckets) {
+        for (auto &B : AlignedSet) {
+            printBucketStats(*B);
+        }
+    }
+}
+
+umf_result_t DisjointPool::initialize(umf_memory_provider_handle_t provider,
+                                      umf_disjoint_pool_params_t *parameters) {
+    if (!provider) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+    // MinBucketSize parameter must be a power of 2 for bucket sizes
+    // to generate correctly.
+    if (!parameters->MinBucketSize ||
+        !((parameters->MinBucketSize & (parameters->MinBucketSize - 1)) == 0)) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+    // Custom size classes must be sorted and unique.
+    if (parameters->SizeClasses) {
+        if (!parameters->NumSizeClasses || !parameters->SizeClasses[0]) {
+            return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+        }
+        for (size_t i = 1; i < parameters->NumSizeClasses; i++) {
+            if (parameters->SizeClasses[i] <= parameters->SizeClasses[i - 1]) {
+                return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+            }
+        }
+    }
+    if (parameters->NodeProviders) {
+        if (!parameters->NumNodeProviders) {
+            return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+        }
+        for (size_t i = 0; i < parameters->NumNodeProviders; i++) {
+            if (!parameters->NodeProviders[i]) {
+                return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+            }
+        }
+    }
+
+    try {
+        impl = std::make_unique<AllocImpl>(provider, parameters);
+    } catch (std::bad_alloc &) {
+        return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+    } catch (MemoryProviderError &e) {
+        return e.code;
+    }
+    return UMF_RESULT_SUCCESS;
+}
+
+void *DisjointPool::malloc(size_t size) { // For full-slab allocations indicates
+                                          // whether slab is from Pool.
+    bool FromPool;
+    auto Ptr = impl->allocate(size, FromPool);
+
+    if (impl->getParams().PoolTrace > 2) {
+        auto MT = impl->getParams().Name;
+        std::cout << "Allocated " << std::setw(8) << size << " " << MT
+                  << " bytes from " << (FromPool ? "Pool" : "Provider") << " ->"
+                  << Ptr << std::endl;
+    }
+    return Ptr;
+}
+
+void *DisjointPool::calloc(size_t num, size_t size) {
+    if (num && size > std::numeric_limits<size_t>::max() / num) {
+        umf::getPoolLastStatusRef<DisjointPool>() =
+            UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+        return nullptr;
+    }
+
+    bool FromPool;
+    auto Ptr = impl->allocateZeroed(num * size, FromPool);
+
+    if (impl->getParams().PoolTrace > 2) {
+        auto MT = impl->getParams().Name;
+        std::cout << "Allocated " << std::setw(8) << num * size << " " << MT
+                  << " zeroed bytes from " << (FromPool ? "Pool" : "Provider")
+                  << " ->" << Ptr << std::endl;
+    }
+    return Ptr;
+}
+
+void *DisjointPool::realloc(void *ptr, size_t size) {
+    if (!ptr) {
+        return malloc(size);
+    }
+
+    if (size == 0) {
+        free(ptr);
+        return nullptr;
+    }
+
+    if (impl->canResizeInPlace(ptr, size)) {
+        return ptr;
+    }
+
+    auto OldSize = impl->getUsableSize(ptr);
+    auto NewPtr = malloc(size);
+    if (!NewPtr) {
+        return nullptr;
+    }
+
+    memcpy(NewPtr, ptr, std::min(OldSize, size));
+    free(ptr);
+    return NewPtr;
+}
+
+void *DisjointPool::aligned_malloc(size_t size, size_t alignment) {
+    bool FromPool;
+    auto Ptr = impl->allocate(size, alignment, FromPool);
+
+    if (impl->getParams().PoolTrace > 2) {
+        auto MT = impl->getParams().Name;
+        std::cout << "Allocated " << std::setw(8) << size << " " << MT
+                  << " bytes aligned at " << alignment << " from "
+                  << (FromPool ? "Pool" : "Provider") << " ->" << Ptr
+                  << std::endl;
+    }
+    return Ptr;
+}
+
+size_t DisjointPool::malloc_usable_size(void *ptr) {
+    if (!ptr) {
+        return 0;
+    }
+
+    return impl->getUsableSize(ptr);
+}
+
+umf_result_t DisjointPool::free(void *ptr) try {
+    if (!ptr) {
+        return UMF_RESULT_SUCCESS;
+    }
+
+    bool ToPool;
+    impl->deallocate(ptr, ToPool);
+
+    if (impl->getParams().PoolTrace > 2) {
+        auto MT = impl->getParams().Name;
+        std::cout << "Freed " << MT << " " << ptr << " to "
+                  << (ToPool ? "Pool" : "Provider")
+                  << ", Current total pool size "
+                  << impl->getLimits()->TotalSize.load()
+                  << ", Current pool size for " << MT << " "
+                  << impl->getParams().CurPoolSize << "\n";
+    }
+    return UMF_RESULT_SUCCESS;
+} catch (MemoryProviderError &e) {
+    return e.code;
+}
+
+umf_result_t DisjointPool::free_sized(void *ptr, size_t size) try {
+    if (!ptr) {
+        return UMF_RESULT_SUCCESS;
+    }
+
+    bool ToPool;
+    impl->deallocate(ptr, size, ToPool);
+
+    if (impl->getParams().PoolTrace > 2) {
+        auto MT = impl->getParams().Name;
+        std::cout << "Freed " << MT << " " << ptr << " of " << size
+                  << " bytes to " << (ToPool ? "Pool" : "Provider")
+                  << ", Current total pool size "
+                  << impl->getLimits()->TotalSize.load()
+                  << ", Current pool size for " << MT << " "
+                  << impl->getParams().CurPoolSize << "\n";
+    }
     return UMF_RESULT_SUCCESS;
 } catch (MemoryProviderError &e) {
     return e.code;
@@ -1044,6 +3109,31 @@ umf_result_t DisjointPool::get_last_allocation_error() {
     return umf::getPoolLastStatusRef<DisjointPool>();
 }
 
+size_t DisjointPool::malloc_batch(size_t size, size_t num, void **ptrs) {
+    auto NumAllocated = impl->allocateBatch(size, num, ptrs);
+
+    if (impl->getParams().PoolTrace > 2) {
+        auto MT = impl->getParams().Name;
+        std::cout << "Allocated " << NumAllocated << " x " << std::setw(8)
+                  << size << " " << MT << " bytes" << std::endl;
+    }
+    return NumAllocated;
+}
+
+umf_result_t DisjointPool::free_batch(void **ptrs, size_t num) {
+    auto Ret = impl->deallocateBatch(ptrs, num);
+
+    if (impl->getParams().PoolTrace > 2) {
+        auto MT = impl->getParams().Name;
+        std::cout << "Freed " << num << " " << MT << " allocations"
+                  << ", Current total pool size "
+                  << impl->getLimits()->TotalSize.load()
+                  << ", Current pool size for " << MT << " "
+                  << impl->getParams().CurPoolSize << "\n";
+    }
+    return Ret;
+}
+
 DisjointPool::DisjointPool() {}
 
 // Define destructor for use with unique_ptr
@@ -1051,7 +3141,8 @@ DisjointPool::~DisjointPool() {
     bool TitlePrinted = false;
     size_t HighBucketSize;
     size_t HighPeakSlabsInUse;
-    if (impl->getParams().PoolTrace > 1) {
+    // impl is not set if the initialization failed
+    if (impl && impl->getParams().PoolTrace > 1) {
         auto name = impl->getParams().Name;
         try { // cannot throw in destructor
             impl->printStats(TitlePrinted, HighBucketSize, HighPeakSlabsInUse,
@@ -1059,6 +3150,11 @@ DisjointPool::~DisjointPool() {
             if (TitlePrinted) {
                 std::cout << "Current Pool Size "
                           << impl->getLimits()->TotalSize.load() << std::endl;
+                if (impl->isDecayEnabled()) {
+                    std::cout << "Purged Bytes " << impl->getPurgedBytes()
+                              << ", Released Bytes "
+                              << impl->getReleasedBytes() << std::endl;
+                }
                 std::cout << "Suggested Setting=;"
                           << std::string(1, tolower(name[0]))
                           << std::string(name + 1) << ":" << HighBucketSize
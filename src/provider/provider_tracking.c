@@ -8,7 +8,10 @@
  */
 
 #include "provider_tracking.h"
+#include "../memory_provider_internal.h"
+#include "base_alloc_global.h"
 #include "critnib.h"
+#include "utils_common.h"
 #include "utils_concurrency.h"
 
 #include <umf/memory_pool.h>
@@ -25,28 +28,43 @@ typedef struct tracker_value_t {
     size_t size;
 } tracker_value_t;
 
+// Number of ranges cached by each thread for umfMemoryTrackerGetPool()
+#define TRACKER_CACHE_SIZE 4
+
+// Incremented on every removal from a tracker, which invalidates the caches
+// of all threads.
+static uint64_t Tracker_generation;
+
+typedef struct tracker_cache_entry_t {
+    uintptr_t base;
+    size_t size;
+    umf_memory_pool_handle_t pool; // NULL if the entry is empty
+} tracker_cache_entry_t;
+
+typedef struct tracker_cache_t {
+    uint64_t generation;
+    unsigned next; // entry to be replaced next
+    tracker_cache_entry_t entries[TRACKER_CACHE_SIZE];
+} tracker_cache_t;
+
+static __TLS tracker_cache_t Tracker_cache;
+
 static umf_result_t umfMemoryTrackerAdd(umf_memory_tracker_handle_t hTracker,
                                         umf_memory_pool_handle_t pool,
                                         const void *ptr, size_t size) {
     assert(ptr);
 
-    tracker_value_t *value =
-        (tracker_value_t *)umf_ba_alloc(hTracker->tracker_allocator);
-    if (value == NULL) {
-        return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
-    }
-
-    value->pool = pool;
-    value->size = size;
-
-    int ret = critnib_insert(hTracker->map, (uintptr_t)ptr, value, 0);
+    tracker_value_t value = {pool, size};
+    int ret = critnib_insert_inline(hTracker->map, (uintptr_t)ptr, &value, 0);
 
     if (ret == 0) {
+#ifdef UMF_ENABLE_TRACKER_PAGE_MAP
+        // pages which could not be mapped are looked up in the critnib
+        (void)page_map_set(hTracker->page_map, (uintptr_t)ptr, size, pool);
+#endif /* UMF_ENABLE_TRACKER_PAGE_MAP */
         return UMF_RESULT_SUCCESS;
     }
 
-    umf_ba_free(hTracker->tracker_allocator, value);
-
     if (ret == ENOMEM) {
         return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
     }
@@ -66,14 +84,19 @@ static umf_result_t umfMemoryTrackerRemove(umf_memory_tracker_handle_t hTracker,
     // umfMemoryTrackerRemove call with the same ptr value.
     (void)size;
 
-    void *value = critnib_remove(hTracker->map, (uintptr_t)ptr);
-    if (!value) {
+    tracker_value_t value;
+    if (!critnib_remove_inline(hTracker->map, (uintptr_t)ptr, &value)) {
         // This should not happen
         // TODO: add logging here
         return UMF_RESULT_ERROR_UNKNOWN;
     }
 
-    umf_ba_free(hTracker->tracker_allocator, value);
+#ifdef UMF_ENABLE_TRACKER_PAGE_MAP
+    page_map_clear(hTracker->page_map, (uintptr_t)ptr, value.size);
+#endif /* UMF_ENABLE_TRACKER_PAGE_MAP */
+
+    // the range might be cached by other threads
+    util_atomic_increment(&Tracker_generation);
 
     return UMF_RESULT_SUCCESS;
 }
@@ -81,15 +104,51 @@ static umf_result_t umfMemoryTrackerRemove(umf_memory_tracker_handle_t hTracker,
 umf_memory_pool_handle_t umfMemoryTrackerGetPool(const void *ptr) {
     assert(ptr);
 
+#ifdef UMF_ENABLE_TRACKER_PAGE_MAP
+    umf_memory_pool_handle_t pool =
+        (umf_memory_pool_handle_t)page_map_get(TRACKER->page_map,
+                                               (uintptr_t)ptr);
+    if (pool) {
+        return pool;
+    }
+#endif /* UMF_ENABLE_TRACKER_PAGE_MAP */
+
+    tracker_cache_t *cache = &Tracker_cache;
+
+    // The generation is read before the lookup, so that a range removed
+    // after the lookup is not cached as valid.
+    uint64_t generation;
+    util_atomic_load_acquire(&Tracker_generation, &generation);
+    if (cache->generation != generation) {
+        for (int i = 0; i < TRACKER_CACHE_SIZE; i++) {
+            cache->entries[i].pool = NULL;
+        }
+        cache->generation = generation;
+    } else {
+        // the end of a range may be the beginning of the next one
+        for (int i = 0; i < TRACKER_CACHE_SIZE; i++) {
+            tracker_cache_entry_t *entry = &cache->entries[i];
+            if (entry->pool && (uintptr_t)ptr - entry->base < entry->size) {
+                return entry->pool;
+            }
+        }
+    }
+
     uintptr_t rkey;
-    tracker_value_t *rvalue;
-    int found = critnib_find(TRACKER->map, (uintptr_t)ptr, FIND_LE,
-                             (void *)&rkey, (void **)&rvalue);
-    if (!found) {
+    tracker_value_t rvalue;
+    int found = critnib_find_inline(TRACKER->map, (uintptr_t)ptr, FIND_LE,
+                                    &rkey, &rvalue);
+    if (!found || rkey + rvalue.size < (uintptr_t)ptr) {
         return NULL;
     }
 
-    return (rkey + rvalue->size >= (uintptr_t)ptr) ? rvalue->pool : NULL;
+    tracker_cache_entry_t *entry =
+        &cache->entries[cache->next++ % TRACKER_CACHE_SIZE];
+    entry->base = rkey;
+    entry->size = rvalue.size;
+    entry->pool = rvalue.pool;
+
+    return rvalue.pool;
 }
 
 typedef struct umf_tracking_memory_provider_t {
@@ -132,39 +191,39 @@ static umf_result_t trackingAllocationSplit(void *hProvider, void *ptr,
     umf_tracking_memory_provider_t *provider =
         (umf_tracking_memory_provider_t *)hProvider;
 
-    tracker_value_t *splitValue =
-        (tracker_value_t *)umf_ba_alloc(provider->hTracker->tracker_allocator);
-    if (!splitValue) {
-        return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
-    }
-
-    splitValue->pool = provider->pool;
-    splitValue->size = firstSize;
+    tracker_value_t splitValue = {provider->pool, firstSize};
 
     int r = util_mutex_lock(&provider->hTracker->splitMergeMutex);
     if (r) {
-        goto err_lock;
+        return ret;
     }
 
-    tracker_value_t *value =
-        (tracker_value_t *)critnib_get(provider->hTracker->map, (uintptr_t)ptr);
-    if (!value) {
+    tracker_value_t value;
+    if (!critnib_get_inline(provider->hTracker->map, (uintptr_t)ptr, &value)) {
         fprintf(stderr, "tracking split: no such value\n");
         ret = UMF_RESULT_ERROR_INVALID_ARGUMENT;
         goto err;
     }
-    if (value->size != totalSize) {
-        fprintf(stderr, "tracking split: %zu != %zu\n", value->size, totalSize);
+    if (value.size != totalSize) {
+        fprintf(stderr, "tracking split: %zu != %zu\n", value.size, totalSize);
         ret = UMF_RESULT_ERROR_INVALID_ARGUMENT;
         goto err;
     }
 
+    // the leaf for the updated entry is allocated up front, so that the
+    // split never has to be rolled back for the lack of it
+    void *leaf = critnib_reserve_inline(provider->hTracker->map);
+    if (!leaf) {
+        ret = UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+        goto err;
+    }
+
     ret = umfMemoryProviderAllocationSplit(provider->hUpstream, ptr, totalSize,
                                            firstSize);
     if (ret != UMF_RESULT_SUCCESS) {
         fprintf(stderr,
                 "tracking split: umfMemoryProviderAllocationSplit failed\n");
-        goto err;
+        goto err_unreserve;
     }
 
     void *highPtr = (void *)(((uintptr_t)ptr) + firstSize);
@@ -179,25 +238,28 @@ static umf_result_t trackingAllocationSplit(void *hProvider, void *ptr,
         // TODO: what now? should we rollback the split? This can only happen due to ENOMEM
         // so it's unlikely but probably the best solution would be to try to preallocate everything
         // (value and critnib nodes) before calling umfMemoryProviderAllocationSplit.
-        goto err;
+        goto err_unreserve;
     }
 
-    int cret = critnib_insert(provider->hTracker->map, (uintptr_t)ptr,
-                              (void *)splitValue, 1 /* update */);
-    // this cannot fail since we know the element exists (nothing to allocate)
-    assert(cret == 0);
-    (void)cret;
+    // the element exists, so the update consumes the reserved leaf only
+    int cret = critnib_insert_reserved_inline(provider->hTracker->map,
+                                              (uintptr_t)ptr, &splitValue,
+                                              1 /* update */, leaf);
+    if (cret) {
+        fprintf(stderr, "tracking split: updating the entry failed\n");
+        (void)umfMemoryTrackerRemove(provider->hTracker, highPtr, secondSize);
+        ret = UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+        goto err;
+    }
 
-    // free the original value
-    umf_ba_free(provider->hTracker->tracker_allocator, value);
     util_mutex_unlock(&provider->hTracker->splitMergeMutex);
 
     return UMF_RESULT_SUCCESS;
 
+err_unreserve:
+    critnib_unreserve_inline(provider->hTracker->map, leaf);
 err:
     util_mutex_unlock(&provider->hTracker->splitMergeMutex);
-err_lock:
-    umf_ba_free(provider->hTracker->tracker_allocator, splitValue);
     return ret;
 }
 
@@ -207,71 +269,74 @@ static umf_result_t trackingAllocationMerge(void *hProvider, void *lowPtr,
     umf_tracking_memory_provider_t *provider =
         (umf_tracking_memory_provider_t *)hProvider;
 
-    tracker_value_t *mergedValue =
-        (tracker_value_t *)umf_ba_alloc(provider->hTracker->tracker_allocator);
-
-    if (!mergedValue) {
-        return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
-    }
-
-    mergedValue->pool = provider->pool;
-    mergedValue->size = totalSize;
+    tracker_value_t mergedValue = {provider->pool, totalSize};
 
     int r = util_mutex_lock(&provider->hTracker->splitMergeMutex);
     if (r) {
-        goto err_lock;
+        return ret;
     }
 
-    tracker_value_t *lowValue = (tracker_value_t *)critnib_get(
-        provider->hTracker->map, (uintptr_t)lowPtr);
-    if (!lowValue) {
+    tracker_value_t lowValue;
+    if (!critnib_get_inline(provider->hTracker->map, (uintptr_t)lowPtr,
+                            &lowValue)) {
         fprintf(stderr, "tracking merge: no left value\n");
         ret = UMF_RESULT_ERROR_INVALID_ARGUMENT;
         goto err;
     }
-    tracker_value_t *highValue = (tracker_value_t *)critnib_get(
-        provider->hTracker->map, (uintptr_t)highPtr);
-    if (!highValue) {
+    tracker_value_t highValue;
+    if (!critnib_get_inline(provider->hTracker->map, (uintptr_t)highPtr,
+                            &highValue)) {
         fprintf(stderr, "tracking merge: no right value\n");
         ret = UMF_RESULT_ERROR_INVALID_ARGUMENT;
         goto err;
     }
-    if (lowValue->pool != highValue->pool) {
+    if (lowValue.pool != highValue.pool) {
         fprintf(stderr, "tracking merge: pool mismatch\n");
         ret = UMF_RESULT_ERROR_INVALID_ARGUMENT;
         goto err;
     }
-    if (lowValue->size + highValue->size != totalSize) {
+    if (lowValue.size + highValue.size != totalSize) {
         fprintf(stderr, "tracking merge: lowValue->size + highValue->size != "
                         "totalSize\n");
         ret = UMF_RESULT_ERROR_INVALID_ARGUMENT;
         goto err;
     }
 
+    // the leaf for the updated entry is allocated up front, so that the
+    // merge never has to be rolled back for the lack of it
+    void *leaf = critnib_reserve_inline(provider->hTracker->map);
+    if (!leaf) {
+        ret = UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+        goto err;
+    }
+
     ret = umfMemoryProviderAllocationMerge(provider->hUpstream, lowPtr, highPtr,
                                            totalSize);
     if (ret != UMF_RESULT_SUCCESS) {
         fprintf(stderr,
                 "tracking merge: umfMemoryProviderAllocationMerge failed\n");
+        critnib_unreserve_inline(provider->hTracker->map, leaf);
         goto err;
     }
 
     // We'll have a duplicate entry for the range [highPtr, highValue->size] but this is fine,
     // the value is the same anyway and we forbid removing that range concurrently
-    int cret = critnib_insert(provider->hTracker->map, (uintptr_t)lowPtr,
-                              (void *)mergedValue, 1 /* update */);
-    // this cannot fail since we know the element exists (nothing to allocate)
-    assert(cret == 0);
-    (void)cret;
-
-    // free old value that we just replaced with mergedValue
-    umf_ba_free(provider->hTracker->tracker_allocator, lowValue);
-
-    void *erasedhighValue =
-        critnib_remove(provider->hTracker->map, (uintptr_t)highPtr);
-    assert(erasedhighValue == highValue);
+    // the element exists, so the update consumes the reserved leaf only
+    int cret = critnib_insert_reserved_inline(provider->hTracker->map,
+                                              (uintptr_t)lowPtr, &mergedValue,
+                                              1 /* update */, leaf);
+    if (cret) {
+        // highPtr is kept, so both halves stay tracked
+        fprintf(stderr, "tracking merge: updating the entry failed\n");
+        ret = UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+        goto err;
+    }
 
-    umf_ba_free(provider->hTracker->tracker_allocator, erasedhighValue);
+    int erased = critnib_remove_inline(provider->hTracker->map,
+                                       (uintptr_t)highPtr, NULL);
+    assert(erased);
+    (void)erased;
+    util_atomic_increment(&Tracker_generation);
 
     util_mutex_unlock(&provider->hTracker->splitMergeMutex);
 
@@ -279,8 +344,6 @@ static umf_result_t trackingAllocationMerge(void *hProvider, void *lowPtr,
 
 err:
     util_mutex_unlock(&provider->hTracker->splitMergeMutex);
-err_lock:
-    umf_ba_free(provider->hTracker->tracker_allocator, mergedValue);
     return ret;
 }
 
@@ -315,11 +378,14 @@ static umf_result_t trackingFree(void *hProvider, void *ptr, size_t size) {
 }
 
 static umf_result_t trackingInitialize(void *params, void **ret) {
-    umf_tracking_memory_provider_t *p =
-        (umf_tracking_memory_provider_t *)params;
+    umf_ba_pool_t *base_allocator =
+        umf_ba_get_pool(sizeof(umf_tracking_memory_provider_t));
+    if (!base_allocator) {
+        return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
     umf_tracking_memory_provider_t *provider =
-        (umf_tracking_memory_provider_t *)umf_ba_linear_alloc(
-            p->hTracker->pool_linear, sizeof(umf_tracking_memory_provider_t));
+        (umf_tracking_memory_provider_t *)umf_ba_alloc(base_allocator);
     if (!provider) {
         return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
     }
@@ -333,14 +399,13 @@ static umf_result_t trackingInitialize(void *params, void **ret) {
 static void check_if_tracker_is_empty(umf_memory_tracker_handle_t hTracker,
                                       umf_memory_pool_handle_t pool) {
     uintptr_t rkey;
-    void *rvalue;
+    tracker_value_t value;
     size_t n_items = 0;
     uintptr_t last_key = 0;
 
-    while (1 == critnib_find((critnib *)hTracker->map, last_key, FIND_G, &rkey,
-                             &rvalue)) {
-        tracker_value_t *value = (tracker_value_t *)rvalue;
-        if (value->pool == pool || pool == NULL) {
+    while (1 == critnib_find_inline((critnib *)hTracker->map, last_key, FIND_G,
+                                    &rkey, &value)) {
+        if (value.pool == pool || pool == NULL) {
             n_items++;
         }
 
@@ -371,10 +436,8 @@ static void trackingFinalize(void *provider) {
     check_if_tracker_is_empty(p->hTracker, p->pool);
 #endif /* NDEBUG */
 
-    (void)provider; // unused in Release build
-    // provider was allocated from the linear allocator,
-    // so it will be freed, when the linear allocator is destroyed
-    // in umfMemoryTrackerDestroy()
+    umf_ba_free(umf_ba_get_pool(sizeof(umf_tracking_memory_provider_t)),
+                provider);
 }
 
 static void trackingGetLastError(void *provider, const char **msg,
@@ -448,15 +511,27 @@ umf_result_t umfTrackingMemoryProviderCreate(
                                    hTrackingProvider);
 }
 
+int umfIsTrackingMemoryProvider(umf_memory_provider_handle_t hProvider) {
+    // the ops are copied into the provider, so compare one of the functions
+    const umf_memory_provider_ops_t *ops = umfMemoryProviderGetOps(hProvider);
+    return ops && ops->alloc == UMF_TRACKING_MEMORY_PROVIDER_OPS.alloc;
+}
+
 void umfTrackingMemoryProviderGetUpstreamProvider(
-    umf_memory_provider_handle_t hTrackingProvider,
-    umf_memory_provider_handle_t *hUpstream) {
+    void *trackingProviderPriv, umf_memory_provider_handle_t *hUpstream) {
     assert(hUpstream);
     umf_tracking_memory_provider_t *p =
-        (umf_tracking_memory_provider_t *)hTrackingProvider;
+        (umf_tracking_memory_provider_t *)trackingProviderPriv;
     *hUpstream = p->hUpstream;
 }
 
+umf_memory_pool_handle_t
+umfTrackingMemoryProviderGetPool(void *trackingProviderPriv) {
+    umf_tracking_memory_provider_t *p =
+        (umf_tracking_memory_provider_t *)trackingProviderPriv;
+    return p->pool;
+}
+
 umf_memory_tracker_handle_t umfMemoryTrackerCreate(void) {
     umf_ba_linear_pool_t *pool_linear =
         umf_ba_linear_create(0 /* minimum pool size */);
@@ -464,38 +539,41 @@ umf_memory_tracker_handle_t umfMemoryTrackerCreate(void) {
         return NULL;
     }
 
-    umf_ba_pool_t *tracker_allocator =
-        umf_ba_create(sizeof(struct tracker_value_t));
-    if (!tracker_allocator) {
-        goto err_destroy_pool_linear;
-    }
-
     umf_memory_tracker_handle_t handle =
         (umf_memory_tracker_handle_t)umf_ba_linear_alloc(
             pool_linear, sizeof(struct umf_memory_tracker_t));
     if (!handle) {
-        goto err_destroy_tracker_allocator;
+        goto err_destroy_pool_linear;
     }
 
     handle->pool_linear = pool_linear;
-    handle->tracker_allocator = tracker_allocator;
 
     void *mutex_ptr = util_mutex_init(&handle->splitMergeMutex);
     if (!mutex_ptr) {
-        goto err_destroy_tracker_allocator;
+        goto err_destroy_pool_linear;
     }
 
-    handle->map = critnib_new();
+    // the values are stored in the critnib leaves, not allocated separately
+    handle->map = critnib_new_inline(sizeof(tracker_value_t));
     if (!handle->map) {
         goto err_destroy_mutex;
     }
 
+#ifdef UMF_ENABLE_TRACKER_PAGE_MAP
+    handle->page_map = page_map_new();
+    if (!handle->page_map) {
+        goto err_delete_map;
+    }
+#endif /* UMF_ENABLE_TRACKER_PAGE_MAP */
+
     return handle;
 
+#ifdef UMF_ENABLE_TRACKER_PAGE_MAP
+err_delete_map:
+    critnib_delete(handle->map);
+#endif /* UMF_ENABLE_TRACKER_PAGE_MAP */
 err_destroy_mutex:
     util_mutex_destroy_not_free(&handle->splitMergeMutex);
-err_destroy_tracker_allocator:
-    umf_ba_destroy(tracker_allocator);
 err_destroy_pool_linear:
     umf_ba_linear_destroy(pool_linear);
     return NULL;
@@ -511,7 +589,10 @@ void umfMemoryTrackerDestroy(umf_memory_tracker_handle_t handle) {
 #endif /* NDEBUG */
 
     critnib_delete(handle->map);
+#ifdef UMF_ENABLE_TRACKER_PAGE_MAP
+    page_map_delete(handle->page_map);
+#endif /* UMF_ENABLE_TRACKER_PAGE_MAP */
+    util_atomic_increment(&Tracker_generation);
     util_mutex_destroy_not_free(&handle->splitMergeMutex);
-    umf_ba_destroy(handle->tracker_allocator);
     umf_ba_linear_destroy(handle->pool_linear);
 }
@@ -20,6 +20,7 @@
 #include "base_alloc.h"
 #include "base_alloc_linear.h"
 #include "critnib.h"
+#include "page_map.h"
 #include "utils_concurrency.h"
 
 #ifdef __cplusplus
@@ -28,8 +29,11 @@ extern "C" {
 
 struct umf_memory_tracker_t {
     umf_ba_linear_pool_t *pool_linear;
-    umf_ba_pool_t *tracker_allocator;
     critnib *map;
+#ifdef UMF_ENABLE_TRACKER_PAGE_MAP
+    // pools of the pages fully covered by the ranges in the map
+    page_map *page_map;
+#endif /* UMF_ENABLE_TRACKER_PAGE_MAP */
     os_mutex_t splitMergeMutex;
 };
 
@@ -48,9 +52,16 @@ umf_result_t umfTrackingMemoryProviderCreate(
     umf_memory_provider_handle_t hUpstream, umf_memory_pool_handle_t hPool,
     umf_memory_provider_handle_t *hTrackingProvider);
 
+// Returns non-zero if hProvider comes from umfTrackingMemoryProviderCreate().
+int umfIsTrackingMemoryProvider(umf_memory_provider_handle_t hProvider);
+
+// The getters below take the private data of a tracking provider,
+// as returned by umfMemoryProviderGetPriv().
 void umfTrackingMemoryProviderGetUpstreamProvider(
-    umf_memory_provider_handle_t hTrackingProvider,
-    umf_memory_provider_handle_t *hUpstream);
+    void *trackingProviderPriv, umf_memory_provider_handle_t *hUpstream);
+
+umf_memory_pool_handle_t
+umfTrackingMemoryProviderGetPool(void *trackingProviderPriv);
 
 #ifdef __cplusplus
 }
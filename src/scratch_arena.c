@@ -0,0 +1,51 @@
+/*
+ *
+ * Copyright (C) 2024 Intel Corporation
+ *
+ * Under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+ *
+ */
+
+#include <umf/scratch_arena.h>
+
+#include "base_alloc_linear.h"
+#include "utils_common.h"
+
+// a scratch arena is a linear base allocator pool
+static umf_ba_linear_pool_t *arena_pool(umf_scratch_arena_handle_t hArena) {
+    return (umf_ba_linear_pool_t *)hArena;
+}
+
+umf_result_t umfScratchArenaCreate(size_t size,
+                                   umf_scratch_arena_handle_t *hArena) {
+    if (!hArena) {
+        return UMF_RESULT_ERROR_INVALID_ARGUMENT;
+    }
+
+    umf_ba_linear_pool_t *pool = umf_ba_linear_create(size);
+    if (!pool) {
+        return UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY;
+    }
+
+    *hArena = (umf_scratch_arena_handle_t)pool;
+
+    return UMF_RESULT_SUCCESS;
+}
+
+void umfScratchArenaDestroy(umf_scratch_arena_handle_t hArena) {
+    if (hArena) {
+        umf_ba_linear_destroy(arena_pool(hArena));
+    }
+}
+
+void *umfScratchArenaAlloc(umf_scratch_arena_handle_t hArena, size_t size) {
+    UMF_CHECK((hArena != NULL), NULL);
+    return umf_ba_linear_alloc(arena_pool(hArena), size);
+}
+
+void umfScratchArenaReset(umf_scratch_arena_handle_t hArena) {
+    if (hArena) {
+        umf_ba_linear_reset(arena_pool(hArena));
+    }
+}
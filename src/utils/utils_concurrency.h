@@ -56,8 +56,36 @@ static __inline unsigned char util_mssb_index(long long value) {
 
 #define util_atomic_store_release(object, desired)                             \
     InterlockedExchange64((LONG64 volatile *)object, (LONG64)desired)
+#define util_atomic_load_seq_cst(object, dest)                                 \
+    do {                                                                       \
+        *dest = InterlockedOr64((LONG64 volatile *)object, 0);                 \
+    } while (0)
+#define util_atomic_store_seq_cst(object, desired)                             \
+    InterlockedExchange64((LONG64 volatile *)object, (LONG64)desired)
 #define util_atomic_increment(object)                                          \
     InterlockedIncrement64((LONG64 volatile *)object)
+#define util_atomic_decrement(object)                                          \
+    InterlockedDecrement64((LONG64 volatile *)object)
+// Adds value to object and returns the previous value of object.
+#define util_fetch_and_add(object, value)                                      \
+    InterlockedExchangeAdd64((LONG64 volatile *)object, (LONG64)value)
+
+// Returns true and stores desired in object if it is equal to expected,
+// otherwise returns false and stores the value of object in expected.
+static __inline int util_compare_exchange64(LONG64 volatile *object,
+                                            LONG64 *expected,
+                                            LONG64 desired) {
+    LONG64 old = InterlockedCompareExchange64(object, desired, *expected);
+    if (old == *expected) {
+        return 1;
+    }
+    *expected = old;
+    return 0;
+}
+
+#define util_compare_exchange(object, expected, desired)                       \
+    util_compare_exchange64((LONG64 volatile *)object, (LONG64 *)expected,     \
+                            (LONG64) * (desired))
 #else
 #define util_lssb_index(x) ((unsigned char)__builtin_ctzll(x))
 #define util_mssb_index(x) ((unsigned char)(63 - __builtin_clzll(x)))
@@ -65,8 +93,19 @@ static __inline unsigned char util_mssb_index(long long value) {
     __atomic_load(object, dest, memory_order_acquire)
 #define util_atomic_store_release(object, desired)                             \
     __atomic_store_n(object, desired, memory_order_release)
+#define util_atomic_load_seq_cst(object, dest)                                 \
+    __atomic_load(object, dest, __ATOMIC_SEQ_CST)
+#define util_atomic_store_seq_cst(object, desired)                             \
+    __atomic_store_n(object, desired, __ATOMIC_SEQ_CST)
 #define util_atomic_increment(object)                                          \
-    __atomic_add_fetch(object, 1, __ATOMIC_ACQ_REL)
+    __atomic_add_fetch(object, 1, __ATOMIC_SEQ_CST)
+#define util_atomic_decrement(object)                                          \
+    __atomic_sub_fetch(object, 1, __ATOMIC_SEQ_CST)
+#define util_fetch_and_add(object, value)                                      \
+    __atomic_fetch_add(object, value, __ATOMIC_ACQ_REL)
+#define util_compare_exchange(object, expected, desired)                       \
+    __atomic_compare_exchange(object, expected, desired, 0 /* strong */,       \
+                              __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
 #endif
 
 #ifdef __cplusplus
@@ -16,6 +16,8 @@ extern "C" {
 
 size_t getLeftmostSetBitPos(size_t num);
 
+size_t getRightmostSetBitPos(size_t num);
+
 // Logarithm is an index of the most significant non-zero bit.
 static inline size_t log2Utils(size_t num) { return getLeftmostSetBitPos(num); }
 
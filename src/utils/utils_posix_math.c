@@ -18,3 +18,12 @@ size_t getLeftmostSetBitPos(size_t num) {
            "Finding leftmost set bit when number equals zero is undefined");
     return (sizeof(num) * CHAR_BIT - 1) - __builtin_clzll(num);
 }
+
+// Retrieves the position of the rightmost set bit.
+// The position of the bit is counted from 0
+// e.g. for 01000011110 the position equals 1.
+size_t getRightmostSetBitPos(size_t num) {
+    assert(num != 0 &&
+           "Finding rightmost set bit when number equals zero is undefined");
+    return __builtin_ctzll(num);
+}
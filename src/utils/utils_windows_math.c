@@ -11,6 +11,7 @@
 #include <intrin.h>
 
 #pragma intrinsic(_BitScanReverse)
+#pragma intrinsic(_BitScanForward64)
 
 // Retrieves the position of the leftmost set bit.
 // The position of the bit is counted from 0
@@ -22,3 +23,14 @@ size_t getLeftmostSetBitPos(size_t num) {
     _BitScanReverse(&index, (unsigned long)num);
     return (size_t)index;
 }
+
+// Retrieves the position of the rightmost set bit.
+// The position of the bit is counted from 0
+// e.g. for 01000011110 the position equals 1.
+size_t getRightmostSetBitPos(size_t num) {
+    assert(num != 0 &&
+           "Finding rightmost set bit when number equals zero is undefined");
+    unsigned long index = 0;
+    _BitScanForward64(&index, (unsigned __int64)num);
+    return (size_t)index;
+}
@@ -409,7 +409,10 @@ INSTANTIATE_TEST_SUITE_P(
         umf_test::withGeneratedArgs(umfPoolMalloc),
         umf_test::withGeneratedArgs(umfPoolAlignedMalloc),
         umf_test::withGeneratedArgs(umfPoolFree),
+        umf_test::withGeneratedArgs(umfPoolFreeSized),
         umf_test::withGeneratedArgs(umfPoolCalloc),
         umf_test::withGeneratedArgs(umfPoolRealloc),
         umf_test::withGeneratedArgs(umfPoolMallocUsableSize),
+        umf_test::withGeneratedArgs(umfPoolMallocBatch),
+        umf_test::withGeneratedArgs(umfPoolFreeBatch),
         umf_test::withGeneratedArgs(umfPoolGetLastAllocationError)));
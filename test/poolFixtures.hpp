@@ -169,6 +169,34 @@ TEST_P(umfPoolTest, freeNullptr) {
     ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
 }
 
+TEST_P(umfPoolTest, mallocFreeSized) {
+    static constexpr std::array<size_t, 3> allocSizes = {8, 64, 1 << 20};
+    for (auto allocSize : allocSizes) {
+        auto *ptr = umfPoolMalloc(pool.get(), allocSize);
+        ASSERT_NE(ptr, nullptr);
+        std::memset(ptr, 0, allocSize);
+        auto ret = umfPoolFreeSized(pool.get(), ptr, allocSize);
+        ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+    }
+}
+
+TEST_P(umfPoolTest, mallocFreeBatch) {
+    static constexpr size_t allocSize = 64;
+    static constexpr size_t numAllocs = 100;
+    std::array<void *, numAllocs> ptrs{};
+
+    auto num =
+        umfPoolMallocBatch(pool.get(), allocSize, numAllocs, ptrs.data());
+    ASSERT_EQ(num, numAllocs);
+    for (auto ptr : ptrs) {
+        ASSERT_NE(ptr, nullptr);
+        std::memset(ptr, 0, allocSize);
+    }
+
+    auto ret = umfPoolFreeBatch(pool.get(), ptrs.data(), numAllocs);
+    ASSERT_EQ(ret, UMF_RESULT_SUCCESS);
+}
+
 TEST_P(umfPoolTest, multiThreadedMallocFree) {
     static constexpr size_t allocSize = 64;
     auto poolMalloc = [](size_t allocSize, umf_memory_pool_handle_t pool) {
@@ -373,6 +401,24 @@ TEST_P(umfMultiPoolTest, memoryTracking) {
         umfFree(std::get<0>(p));
     }
 }
+
+TEST_P(umfMultiPoolTest, memoryTrackingAfterFree) {
+    // freed memory is likely to be reused by the next pool, which must be
+    // found instead of the previous one
+    static constexpr size_t allocSize = 1024 * 1024;
+
+    for (size_t i = 0; i < 2 * pools.size(); i++) {
+        auto pool = pools[i % pools.size()].get();
+
+        auto *ptr = umfPoolMalloc(pool, allocSize);
+        ASSERT_NE(ptr, nullptr);
+        ASSERT_EQ(umfPoolByPtr(ptr), pool);
+        ASSERT_EQ(umfPoolByPtr(static_cast<char *>(ptr) + allocSize - 1),
+                  pool);
+
+        ASSERT_EQ(umfFree(ptr), UMF_RESULT_SUCCESS);
+    }
+}
 #endif /* UMF_ENABLE_POOL_TRACKING_TESTS */
 
 /* malloc compliance tests */
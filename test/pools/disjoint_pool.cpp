@@ -2,6 +2,13 @@
 // Under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
 // SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
 #include "pool.hpp"
 #include "poolFixtures.hpp"
 #include "pool_disjoint.h"
@@ -148,6 +155,748 @@ TEST_F(test, sharedLimits) {
     EXPECT_EQ(MaxSize / SlabMinSize * 2, numFrees);
 }
 
+TEST_F(test, threadCacheFlush) {
+    static size_t numAllocs = 0;
+    static size_t numFrees = 0;
+
+    struct memory_provider : public umf_test::provider_base_t {
+        umf_result_t alloc(size_t size, size_t, void **ptr) noexcept {
+            *ptr = malloc(size);
+            numAllocs++;
+            return UMF_RESULT_SUCCESS;
+        }
+        umf_result_t free(void *ptr, [[maybe_unused]] size_t size) noexcept {
+            ::free(ptr);
+            numFrees++;
+            return UMF_RESULT_SUCCESS;
+        }
+    };
+    umf_memory_provider_ops_t provider_ops =
+        umf::providerMakeCOps<memory_provider, void>();
+
+    static constexpr size_t allocSize = 64;
+    static constexpr size_t numSlabs = 8;
+
+    auto config = poolConfig();
+    config.ThreadCacheSize = 16;
+
+    auto provider =
+        wrapProviderUnique(createProviderChecked(&provider_ops, nullptr));
+    auto pool = wrapPoolUnique(
+        createPoolChecked(umfDisjointPoolOps(), provider.get(), &config));
+
+    std::thread thread([&] {
+        std::vector<void *> ptrs;
+        for (size_t i = 0; i < numSlabs * config.SlabMinSize / allocSize;
+             i++) {
+            ptrs.push_back(umfPoolMalloc(pool.get(), allocSize));
+            ASSERT_NE(ptrs.back(), nullptr);
+        }
+        EXPECT_EQ(numAllocs, numSlabs);
+
+        for (auto ptr : ptrs) {
+            EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+        }
+
+        // Chunks held in the thread's cache keep their slabs allocated
+        EXPECT_GT(numAllocs - numFrees, 1);
+    });
+    thread.join();
+
+    // The cache is flushed on thread exit, only one empty slab can be pooled
+    EXPECT_EQ(numAllocs - numFrees, 1);
+
+    void *ptr = umfPoolMalloc(pool.get(), allocSize);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+
+    // The cache of the main thread is flushed on pool destruction
+    pool.reset();
+    EXPECT_EQ(numAllocs, numFrees);
+}
+
+TEST_F(test, reallocInPlace) {
+    auto config = poolConfig();
+    auto provider = wrapProviderUnique(
+        createProviderChecked(&MALLOC_PROVIDER_OPS, nullptr));
+    auto pool = wrapPoolUnique(
+        createPoolChecked(umfDisjointPoolOps(), provider.get(), &config));
+
+    void *ptr = umfPoolMalloc(pool.get(), 100);
+    ASSERT_NE(ptr, nullptr);
+    size_t usableSize = umfPoolMallocUsableSize(pool.get(), ptr);
+    EXPECT_GE(usableSize, 100);
+    memset(ptr, 0xab, 100);
+
+    // Sizes mapped to the same bucket are served from the same chunk
+    EXPECT_EQ(umfPoolRealloc(pool.get(), ptr, usableSize), ptr);
+
+    // Growing past the bucket size moves the allocation
+    void *newPtr = umfPoolRealloc(pool.get(), ptr, 2 * usableSize);
+    ASSERT_NE(newPtr, nullptr);
+    EXPECT_NE(newPtr, ptr);
+    EXPECT_GE(umfPoolMallocUsableSize(pool.get(), newPtr), 2 * usableSize);
+    for (size_t i = 0; i < 100; i++) {
+        ASSERT_EQ(static_cast<unsigned char *>(newPtr)[i], 0xab);
+    }
+
+    // Allocations from the memory provider report their exact size
+    size_t largeSize = 4 * config.MaxPoolableSize;
+    void *largePtr = umfPoolRealloc(pool.get(), newPtr, largeSize);
+    ASSERT_NE(largePtr, nullptr);
+    EXPECT_EQ(umfPoolMallocUsableSize(pool.get(), largePtr), largeSize);
+    EXPECT_EQ(umfPoolRealloc(pool.get(), largePtr, largeSize - 1), largePtr);
+
+    EXPECT_EQ(umfPoolRealloc(pool.get(), largePtr, 0), nullptr);
+}
+
+TEST_F(test, callocZeroedProvider) {
+    struct memory_provider : public umf_test::provider_base_t {
+        umf_result_t alloc(size_t size, size_t, void **ptr) noexcept {
+            *ptr = ::calloc(1, size);
+            return UMF_RESULT_SUCCESS;
+        }
+        umf_result_t free(void *ptr, [[maybe_unused]] size_t size) noexcept {
+            ::free(ptr);
+            return UMF_RESULT_SUCCESS;
+        }
+    };
+    umf_memory_provider_ops_t provider_ops =
+        umf::providerMakeCOps<memory_provider, void>();
+
+    static constexpr size_t allocSize = 64;
+
+    auto config = poolConfig();
+    config.ProviderMemoryZeroed = 1;
+
+    auto provider =
+        wrapProviderUnique(createProviderChecked(&provider_ops, nullptr));
+    auto pool = wrapPoolUnique(
+        createPoolChecked(umfDisjointPoolOps(), provider.get(), &config));
+
+    // Dirty the chunks, so that calloc must clear them when they are reused
+    std::vector<void *> ptrs;
+    for (size_t i = 0; i < config.SlabMinSize / allocSize; i++) {
+        ptrs.push_back(umfPoolMalloc(pool.get(), allocSize));
+        ASSERT_NE(ptrs.back(), nullptr);
+        memset(ptrs.back(), 0xff, allocSize);
+    }
+    for (auto ptr : ptrs) {
+        EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    }
+
+    for (auto &ptr : ptrs) {
+        ptr = umfPoolCalloc(pool.get(), 1, allocSize);
+        ASSERT_NE(ptr, nullptr);
+        for (size_t i = 0; i < allocSize; i++) {
+            ASSERT_EQ(static_cast<unsigned char *>(ptr)[i], 0);
+        }
+    }
+    for (auto ptr : ptrs) {
+        EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    }
+}
+
+TEST_F(test, alignedSlabs) {
+    static size_t numAllocs = 0;
+    static size_t lastAlignment = 0;
+
+    struct memory_provider : public provider_malloc {
+        umf_result_t alloc(size_t size, size_t align, void **ptr) noexcept {
+            numAllocs++;
+            lastAlignment = align;
+            return provider_malloc::alloc(size, align, ptr);
+        }
+    };
+    umf_memory_provider_ops_t provider_ops =
+        umf::providerMakeCOps<memory_provider, void>();
+
+    static constexpr size_t alignment = 1024;
+
+    auto config = poolConfig();
+    config.SlabMinSize = 64 * 1024;
+    config.MaxPoolableSize = 64 * 1024;
+
+    auto provider =
+        wrapProviderUnique(createProviderChecked(&provider_ops, nullptr));
+    auto pool = wrapPoolUnique(
+        createPoolChecked(umfDisjointPoolOps(), provider.get(), &config));
+
+    // Without padding all the allocations fit in a single aligned slab
+    std::vector<void *> ptrs;
+    for (size_t i = 0; i < config.SlabMinSize / alignment; i++) {
+        ptrs.push_back(umfPoolAlignedMalloc(pool.get(), alignment, alignment));
+        ASSERT_NE(ptrs.back(), nullptr);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(ptrs.back()) % alignment, 0);
+        EXPECT_EQ(umfPoolMallocUsableSize(pool.get(), ptrs.back()), alignment);
+    }
+    EXPECT_EQ(numAllocs, 1);
+    EXPECT_EQ(lastAlignment, alignment);
+
+    for (auto ptr : ptrs) {
+        EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    }
+}
+
+TEST_F(test, decayRelease) {
+    static size_t numAllocs = 0;
+    static size_t numFrees = 0;
+
+    struct memory_provider : public provider_malloc {
+        umf_result_t alloc(size_t size, size_t align, void **ptr) noexcept {
+            numAllocs++;
+            return provider_malloc::alloc(size, align, ptr);
+        }
+        umf_result_t free(void *ptr, size_t size) noexcept {
+            numFrees++;
+            return provider_malloc::free(ptr, size);
+        }
+    };
+    umf_memory_provider_ops_t provider_ops =
+        umf::providerMakeCOps<memory_provider, void>();
+
+    auto config = poolConfig();
+    config.ReleaseDelayMs = 1;
+
+    auto provider =
+        wrapProviderUnique(createProviderChecked(&provider_ops, nullptr));
+    auto pool = wrapPoolUnique(
+        createPoolChecked(umfDisjointPoolOps(), provider.get(), &config));
+
+    // The slab is kept in the pool after the free
+    void *ptr = umfPoolMalloc(pool.get(), config.SlabMinSize);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(numAllocs - numFrees, 1);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    // Other allocations release the idle slab lazily
+    for (int i = 0; i < 1024; i++) {
+        ptr = umfPoolMalloc(pool.get(), 64);
+        ASSERT_NE(ptr, nullptr);
+        EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    }
+    EXPECT_EQ(numFrees, 1);
+}
+
+TEST_F(test, decayThreadPurge) {
+    static std::atomic<size_t> numPurges = 0;
+
+    struct memory_provider : public provider_malloc {
+        umf_result_t purge_lazy(void *, size_t) noexcept {
+            numPurges++;
+            return UMF_RESULT_SUCCESS;
+        }
+    };
+    umf_memory_provider_ops_t provider_ops =
+        umf::providerMakeCOps<memory_provider, void>();
+
+    auto config = poolConfig();
+    config.PurgeDelayMs = 1;
+    config.DecayThread = 1;
+
+    auto provider =
+        wrapProviderUnique(createProviderChecked(&provider_ops, nullptr));
+    auto pool = wrapPoolUnique(
+        createPoolChecked(umfDisjointPoolOps(), provider.get(), &config));
+
+    void *ptr = umfPoolMalloc(pool.get(), config.SlabMinSize);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+
+    // Each idle slab is purged once
+    for (int i = 0; i < 100 && numPurges == 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_EQ(numPurges, 1);
+
+    // The purged slab is reused
+    ptr = umfPoolMalloc(pool.get(), config.SlabMinSize);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+}
+
+TEST_F(test, sizeClasses) {
+    static const size_t sizeClasses[] = {24, 40, 56, 80, 120, 4096};
+
+    auto config = poolConfig();
+    config.SizeClasses = sizeClasses;
+    config.NumSizeClasses = sizeof(sizeClasses) / sizeof(sizeClasses[0]);
+
+    auto provider = wrapProviderUnique(
+        createProviderChecked(&MALLOC_PROVIDER_OPS, nullptr));
+    auto pool = wrapPoolUnique(
+        createPoolChecked(umfDisjointPoolOps(), provider.get(), &config));
+
+    for (size_t size = 1; size <= config.MaxPoolableSize; size++) {
+        void *ptr = umfPoolMalloc(pool.get(), size);
+        ASSERT_NE(ptr, nullptr);
+        size_t expected = *std::lower_bound(std::begin(sizeClasses),
+                                            std::end(sizeClasses), size);
+        ASSERT_EQ(umfPoolMallocUsableSize(pool.get(), ptr), expected);
+        ASSERT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    }
+
+    // Size classes must be sorted
+    static const size_t unsortedSizeClasses[] = {64, 32};
+    config.SizeClasses = unsortedSizeClasses;
+    config.NumSizeClasses = 2;
+
+    umf_memory_pool_handle_t hPool = nullptr;
+    EXPECT_EQ(umfPoolCreate(umfDisjointPoolOps(), provider.get(), &config, 0,
+                            &hPool),
+              UMF_RESULT_ERROR_INVALID_ARGUMENT);
+}
+
+TEST_F(test, defaultSizeClasses) {
+    auto config = poolConfig();
+    config.MinBucketSize = 8;
+
+    auto provider = wrapProviderUnique(
+        createProviderChecked(&MALLOC_PROVIDER_OPS, nullptr));
+    auto pool = wrapPoolUnique(
+        createPoolChecked(umfDisjointPoolOps(), provider.get(), &config));
+
+    // Four size classes per power of 2, at least 8 bytes apart
+    static const std::pair<size_t, size_t> expected[] = {
+        {1, 8},     {9, 16},    {17, 24},   {25, 32},   {33, 40},
+        {56, 56},   {57, 64},   {65, 80},   {120, 128}, {129, 160},
+        {161, 192}, {200, 224}, {250, 256}, {257, 320}};
+    for (auto &[size, usableSize] : expected) {
+        void *ptr = umfPoolMalloc(pool.get(), size);
+        ASSERT_NE(ptr, nullptr);
+        EXPECT_EQ(umfPoolMallocUsableSize(pool.get(), ptr), usableSize);
+        EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    }
+}
+
+TEST_F(test, adaptiveSlabSize) {
+    static std::vector<size_t> allocSizes;
+
+    struct memory_provider : public provider_malloc {
+        umf_result_t alloc(size_t size, size_t align, void **ptr) noexcept {
+            allocSizes.push_back(size);
+            return provider_malloc::alloc(size, align, ptr);
+        }
+    };
+    umf_memory_provider_ops_t provider_ops =
+        umf::providerMakeCOps<memory_provider, void>();
+
+    static constexpr size_t allocSize = 64;
+
+    auto config = poolConfig();
+    config.SlabMaxSize = 4 * config.SlabMinSize;
+
+    auto provider =
+        wrapProviderUnique(createProviderChecked(&provider_ops, nullptr));
+    auto pool = wrapPoolUnique(
+        createPoolChecked(umfDisjointPoolOps(), provider.get(), &config));
+
+    // Slabs grow geometrically up to SlabMaxSize
+    std::vector<void *> ptrs;
+    size_t numChunks = (1 + 2 + 4 + 4) * config.SlabMinSize / allocSize;
+    for (size_t i = 0; i < numChunks; i++) {
+        ptrs.push_back(umfPoolMalloc(pool.get(), allocSize));
+        ASSERT_NE(ptrs.back(), nullptr);
+    }
+    std::vector<size_t> expected = {
+        config.SlabMinSize, 2 * config.SlabMinSize, 4 * config.SlabMinSize,
+        4 * config.SlabMinSize};
+    EXPECT_EQ(allocSizes, expected);
+
+    for (auto ptr : ptrs) {
+        EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    }
+
+    // The first slab is kept in the pool and three were returned, so slab
+    // sizes grow from SlabMinSize again
+    allocSizes.clear();
+    ptrs.clear();
+    numChunks = (1 + 1 + 2 + 4) * config.SlabMinSize / allocSize;
+    for (size_t i = 0; i < numChunks; i++) {
+        ptrs.push_back(umfPoolMalloc(pool.get(), allocSize));
+        ASSERT_NE(ptrs.back(), nullptr);
+    }
+    expected = {config.SlabMinSize, 2 * config.SlabMinSize,
+                4 * config.SlabMinSize};
+    EXPECT_EQ(allocSizes, expected);
+
+    for (auto ptr : ptrs) {
+        EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    }
+}
+
+TEST_F(test, largeCache) {
+    static size_t numAllocs = 0;
+    static size_t numFrees = 0;
+
+    struct memory_provider : public provider_malloc {
+        umf_result_t alloc(size_t size, size_t align, void **ptr) noexcept {
+            numAllocs++;
+            return provider_malloc::alloc(size, align, ptr);
+        }
+        umf_result_t free(void *ptr, size_t size) noexcept {
+            numFrees++;
+            return provider_malloc::free(ptr, size);
+        }
+    };
+    umf_memory_provider_ops_t provider_ops =
+        umf::providerMakeCOps<memory_provider, void>();
+
+    static constexpr size_t largeSize = 64 * 1024;
+
+    auto config = poolConfig();
+    config.LargeCacheSize = 2 * largeSize;
+
+    auto provider =
+        wrapProviderUnique(createProviderChecked(&provider_ops, nullptr));
+    auto pool = wrapPoolUnique(
+        createPoolChecked(umfDisjointPoolOps(), provider.get(), &config));
+
+    void *ptr = umfPoolMalloc(pool.get(), largeSize);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(numAllocs, 1);
+    EXPECT_EQ(numFrees, 0);
+
+    // A slightly smaller allocation reuses the cached region
+    void *ptr2 = umfPoolMalloc(pool.get(), largeSize - 1024);
+    EXPECT_EQ(ptr2, ptr);
+    EXPECT_EQ(numAllocs, 1);
+    EXPECT_EQ(umfPoolMallocUsableSize(pool.get(), ptr2), largeSize);
+
+    // A much smaller one does not, to bound the waste
+    void *ptr3 = umfPoolMalloc(pool.get(), largeSize / 2);
+    ASSERT_NE(ptr3, nullptr);
+    EXPECT_EQ(numAllocs, 2);
+
+    // The cache is bounded, the oldest region is evicted
+    void *ptr4 = umfPoolMalloc(pool.get(), 2 * largeSize);
+    ASSERT_NE(ptr4, nullptr);
+    EXPECT_EQ(umfPoolFree(pool.get(), ptr2), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(umfPoolFree(pool.get(), ptr3), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(numFrees, 0);
+    EXPECT_EQ(umfPoolFree(pool.get(), ptr4), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(numFrees, 2);
+
+    pool.reset();
+    EXPECT_EQ(numAllocs, numFrees);
+
+    // A region over the size limit is not cached, and evicts nothing
+    auto limits =
+        std::unique_ptr<umf_disjoint_pool_shared_limits_t,
+                        decltype(&umfDisjointPoolSharedLimitsDestroy)>(
+            umfDisjointPoolSharedLimitsCreate(2 * largeSize),
+            &umfDisjointPoolSharedLimitsDestroy);
+    config.SharedLimits = limits.get();
+    pool = wrapPoolUnique(
+        createPoolChecked(umfDisjointPoolOps(), provider.get(), &config));
+    numAllocs = numFrees = 0;
+
+    ptr = umfPoolMalloc(pool.get(), largeSize);
+    ASSERT_NE(ptr, nullptr);
+    ptr4 = umfPoolMalloc(pool.get(), 2 * largeSize);
+    ASSERT_NE(ptr4, nullptr);
+    EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(umfPoolFree(pool.get(), ptr4), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(numFrees, 1);
+    EXPECT_EQ(umfPoolMalloc(pool.get(), largeSize), ptr);
+    EXPECT_EQ(numAllocs, 2);
+    EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+
+    pool.reset();
+    EXPECT_EQ(numAllocs, numFrees);
+}
+
+TEST_F(test, numaNodeProviders) {
+    // Allocations of the pool's provider (0) and of the node providers
+    static size_t numAllocs[3] = {};
+    static size_t numFrees[3] = {};
+
+    struct memory_provider : public provider_malloc {
+        size_t index = 0;
+        umf_result_t initialize(size_t *index) noexcept {
+            this->index = *index;
+            return UMF_RESULT_SUCCESS;
+        }
+        umf_result_t alloc(size_t size, size_t align, void **ptr) noexcept {
+            numAllocs[index]++;
+            return provider_malloc::alloc(size, align, ptr);
+        }
+        umf_result_t free(void *ptr, size_t size) noexcept {
+            numFrees[index]++;
+            return provider_malloc::free(ptr, size);
+        }
+    };
+    umf_memory_provider_ops_t provider_ops =
+        umf::providerMakeCOps<memory_provider, size_t>();
+
+    std::vector<decltype(wrapProviderUnique(nullptr))> providers;
+    for (size_t i = 0; i < 3; i++) {
+        providers.push_back(
+            wrapProviderUnique(createProviderChecked(&provider_ops, &i)));
+    }
+    umf_memory_provider_handle_t nodeProviders[] = {providers[1].get(),
+                                                    providers[2].get()};
+
+    auto config = poolConfig();
+    config.NodeProviders = nodeProviders;
+    config.NumNodeProviders = 2;
+
+    auto pool = wrapPoolUnique(
+        createPoolChecked(umfDisjointPoolOps(), providers[0].get(), &config));
+
+    // Slabs are requested from the provider of the calling CPU's node
+    void *ptr = umfPoolMalloc(pool.get(), 64);
+    ASSERT_NE(ptr, nullptr);
+    void *slabPtr = umfPoolMalloc(pool.get(), config.SlabMinSize);
+    ASSERT_NE(slabPtr, nullptr);
+    EXPECT_EQ(numAllocs[0], 0);
+    EXPECT_EQ(numAllocs[1] + numAllocs[2], 2);
+
+    // Larger allocations are served by the pool's provider
+    void *largePtr = umfPoolMalloc(pool.get(), 2 * config.MaxPoolableSize);
+    ASSERT_NE(largePtr, nullptr);
+    EXPECT_EQ(numAllocs[0], 1);
+
+#if UMF_ENABLE_POOL_TRACKING_TESTS
+    // Memory of the node providers is attributed to the pool
+    EXPECT_EQ(umfPoolByPtr(ptr), pool.get());
+    EXPECT_EQ(umfPoolByPtr(slabPtr), pool.get());
+#endif
+
+    EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(umfPoolFree(pool.get(), slabPtr), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(umfPoolFree(pool.get(), largePtr), UMF_RESULT_SUCCESS);
+
+    pool.reset();
+    for (size_t i = 0; i < 3; i++) {
+        EXPECT_EQ(numAllocs[i], numFrees[i]);
+    }
+
+    // All node providers must be set
+    nodeProviders[1] = nullptr;
+    umf_memory_pool_handle_t hPool = nullptr;
+    EXPECT_EQ(umfPoolCreate(umfDisjointPoolOps(), providers[0].get(), &config,
+                            0, &hPool),
+              UMF_RESULT_ERROR_INVALID_ARGUMENT);
+
+#if UMF_ENABLE_POOL_TRACKING_TESTS
+    // Only the provider of a pool can be passed as hPoolProvider
+    umf_memory_provider_handle_t hTracked = nullptr;
+    EXPECT_EQ(umfPoolTrackMemoryProvider(providers[0].get(),
+                                         providers[1].get(), &hTracked),
+              UMF_RESULT_ERROR_INVALID_ARGUMENT);
+#endif
+}
+
+TEST_F(test, remoteFrees) {
+    static std::atomic<size_t> numAllocs{0};
+    static std::atomic<size_t> numFrees{0};
+
+    struct memory_provider : public provider_malloc {
+        umf_result_t alloc(size_t size, size_t align, void **ptr) noexcept {
+            numAllocs++;
+            return provider_malloc::alloc(size, align, ptr);
+        }
+        umf_result_t free(void *ptr, size_t size) noexcept {
+            numFrees++;
+            return provider_malloc::free(ptr, size);
+        }
+    };
+    umf_memory_provider_ops_t provider_ops =
+        umf::providerMakeCOps<memory_provider, void>();
+
+    auto config = poolConfig();
+    config.RemoteFreeQueueSize = 64;
+
+    auto provider =
+        wrapProviderUnique(createProviderChecked(&provider_ops, nullptr));
+    auto pool = wrapPoolUnique(
+        createPoolChecked(umfDisjointPoolOps(), provider.get(), &config));
+
+    // One thread allocates and the other one frees, the frees contend with
+    // the allocations on the bucket lock.
+    static constexpr size_t numPtrs = 100000;
+    std::vector<void *> ptrs;
+    std::mutex lock;
+    std::atomic<bool> done{false};
+
+    std::thread consumer([&] {
+        while (true) {
+            bool last = done.load();
+            std::vector<void *> batch;
+            {
+                std::lock_guard<std::mutex> lg(lock);
+                batch.swap(ptrs);
+            }
+            for (auto ptr : batch) {
+                EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+            }
+            if (last && batch.empty()) {
+                break;
+            }
+        }
+    });
+
+    for (size_t i = 0; i < numPtrs; i++) {
+        void *ptr = umfPoolMalloc(pool.get(), 64);
+        if (!ptr) {
+            ADD_FAILURE() << "allocation failed";
+            break;
+        }
+        memset(ptr, 0xab, 64);
+        std::lock_guard<std::mutex> lg(lock);
+        ptrs.push_back(ptr);
+    }
+    done = true;
+    consumer.join();
+
+    // The deferred frees are completed on the next allocation
+    void *ptr = umfPoolMalloc(pool.get(), 64);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(umfPoolFree(pool.get(), ptr), UMF_RESULT_SUCCESS);
+
+    pool.reset();
+    EXPECT_EQ(numAllocs, numFrees);
+}
+
+TEST_F(test, hierarchicalLimits) {
+    auto config = poolConfig();
+    const size_t slabSize = config.SlabMinSize;
+
+    using limits_unique_t =
+        std::unique_ptr<umf_disjoint_pool_shared_limits_t,
+                        decltype(&umfDisjointPoolSharedLimitsDestroy)>;
+    auto process = limits_unique_t(
+        umfDisjointPoolSharedLimitsCreateEx(SIZE_MAX, 0, 4 * slabSize, NULL),
+        &umfDisjointPoolSharedLimitsDestroy);
+    ASSERT_NE(process, nullptr);
+    auto tenant = limits_unique_t(umfDisjointPoolSharedLimitsCreateEx(
+                                      SIZE_MAX, 2 * slabSize, 0, process.get()),
+                                  &umfDisjointPoolSharedLimitsDestroy);
+    ASSERT_NE(tenant, nullptr);
+    config.SharedLimits = tenant.get();
+
+    auto provider = wrapProviderUnique(
+        createProviderChecked(&MALLOC_PROVIDER_OPS, nullptr));
+    auto pool1 = wrapPoolUnique(
+        createPoolChecked(umfDisjointPoolOps(), provider.get(), &config));
+    auto pool2 = wrapPoolUnique(
+        createPoolChecked(umfDisjointPoolOps(), provider.get(), &config));
+
+    // The hard limit of the process covers the memory in use by the tenant
+    std::vector<void *> ptrs;
+    for (size_t i = 0; i < 4; i++) {
+        ptrs.push_back(umfPoolMalloc(pool1.get(), slabSize));
+        ASSERT_NE(ptrs.back(), nullptr);
+    }
+    EXPECT_EQ(umfDisjointPoolSharedLimitsGetUsedSize(tenant.get()),
+              4 * slabSize);
+    EXPECT_EQ(umfDisjointPoolSharedLimitsGetUsedSize(process.get()),
+              4 * slabSize);
+    EXPECT_EQ(umfPoolMalloc(pool1.get(), slabSize), nullptr);
+    EXPECT_EQ(umfPoolGetLastAllocationError(pool1.get()),
+              UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY);
+
+    // Nothing is cached above the soft limit of the tenant
+    for (auto ptr : ptrs) {
+        EXPECT_EQ(umfPoolFree(pool1.get(), ptr), UMF_RESULT_SUCCESS);
+    }
+    EXPECT_EQ(umfDisjointPoolSharedLimitsGetUsedSize(tenant.get()),
+              2 * slabSize);
+
+    // Exceeding the soft limit releases the memory cached by all the pools
+    // of the tenant
+    void *ptr = umfPoolMalloc(pool2.get(), 64);
+    ASSERT_NE(ptr, nullptr);
+    EXPECT_EQ(umfDisjointPoolSharedLimitsGetUsedSize(tenant.get()),
+              3 * slabSize);
+    void *ptr2 = umfPoolMalloc(pool2.get(), 64);
+    ASSERT_NE(ptr2, nullptr);
+    EXPECT_EQ(umfDisjointPoolSharedLimitsGetUsedSize(tenant.get()), slabSize);
+    EXPECT_EQ(umfDisjointPoolSharedLimitsGetUsedSize(process.get()), slabSize);
+
+    EXPECT_EQ(umfPoolFree(pool2.get(), ptr), UMF_RESULT_SUCCESS);
+    EXPECT_EQ(umfPoolFree(pool2.get(), ptr2), UMF_RESULT_SUCCESS);
+    pool1.reset();
+    pool2.reset();
+    EXPECT_EQ(umfDisjointPoolSharedLimitsGetUsedSize(process.get()), 0);
+
+    // Reaching the hard limit releases the memory cached below it
+    config.SharedLimits = process.get();
+    auto pool3 = wrapPoolUnique(
+        createPoolChecked(umfDisjointPoolOps(), provider.get(), &config));
+    auto pool4 = wrapPoolUnique(
+        createPoolChecked(umfDisjointPoolOps(), provider.get(), &config));
+    for (auto &ptr : ptrs) {
+        ptr = umfPoolMalloc(pool3.get(), slabSize);
+        ASSERT_NE(ptr, nullptr);
+    }
+    for (auto ptr : ptrs) {
+        EXPECT_EQ(umfPoolFree(pool3.get(), ptr), UMF_RESULT_SUCCESS);
+    }
+    ASSERT_GT(umfDisjointPoolSharedLimitsGetUsedSize(process.get()), 0);
+    for (auto &ptr : ptrs) {
+        ptr = umfPoolMalloc(pool4.get(), slabSize);
+        ASSERT_NE(ptr, nullptr);
+    }
+    // Only the memory of pool4 is left, pool3 has released its cache
+    EXPECT_EQ(umfDisjointPoolSharedLimitsGetUsedSize(process.get()),
+              4 * slabSize);
+    for (auto ptr : ptrs) {
+        EXPECT_EQ(umfPoolFree(pool4.get(), ptr), UMF_RESULT_SUCCESS);
+    }
+}
+
+TEST_F(test, batchAllocFree) {
+    auto config = poolConfig();
+    const size_t slabSize = config.SlabMinSize;
+    static constexpr size_t allocSize = 64;
+    const size_t chunksPerSlab = slabSize / allocSize;
+
+    using limits_unique_t =
+        std::unique_ptr<umf_disjoint_pool_shared_limits_t,
+                        decltype(&umfDisjointPoolSharedLimitsDestroy)>;
+    auto limits = limits_unique_t(
+        umfDisjointPoolSharedLimitsCreateEx(SIZE_MAX, 0, 2 * slabSize, NULL),
+        &umfDisjointPoolSharedLimitsDestroy);
+    ASSERT_NE(limits, nullptr);
+    config.SharedLimits = limits.get();
+
+    auto provider = wrapProviderUnique(
+        createProviderChecked(&MALLOC_PROVIDER_OPS, nullptr));
+    auto pool = wrapPoolUnique(
+        createPoolChecked(umfDisjointPoolOps(), provider.get(), &config));
+
+    // The batch is cut short by the hard limit
+    std::vector<void *> ptrs(3 * chunksPerSlab, nullptr);
+    size_t num =
+        umfPoolMallocBatch(pool.get(), allocSize, ptrs.size(), ptrs.data());
+    ASSERT_EQ(num, 2 * chunksPerSlab);
+    EXPECT_EQ(umfPoolGetLastAllocationError(pool.get()),
+              UMF_RESULT_ERROR_OUT_OF_HOST_MEMORY);
+    std::sort(ptrs.begin(), ptrs.begin() + num);
+    EXPECT_EQ(std::adjacent_find(ptrs.begin(), ptrs.begin() + num),
+              ptrs.begin() + num);
+    for (size_t i = 0; i < num; i++) {
+        std::memset(ptrs[i], 0xab, allocSize);
+    }
+
+    EXPECT_EQ(umfPoolFreeBatch(pool.get(), ptrs.data(), ptrs.size()),
+              UMF_RESULT_SUCCESS);
+
+    // The slabs are kept in the pool and reused by the next batch
+    num = umfPoolMallocBatch(pool.get(), allocSize, num, ptrs.data());
+    ASSERT_EQ(num, 2 * chunksPerSlab);
+    EXPECT_EQ(umfDisjointPoolSharedLimitsGetUsedSize(limits.get()),
+              2 * slabSize);
+    EXPECT_EQ(umfPoolFreeBatch(pool.get(), ptrs.data(), num),
+              UMF_RESULT_SUCCESS);
+}
+
 auto defaultPoolConfig = poolConfig();
 INSTANTIATE_TEST_SUITE_P(disjointPoolTests, umfPoolTest,
                          ::testing::Values(poolCreateExtParams{
@@ -166,3 +915,22 @@ INSTANTIATE_TEST_SUITE_P(disjointMultiPoolTests, umfMultiPoolTest,
                          ::testing::Values(poolCreateExtParams{
                              umfDisjointPoolOps(), (void *)&defaultPoolConfig,
                              &MALLOC_PROVIDER_OPS, nullptr}));
+
+umf_disjoint_pool_params_t threadCachePoolConfig() {
+    umf_disjoint_pool_params_t config = poolConfig();
+    config.ThreadCacheSize = 32;
+    return config;
+}
+
+auto threadCacheConfig = threadCachePoolConfig();
+INSTANTIATE_TEST_SUITE_P(disjointPoolThreadCacheTests, umfPoolTest,
+                         ::testing::Values(poolCreateExtParams{
+                             umfDisjointPoolOps(),
+                             (void *)&threadCacheConfig,
+                             &MALLOC_PROVIDER_OPS, nullptr}));
+
+INSTANTIATE_TEST_SUITE_P(disjointMultiPoolThreadCacheTests, umfMultiPoolTest,
+                         ::testing::Values(poolCreateExtParams{
+                             umfDisjointPoolOps(),
+                             (void *)&threadCacheConfig,
+                             &MALLOC_PROVIDER_OPS, nullptr}));
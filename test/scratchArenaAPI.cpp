@@ -0,0 +1,101 @@
+// Copyright (C) 2024 Intel Corporation
+// Under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+// This file contains tests for UMF scratch arena API
+
+#include <umf/scratch_arena.h>
+
+#include "base.hpp"
+#include "test_helpers.h"
+
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using umf_test::test;
+
+using arena_unique_handle_t =
+    std::unique_ptr<umf_scratch_arena_t, decltype(&umfScratchArenaDestroy)>;
+
+static arena_unique_handle_t createArena(size_t size) {
+    umf_scratch_arena_handle_t hArena = nullptr;
+    auto ret = umfScratchArenaCreate(size, &hArena);
+    EXPECT_EQ(ret, UMF_RESULT_SUCCESS);
+    return arena_unique_handle_t(hArena, &umfScratchArenaDestroy);
+}
+
+TEST_F(test, scratchArenaCreateInvalidArgs) {
+    auto ret = umfScratchArenaCreate(0, nullptr);
+    ASSERT_EQ(ret, UMF_RESULT_ERROR_INVALID_ARGUMENT);
+}
+
+TEST_F(test, scratchArenaAllocReset) {
+    static constexpr size_t ARENA_SIZE = 4096;
+    static constexpr int ITERATIONS = 10;
+    static constexpr int N_BUFFERS = 64;
+
+    auto arena = createArena(ARENA_SIZE);
+    ASSERT_NE(arena.get(), nullptr);
+
+    for (int iter = 0; iter < ITERATIONS; iter++) {
+        // the buffers need more memory than the arena was created with
+        std::vector<unsigned char *> buffers;
+        for (int i = 0; i < N_BUFFERS; i++) {
+            size_t size = (i % 4 == 3) ? 4 * ARENA_SIZE : (size_t)i + 1;
+            auto ptr =
+                (unsigned char *)umfScratchArenaAlloc(arena.get(), size);
+            ASSERT_NE(ptr, nullptr);
+            ASSERT_EQ((uintptr_t)ptr % sizeof(void *), 0);
+            memset(ptr, i, size);
+            buffers.push_back(ptr);
+        }
+
+        for (int i = 0; i < N_BUFFERS; i++) {
+            size_t size = (i % 4 == 3) ? 4 * ARENA_SIZE : (size_t)i + 1;
+            ASSERT_EQ(buffers[i][0], i);
+            ASSERT_EQ(buffers[i][size - 1], i);
+        }
+
+        umfScratchArenaReset(arena.get());
+    }
+}
+
+TEST_F(test, scratchArenaMultiThreadedAlloc) {
+    static constexpr int NTHREADS = 8;
+    static constexpr int N_BUFFERS = 1000;
+    static constexpr size_t BUFFER_SIZE = 40;
+
+    auto arena = createArena(0);
+    ASSERT_NE(arena.get(), nullptr);
+
+    auto arenaAlloc = [&](int TID) {
+        std::vector<unsigned char *> buffers;
+        for (int i = 0; i < N_BUFFERS; i++) {
+            auto ptr = (unsigned char *)umfScratchArenaAlloc(arena.get(),
+                                                             BUFFER_SIZE);
+            UT_ASSERTne(ptr, nullptr);
+            memset(ptr, TID, BUFFER_SIZE);
+            buffers.push_back(ptr);
+        }
+
+        for (auto ptr : buffers) {
+            for (size_t k = 0; k < BUFFER_SIZE; k++) {
+                UT_ASSERTeq(ptr[k], TID);
+            }
+        }
+    };
+
+    for (int iter = 0; iter < 2; iter++) {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < NTHREADS; i++) {
+            threads.emplace_back(arenaAlloc, i);
+        }
+
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        umfScratchArenaReset(arena.get());
+    }
+}
@@ -10,6 +10,7 @@
 #include <thread>
 
 #include "base_alloc.h"
+#include "base_alloc_global.h"
 
 #include "base.hpp"
 #include "test_helpers.h"
@@ -51,3 +52,133 @@ TEST_F(test, baseAllocMultiThreadedAllocMemset) {
         thread.join();
     }
 }
+
+TEST_F(test, baseAllocMultiThreadedFreeByOtherThreads) {
+    static constexpr int NTHREADS = 8;
+    static constexpr int ITERATIONS = 10;
+    static constexpr int NCHUNKS = 256;
+    static constexpr int ALLOCATION_SIZE = 16;
+
+    auto pool = std::shared_ptr<umf_ba_pool_t>(umf_ba_create(ALLOCATION_SIZE),
+                                               umf_ba_destroy);
+    ASSERT_NE(pool.get(), nullptr);
+
+    std::vector<std::vector<unsigned char *>> ptrs(NTHREADS);
+
+    auto poolAlloc = [&](int TID) {
+        for (int i = 0; i < NCHUNKS; i++) {
+            auto ptr = (unsigned char *)umf_ba_alloc(pool.get());
+            UT_ASSERTne(ptr, nullptr);
+            memset(ptr, TID, ALLOCATION_SIZE);
+            ptrs[TID].push_back(ptr);
+        }
+    };
+
+    // each thread frees the chunks of the next one, so the chunks move
+    // between the free lists of the threads
+    auto poolFree = [&](int TID) {
+        for (auto ptr : ptrs[(TID + 1) % NTHREADS]) {
+            for (int k = 0; k < ALLOCATION_SIZE; k++) {
+                UT_ASSERTeq(ptr[k], (TID + 1) % NTHREADS);
+            }
+            umf_ba_free(pool.get(), ptr);
+        }
+    };
+
+    for (int iter = 0; iter < ITERATIONS; iter++) {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < NTHREADS; i++) {
+            threads.emplace_back(poolAlloc, i);
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        threads.clear();
+        for (int i = 0; i < NTHREADS; i++) {
+            threads.emplace_back(poolFree, i);
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+
+        for (auto &v : ptrs) {
+            v.clear();
+        }
+    }
+}
+
+TEST_F(test, baseAllocGlobalSizeClasses) {
+    static constexpr size_t sizeClasses[] = {16, 32, 64, 128, 256, 512};
+
+    size_t prevSize = 0;
+    umf_ba_pool_t *prevPool = nullptr;
+    for (auto size : sizeClasses) {
+        auto pool = umf_ba_get_pool(size);
+        ASSERT_NE(pool, nullptr);
+        ASSERT_NE(pool, prevPool);
+
+        // sizes between the classes get the pool of the larger class
+        ASSERT_EQ(umf_ba_get_pool(prevSize + 1), pool);
+
+        void *ptr = umf_ba_alloc(pool);
+        ASSERT_NE(ptr, nullptr);
+        memset(ptr, 0xFF, size);
+        umf_ba_free(pool, ptr);
+
+        prevSize = size;
+        prevPool = pool;
+    }
+}
+
+TEST_F(test, baseAllocReleaseFreeRegions) {
+    static constexpr int ITERATIONS = 4;
+    static constexpr int NCHUNKS = 64 * 1024;
+    static constexpr int ALLOCATION_SIZE = 64;
+
+    auto pool = std::shared_ptr<umf_ba_pool_t>(umf_ba_create(ALLOCATION_SIZE),
+                                               umf_ba_destroy);
+    ASSERT_NE(pool.get(), nullptr);
+
+    // the regions of a pool reused in cycles are not released and mapped
+    // again in every cycle
+    umf_ba_stats_t stats;
+    size_t n_region_maps = 0;
+    std::vector<unsigned char *> ptrs(NCHUNKS);
+    for (int iter = 0; iter < ITERATIONS; iter++) {
+        for (int i = 0; i < NCHUNKS; i++) {
+            ptrs[i] = (unsigned char *)umf_ba_alloc(pool.get());
+            ASSERT_NE(ptrs[i], nullptr);
+            memset(ptrs[i], i & 0xFF, ALLOCATION_SIZE);
+        }
+        if (iter == 0) {
+            umf_ba_get_stats(pool.get(), &stats);
+            n_region_maps = stats.n_region_maps;
+        }
+
+        // free every other chunk first, so no region is free until the
+        // second pass
+        for (int first : {0, 1}) {
+            for (int i = first; i < NCHUNKS; i += 2) {
+                ASSERT_EQ(ptrs[i][ALLOCATION_SIZE - 1], i & 0xFF);
+                umf_ba_free(pool.get(), ptrs[i]);
+            }
+        }
+    }
+    umf_ba_get_stats(pool.get(), &stats);
+    EXPECT_EQ(stats.n_region_maps, n_region_maps);
+
+    // once the pool needs only a few chunks, the free regions are released
+    size_t n_regions = stats.n_regions;
+    for (int iter = 0; iter < 1024 && stats.n_regions > n_regions / 2;
+         iter++) {
+        for (int i = 0; i < NCHUNKS / 16; i++) {
+            void *ptr = umf_ba_alloc(pool.get());
+            ASSERT_NE(ptr, nullptr);
+            umf_ba_free(pool.get(), ptr);
+        }
+        umf_ba_get_stats(pool.get(), &stats);
+    }
+    EXPECT_LE(stats.n_regions, n_regions / 2);
+    EXPECT_EQ(stats.n_region_maps, n_region_maps);
+}
@@ -59,3 +59,24 @@ TEST_F(test, baseAllocLinearMultiThreadedAllocMemset) {
         thread.join();
     }
 }
+
+TEST_F(test, baseAllocLinearLargeAllocReset) {
+    static constexpr int ITERATIONS = 4;
+    static constexpr size_t POOL_SIZE = 1024;
+
+    auto pool = std::shared_ptr<umf_ba_linear_pool_t>(
+        umf_ba_linear_create(POOL_SIZE), umf_ba_linear_destroy);
+    ASSERT_NE(pool.get(), nullptr);
+
+    for (int iter = 0; iter < ITERATIONS; iter++) {
+        // allocations larger than a pool get pools of their own
+        for (size_t size = POOL_SIZE; size <= 64 * POOL_SIZE; size *= 2) {
+            auto ptr = (unsigned char *)umf_ba_linear_alloc(pool.get(), size);
+            ASSERT_NE(ptr, nullptr);
+            memset(ptr, iter, size);
+            ASSERT_EQ(ptr[size - 1], iter);
+        }
+
+        umf_ba_linear_reset(pool.get());
+    }
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2024 Intel Corporation
+ *
+ * Under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+*/
+
+#include <cerrno>
+#include <thread>
+#include <vector>
+
+#include "critnib/critnib.h"
+
+#include "base.hpp"
+#include "test_helpers.h"
+
+using umf_test::test;
+
+TEST_F(test, critnibMultiThreadedInsertRemove) {
+    static constexpr int NTHREADS = 8;
+    static constexpr int ITERATIONS = 50;
+    static constexpr int NKEYS = 128;
+
+    auto c = std::shared_ptr<critnib>(critnib_new(), critnib_delete);
+    ASSERT_NE(c.get(), nullptr);
+
+    // keys of the threads are interleaved, so they share the tree's nodes
+    auto key = [](int TID, int i) {
+        return (uintptr_t)(i * NTHREADS + TID + 1) * 64;
+    };
+
+    auto insertRemove = [&](int TID) {
+        for (int iter = 0; iter < ITERATIONS; iter++) {
+            for (int i = 0; i < NKEYS; i++) {
+                UT_ASSERTeq(critnib_insert(c.get(), key(TID, i),
+                                           (void *)key(TID, i), 0),
+                            0);
+            }
+
+            for (int i = 0; i < NKEYS; i++) {
+                UT_ASSERTeq(critnib_get(c.get(), key(TID, i)),
+                            (void *)key(TID, i));
+                uintptr_t rkey;
+                void *rvalue;
+                UT_ASSERTeq(critnib_find(c.get(), key(TID, i), FIND_LE, &rkey,
+                                         &rvalue),
+                            1);
+                UT_ASSERTeq(rkey, key(TID, i));
+            }
+
+            for (int i = 0; i < NKEYS; i++) {
+                UT_ASSERTeq(critnib_remove(c.get(), key(TID, i)),
+                            (void *)key(TID, i));
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < NTHREADS; i++) {
+        threads.emplace_back(insertRemove, i);
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (int i = 0; i < NTHREADS * NKEYS; i++) {
+        UT_ASSERTeq(critnib_get(c.get(), (uintptr_t)(i + 1) * 64), nullptr);
+    }
+}
+
+TEST_F(test, critnibInlineValues) {
+    struct value_t {
+        void *ptr;
+        size_t size;
+    };
+
+    auto c = std::shared_ptr<critnib>(critnib_new_inline(sizeof(value_t)),
+                                      critnib_delete);
+    ASSERT_NE(c.get(), nullptr);
+
+    for (uintptr_t key = 64; key <= 1024; key += 64) {
+        value_t value = {(void *)key, key / 64};
+        UT_ASSERTeq(critnib_insert_inline(c.get(), key, &value, 0), 0);
+    }
+
+    value_t value = {nullptr, 0};
+    UT_ASSERTeq(critnib_insert_inline(c.get(), 64, &value, 0), EEXIST);
+
+    UT_ASSERTeq(critnib_get_inline(c.get(), 128, &value), 1);
+    UT_ASSERTeq(value.ptr, (void *)128);
+    UT_ASSERTeq(value.size, 2);
+    UT_ASSERTeq(critnib_get_inline(c.get(), 130, &value), 0);
+
+    uintptr_t rkey;
+    UT_ASSERTeq(critnib_find_inline(c.get(), 200, FIND_LE, &rkey, &value), 1);
+    UT_ASSERTeq(rkey, 192);
+    UT_ASSERTeq(value.size, 3);
+
+    value = {nullptr, 42};
+    UT_ASSERTeq(critnib_insert_inline(c.get(), 192, &value, 1), 0);
+    UT_ASSERTeq(critnib_remove_inline(c.get(), 192, &value), 1);
+    UT_ASSERTeq(value.ptr, nullptr);
+    UT_ASSERTeq(value.size, 42);
+    UT_ASSERTeq(critnib_remove_inline(c.get(), 192, &value), 0);
+
+    for (uintptr_t key = 64; key <= 1024; key += 64) {
+        UT_ASSERTeq(critnib_remove_inline(c.get(), key, nullptr), key != 192);
+    }
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2024 Intel Corporation
+ *
+ * Under the Apache License v2.0 with LLVM Exceptions. See LICENSE.TXT.
+ * SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+*/
+
+#include <thread>
+#include <vector>
+
+#include "page_map/page_map.h"
+
+#include "base.hpp"
+#include "test_helpers.h"
+
+using umf_test::test;
+
+static constexpr uintptr_t PAGE = PAGE_MAP_PAGE_SIZE;
+
+TEST_F(test, pageMapSetClear) {
+    auto pm = std::shared_ptr<page_map>(page_map_new(), page_map_delete);
+    ASSERT_NE(pm.get(), nullptr);
+
+    uintptr_t base = 0x7f0000000000;
+    void *value = (void *)0x1234;
+
+    UT_ASSERTeq(page_map_get(pm.get(), base), nullptr);
+
+    // only the pages fully covered by the range are mapped
+    UT_ASSERTeq(page_map_set(pm.get(), base + 8, 4 * PAGE, value), 0);
+    UT_ASSERTeq(page_map_get(pm.get(), base + 8), nullptr);
+    UT_ASSERTeq(page_map_get(pm.get(), base + PAGE), value);
+    UT_ASSERTeq(page_map_get(pm.get(), base + 4 * PAGE - 1), value);
+    UT_ASSERTeq(page_map_get(pm.get(), base + 4 * PAGE), nullptr);
+
+    // all pages overlapping the range are unmapped
+    page_map_clear(pm.get(), base + 8, 4 * PAGE);
+    for (uintptr_t addr = base; addr < base + 5 * PAGE; addr += PAGE) {
+        UT_ASSERTeq(page_map_get(pm.get(), addr), nullptr);
+    }
+
+    // a range spanning two leaves
+    uintptr_t leaf_end = (uintptr_t)1 << 40;
+    UT_ASSERTeq(page_map_set(pm.get(), leaf_end - PAGE, 2 * PAGE, value), 0);
+    UT_ASSERTeq(page_map_get(pm.get(), leaf_end - 1), value);
+    UT_ASSERTeq(page_map_get(pm.get(), leaf_end), value);
+    page_map_clear(pm.get(), leaf_end - PAGE, 2 * PAGE);
+    UT_ASSERTeq(page_map_get(pm.get(), leaf_end - 1), nullptr);
+    UT_ASSERTeq(page_map_get(pm.get(), leaf_end), nullptr);
+
+    // addresses beyond the map are never mapped
+    UT_ASSERTeq(page_map_set(pm.get(), UINTPTR_MAX - 4 * PAGE + 1, 4 * PAGE,
+                             value),
+                0);
+    UT_ASSERTeq(page_map_get(pm.get(), UINTPTR_MAX - PAGE), nullptr);
+    page_map_clear(pm.get(), UINTPTR_MAX - 4 * PAGE + 1, 4 * PAGE);
+}
+
+TEST_F(test, pageMapMultiThreaded) {
+    static constexpr int NTHREADS = 8;
+    static constexpr int ITERATIONS = 50;
+    static constexpr int NRANGES = 128;
+
+    auto pm = std::shared_ptr<page_map>(page_map_new(), page_map_delete);
+    ASSERT_NE(pm.get(), nullptr);
+
+    // ranges of the threads are interleaved, so they share the leaves
+    auto addr = [](int TID, int i) {
+        return (uintptr_t)0x7f0000000000 + (i * NTHREADS + TID) * 2 * PAGE;
+    };
+
+    auto setClear = [&](int TID) {
+        for (int iter = 0; iter < ITERATIONS; iter++) {
+            for (int i = 0; i < NRANGES; i++) {
+                UT_ASSERTeq(page_map_set(pm.get(), addr(TID, i), 2 * PAGE,
+                                         (void *)addr(TID, i)),
+                            0);
+            }
+
+            for (int i = 0; i < NRANGES; i++) {
+                UT_ASSERTeq(page_map_get(pm.get(), addr(TID, i) + PAGE),
+                            (void *)addr(TID, i));
+            }
+
+            for (int i = 0; i < NRANGES; i++) {
+                page_map_clear(pm.get(), addr(TID, i), 2 * PAGE);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < NTHREADS; i++) {
+        threads.emplace_back(setClear, i);
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (int i = 0; i < NTHREADS * NRANGES; i++) {
+        UT_ASSERTeq(page_map_get(pm.get(), addr(0, 0) + i * 2 * PAGE),
+                    nullptr);
+    }
+}